@@ -72,6 +72,7 @@ namespace math {
 
 namespace path {
 	constexpr char shader[] = "shaders/";
+	constexpr char spirv[] = "cache/spirv/";
 	namespace asset {
 		constexpr char cubemap[] = "assets/cubemaps/";
 		constexpr char model[] = "assets/models/";
@@ -0,0 +1,161 @@
+#include <rendercat/core/shadow_atlas.hpp>
+#include <rendercat/common.hpp>
+#include <algorithm>
+#include <cassert>
+
+using namespace rc;
+
+ShadowAtlas::ShadowAtlas(uint32_t size, uint32_t min_region_size) : m_size(size), m_min_size(min_region_size)
+{
+	assert(rc::math::is_power_of_two(size));
+	assert(rc::math::is_power_of_two(min_region_size));
+	assert(min_region_size <= size);
+
+	// complete quadtree: 1 + 4 + 16 + ... nodes down to the smallest region size
+	size_t node_count = 0;
+	size_t level_nodes = 1;
+	for (uint32_t s = size; s >= min_region_size; s /= 2) {
+		node_count += level_nodes;
+		level_nodes *= 4;
+	}
+	m_nodes.resize(node_count, NodeState::Free);
+}
+
+bool ShadowAtlas::allocate_recursive(int32_t node, uint32_t node_size, uint16_t x, uint16_t y,
+                                     uint32_t target_size, bool allow_split, Region& out)
+{
+	auto& state = m_nodes[node];
+	if (state == NodeState::Used)
+		return false;
+
+	if (node_size == target_size) {
+		if (state != NodeState::Free)
+			return false;
+
+		state = NodeState::Used;
+		out = Region{x, y, uint16_t(node_size), node};
+		return true;
+	}
+
+	// first pass only descends into already split nodes to keep large free blocks intact
+	if (state == NodeState::Free) {
+		if (!allow_split)
+			return false;
+		state = NodeState::Split;
+	}
+
+	const uint32_t half = node_size / 2;
+	for (int child = 0; child < 4; ++child) {
+		const auto cx = uint16_t(x + (child & 1) * half);
+		const auto cy = uint16_t(y + (child >> 1) * half);
+		if (allocate_recursive(node * 4 + 1 + child, half, cx, cy, target_size, allow_split, out))
+			return true;
+	}
+
+	// nothing fit, undo the split if we made it
+	const bool all_free = std::all_of(&m_nodes[node * 4 + 1], &m_nodes[node * 4 + 5],
+	                                  [](auto s){ return s == NodeState::Free; });
+	if (all_free)
+		state = NodeState::Free;
+	return false;
+}
+
+ShadowAtlas::Region ShadowAtlas::allocate(uint32_t size)
+{
+	uint32_t target = m_min_size;
+	while (target < size)
+		target *= 2;
+
+	Region region;
+	if (target > m_size)
+		return region;
+
+	if (allocate_recursive(0, m_size, 0, 0, target, false, region)
+	    || allocate_recursive(0, m_size, 0, 0, target, true, region)) {
+		m_used_area += uint64_t(target) * target;
+	}
+	return region;
+}
+
+void ShadowAtlas::release(Region& region) noexcept
+{
+	if (!region.valid())
+		return;
+
+	assert(m_nodes[region.node] == NodeState::Used);
+	m_nodes[region.node] = NodeState::Free;
+	m_used_area -= uint64_t(region.size) * region.size;
+
+	// merge parents whose children are all free again
+	int32_t node = region.node;
+	while (node > 0) {
+		const int32_t parent = (node - 1) / 4;
+		const bool all_free = std::all_of(&m_nodes[parent * 4 + 1], &m_nodes[parent * 4 + 5],
+		                                  [](auto s){ return s == NodeState::Free; });
+		if (!all_free)
+			break;
+		m_nodes[parent] = NodeState::Free;
+		node = parent;
+	}
+	region = Region{};
+}
+
+void ShadowAtlas::clear() noexcept
+{
+	std::fill(m_nodes.begin(), m_nodes.end(), NodeState::Free);
+	m_used_area = 0;
+}
+
+
+// -----------------------------------------------------------------------------
+#include <doctest/doctest.h>
+#ifndef DOCTEST_CONFIG_DISABLE
+
+TEST_CASE("ShadowAtlas allocation") {
+	rc::ShadowAtlas atlas(1024, 128);
+
+	auto a = atlas.allocate(512);
+	REQUIRE(a.valid());
+	REQUIRE(a.size == 512);
+
+	// rounded up to power of two
+	auto b = atlas.allocate(200);
+	REQUIRE(b.valid());
+	REQUIRE(b.size == 256);
+
+	// small regions should be packed into already split quadrant
+	auto c = atlas.allocate(256);
+	REQUIRE(c.valid());
+	REQUIRE(c.x / 512 == b.x / 512);
+	REQUIRE(c.y / 512 == b.y / 512);
+
+	REQUIRE(!atlas.allocate(2048).valid());
+	REQUIRE(atlas.used_area() == 512*512 + 2*256*256);
+}
+
+TEST_CASE("ShadowAtlas exhaustion and release") {
+	rc::ShadowAtlas atlas(512, 128);
+
+	rc::ShadowAtlas::Region regions[4];
+	for (auto& r : regions) {
+		r = atlas.allocate(256);
+		REQUIRE(r.valid());
+	}
+	REQUIRE(!atlas.allocate(128).valid());
+
+	atlas.release(regions[2]);
+	REQUIRE(!regions[2].valid());
+	REQUIRE(!atlas.allocate(512).valid());
+
+	for (auto& r : regions)
+		atlas.release(r);
+
+	// all quadrants merged back
+	auto full = atlas.allocate(512);
+	REQUIRE(full.valid());
+	REQUIRE(full.x == 0);
+	REQUIRE(full.y == 0);
+	REQUIRE(atlas.used_area() == 512*512);
+}
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace rc {
+
+/// Quadtree allocator for square power-of-two regions of a square texture atlas.
+class ShadowAtlas
+{
+public:
+	struct Region
+	{
+		uint16_t x = 0;
+		uint16_t y = 0;
+		uint16_t size = 0;
+		int32_t  node = -1;
+
+		bool valid() const noexcept { return node >= 0; }
+	};
+
+	/// Creates allocator for atlas of \p size texels, subdivided down to \p min_region_size.
+	/// Both sizes must be powers of two.
+	ShadowAtlas(uint32_t size, uint32_t min_region_size);
+
+	/// Allocates region of \p size texels (rounded up to the next power of two).
+	/// Returns invalid region if there is no free space of that size left.
+	Region allocate(uint32_t size);
+
+	/// Returns \p region back to atlas and invalidates it. Does nothing if region is invalid.
+	void release(Region& region) noexcept;
+
+	/// Frees all regions at once.
+	void clear() noexcept;
+
+	uint32_t size() const noexcept { return m_size; }
+	uint32_t min_region_size() const noexcept { return m_min_size; }
+	uint64_t used_area() const noexcept { return m_used_area; }
+
+private:
+	enum class NodeState : uint8_t
+	{
+		Free,
+		Split,
+		Used
+	};
+
+	bool allocate_recursive(int32_t node, uint32_t node_size, uint16_t x, uint16_t y,
+	                        uint32_t target_size, bool allow_split, Region& out);
+
+	std::vector<NodeState> m_nodes;
+	uint32_t m_size;
+	uint32_t m_min_size;
+	uint64_t m_used_area = 0;
+};
+
+} // namespace rc
@@ -1,10 +1,17 @@
 #include <rendercat/cubemap.hpp>
 #include <rendercat/uniform.hpp>
 #include <rendercat/shader_set.hpp>
+#include <rendercat/texture_bake_cache.hpp>
+#include <rendercat/texture_cooker.hpp>
+#include <rendercat/util/file_io.hpp>
 #include <rendercat/util/gl_debug.hpp>
+#include <rendercat/util/gl_perfquery.hpp>
 #include <stb_image.h>
+#include <chrono>
+#include <future>
 #include <string>
 #include <utility>
+#include <vector>
 #include <cassert>
 #include <filesystem>
 #include <fmt/core.h>
@@ -44,10 +51,11 @@ static GLboolean has_seamless_filtering_per_texture; // requires GL_ARB_seamless
 static GLuint cubemap_vao;
 static uint32_t *cubemap_draw_shader;
 static uint32_t *cubemap_load_shader;
-static uint32_t *compute_diffuse_irradiance_shader;
+static uint32_t *compute_irradiance_sh_shader;
 static uint32_t *compute_specular_env_map_shader;
 static uint32_t *minimal_atmosphere_shader;
 static uint32_t *compute_minimal_atmosphere_bake_shader;
+static ShaderSet* shaders;
 
 static void set_tex_params(uint32_t tex, bool mips=false)
 {
@@ -89,7 +97,7 @@ Cubemap::Cubemap()
 	}
 }
 
-void Cubemap::load_cube(const std::filesystem::path& dir)
+bool Cubemap::load_cube(const std::filesystem::path& dir)
 {
 	ZoneScoped;
 
@@ -128,7 +136,7 @@ void Cubemap::load_cube(const std::filesystem::path& dir)
 					           prev_face_height);
 
 					stbi_image_free(data);
-					return;
+					return false;
 				}
 			}
 
@@ -141,30 +149,37 @@ void Cubemap::load_cube(const std::filesystem::path& dir)
 			if(chan != 3) {
 				fmt::print(stderr, "[cubemap] invalid channel count: {}\n", chan);
 			}
-			return;
+			return false;
 		}
 	}
 	rcObjectLabel(tex, fmt::format("cubemap: {} ({}x{})", dir.u8string(), prev_face_width, prev_face_height));
 	m_cubemap = std::move(tex);
+	return true;
 }
 
-void Cubemap::load_equirectangular(const std::filesystem::path& file)
+bool Cubemap::load_equirectangular(const std::filesystem::path& file)
 {
-	assert(cubemap_load_shader);
 	ZoneScoped;
-	rc::texture_handle flat_texture;
 	int flat_width, flat_height, chan;
 	auto data = stbi_loadf(file.u8string().data(), &flat_width, &flat_height, &chan, 3);
-	if(data && chan == 3) {
-			glCreateTextures(GL_TEXTURE_2D, 1, flat_texture.get());
-			glTextureStorage2D(*flat_texture, 1, GL_RGB32F, flat_width, flat_height);
-			glTextureSubImage2D(*flat_texture, 0, 0, 0, flat_width, flat_height, GL_RGB, GL_FLOAT, data);
-			stbi_image_free(data);
-	} else {
+	if(!data || chan != 3) {
 		fmt::print(stderr, "[cubemap] could not open equirectangular map file '{}'\n", file.u8string());
 		stbi_image_free(data);
-		return;
+		return false;
 	}
+	from_equirectangular(data, flat_width, flat_height, file.u8string());
+	stbi_image_free(data);
+	return true;
+}
+
+void Cubemap::from_equirectangular(const float* rgb, int flat_width, int flat_height, std::string_view name)
+{
+	assert(cubemap_load_shader);
+	ZoneScoped;
+	rc::texture_handle flat_texture;
+	glCreateTextures(GL_TEXTURE_2D, 1, flat_texture.get());
+	glTextureStorage2D(*flat_texture, 1, GL_RGB32F, flat_width, flat_height);
+	glTextureSubImage2D(*flat_texture, 0, 0, 0, flat_width, flat_height, GL_RGB, GL_FLOAT, rgb);
 
 	const unsigned face_size = (flat_height * 3) / 4;
 
@@ -180,7 +195,7 @@ void Cubemap::load_equirectangular(const std::filesystem::path& file)
 	glDispatchCompute(face_size/32, face_size/32, 6);
 
 	m_cubemap = std::move(cubemap_to);
-	rcObjectLabel(m_cubemap, fmt::format("cubemap: {} ({}x{})", file.u8string(), face_size, face_size));
+	rcObjectLabel(m_cubemap, fmt::format("cubemap: {} ({}x{})", name, face_size, face_size));
 }
 
 void Cubemap::draw(const Cubemap & cubemap, const zcm::mat4 & view, const zcm::mat4 & projection, int mip_level) noexcept
@@ -190,6 +205,7 @@ void Cubemap::draw(const Cubemap & cubemap, const zcm::mat4 & view, const zcm::m
 		// remove translation part from view matrix
 		unif::m4(*cubemap_draw_shader, 0, projection * zcm::mat4{zcm::mat3{view}});
 		unif::i1(*cubemap_draw_shader, 1, mip_level);
+		unif::b1(*cubemap_draw_shader, 2, false);
 
 		glUseProgram(*cubemap_draw_shader);
 		glBindVertexArray(cubemap_vao);
@@ -201,6 +217,20 @@ void Cubemap::draw(const Cubemap & cubemap, const zcm::mat4 & view, const zcm::m
 	}
 }
 
+void Cubemap::draw_irradiance_sh(uint32_t sh_buffer, const zcm::mat4& view, const zcm::mat4& projection) noexcept
+{
+	assert(cubemap_draw_shader);
+	// remove translation part from view matrix
+	unif::m4(*cubemap_draw_shader, 0, projection * zcm::mat4{zcm::mat3{view}});
+	unif::b1(*cubemap_draw_shader, 2, true);
+
+	glUseProgram(*cubemap_draw_shader);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, RC_SHADER_STORAGE_BINDING_IRRADIANCE_SH, sh_buffer);
+	glBindVertexArray(cubemap_vao);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 14); // see cubemap.vert
+	glBindVertexArray(0);
+}
+
 void Cubemap::draw_atmosphere(const zcm::mat4 & view, const zcm::mat4 & projection, bool draw_planet) noexcept
 {
 	assert(minimal_atmosphere_shader);
@@ -214,71 +244,86 @@ void Cubemap::draw_atmosphere(const zcm::mat4 & view, const zcm::mat4 & projecti
 	glBindVertexArray(0);
 }
 
-void Cubemap::draw_atmosphere_to_cube(Cubemap& cube, int size, bool draw_planet) noexcept
+static int texture_width(const rc::texture_handle& tex)
+{
+	GLint width = 0;
+	if (tex)
+		glGetTextureLevelParameteriv(*tex, 0, GL_TEXTURE_WIDTH, &width);
+	return width;
+}
+
+void Cubemap::draw_atmosphere_to_cube(Cubemap& cube, int size, const AtmosphereParams& params, int first_face, int num_faces) noexcept
 {
 	assert(compute_minimal_atmosphere_bake_shader);
-	if (!cube.m_cubemap) {
+	if (texture_width(cube.m_cubemap) != size) {
 		rc::texture_handle tex;
 		// BUG: AMD driver cannot upload faces of single cubemap, only cubemap array (size of 1 still works)
 		glCreateTextures(GL_TEXTURE_CUBE_MAP_ARRAY, 1, tex.get());
 		set_tex_params(*tex);
 
-		// create texture array for point light shadowmaps
 		glTextureStorage3D(*tex, 1, GL_RGBA16F, size, size, 6);
 		rcObjectLabel(tex, fmt::format("Baked atmosphere cubemap ({}x{})", size, size));
 		cube.m_cubemap = std::move(tex);
 	}
-	unif::b1(*compute_minimal_atmosphere_bake_shader, 1, draw_planet);
+	unif::b1(*compute_minimal_atmosphere_bake_shader, 1, params.draw_planet);
+	unif::v3(*compute_minimal_atmosphere_bake_shader, 2, params.light_dir);
+	unif::v3(*compute_minimal_atmosphere_bake_shader, 3, params.light_color);
+	unif::i1(*compute_minimal_atmosphere_bake_shader, 4, first_face);
 	glUseProgram(*compute_minimal_atmosphere_bake_shader);
 	glBindImageTexture(0, *cube.m_cubemap, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
-	glDispatchCompute(size/16, size/16, 6);
+	glDispatchCompute(size/16, size/16, num_faces);
 	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT|GL_TEXTURE_FETCH_BARRIER_BIT);
 }
 
 
-Cubemap Cubemap::integrate_diffuse_irradiance(const Cubemap & source)
+void Cubemap::project_irradiance_sh(const Cubemap& source, uint32_t sh_buffer) noexcept
 {
-	assert(compute_diffuse_irradiance_shader);
-	ZoneScoped;
-	TracyGpuZone("cubemap_integrate_diffuse_irradiance");
-	Cubemap res;
-	if (source.m_cubemap) {
-		const unsigned irradiance_size = 32;
-		rc::texture_handle irradiance_cube_to;
-		glCreateTextures(GL_TEXTURE_CUBE_MAP_ARRAY, 1, irradiance_cube_to.get());
-		glTextureStorage3D(*irradiance_cube_to, 1, GL_RGBA16F, irradiance_size, irradiance_size, 6);
-		set_tex_params(*irradiance_cube_to);
-
-		glUseProgram(*compute_diffuse_irradiance_shader);
-		glBindTextureUnit(0, *source.m_cubemap);
-		glBindImageTexture(0, *irradiance_cube_to, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
-		glDispatchCompute(irradiance_size/16, irradiance_size/16, 6);
-
-		res.m_cubemap = std::move(irradiance_cube_to);
-	}
-	return res;
-}
-
-Cubemap Cubemap::convolve_specular(const Cubemap & source)
-{
-	assert(compute_specular_env_map_shader);
-	Cubemap res;
+	assert(compute_irradiance_sh_shader);
 	if (!source.m_cubemap)
-		return res;
+		return;
 
 	ZoneScoped;
-	TracyGpuZone("cubemap_convolve_specular");
+	TracyGpuZone("cubemap_project_irradiance_sh");
+	glUseProgram(*compute_irradiance_sh_shader);
+	glBindTextureUnit(0, *source.m_cubemap);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, RC_SHADER_STORAGE_BINDING_IRRADIANCE_SH, sh_buffer);
+	glDispatchCompute(1, 1, 1);
+	// coefficients are copied into per-frame uniforms and read by shaders
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT|GL_SHADER_STORAGE_BARRIER_BIT);
+}
 
-	rc::texture_handle cubemap_with_mips_to;
-	glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, cubemap_with_mips_to.get());
+namespace {
 
-	GLint src_size, dst_size;
-	glGetTextureLevelParameteriv(*source.m_cubemap, 0, GL_TEXTURE_WIDTH, &src_size);
-	dst_size = std::min(std::max(src_size, 64), 256);
-	int dst_numlevels = rc::math::num_mipmap_levels(dst_size, dst_size);
-	glTextureStorage2D(*cubemap_with_mips_to, dst_numlevels, GL_RGBA16F, dst_size, dst_size);
-	set_tex_params(*cubemap_with_mips_to, true);
+// Specular environment prefiltering state, so mip levels can be filtered one at a time.
+struct SpecularConvolution
+{
+	rc::texture_handle source_mips; // downsampled source, mips are used for filtered importance sampling
+	rc::texture_handle result;
+	int size = 0;
+	int levels = 0;
+	int next_level = 1;
+
+	void begin(uint32_t source);
+	void filter_next_level();
+	bool done() const noexcept { return next_level >= levels; }
+};
 
+void SpecularConvolution::begin(uint32_t source)
+{
+	ZoneScoped;
+	GLint src_size;
+	glGetTextureLevelParameteriv(source, 0, GL_TEXTURE_WIDTH, &src_size);
+	size = std::min(std::max(src_size, 64), 256);
+	levels = rc::math::num_mipmap_levels(size, size);
+	next_level = 1;
+
+	// textures left from previous convolution of same size are reused
+	if (texture_width(source_mips) != size) {
+		source_mips.reset();
+		glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, source_mips.get());
+		glTextureStorage2D(*source_mips, levels, GL_RGBA16F, size, size);
+		set_tex_params(*source_mips, true);
+	}
 
 	{
 		ZoneScopedN("downsample");
@@ -288,50 +333,468 @@ Cubemap Cubemap::convolve_specular(const Cubemap & source)
 		glCreateFramebuffers(1, dst_fbo.get());
 
 		for (int i = 0; i < 6; ++i) {
-			glNamedFramebufferTextureLayer(*src_fbo, GL_COLOR_ATTACHMENT0, *source.m_cubemap, 0, i);
-			glNamedFramebufferTextureLayer(*dst_fbo, GL_COLOR_ATTACHMENT0, *cubemap_with_mips_to, 0, i);
+			glNamedFramebufferTextureLayer(*src_fbo, GL_COLOR_ATTACHMENT0, source, 0, i);
+			glNamedFramebufferTextureLayer(*dst_fbo, GL_COLOR_ATTACHMENT0, *source_mips, 0, i);
 			glBlitNamedFramebuffer(*src_fbo, *dst_fbo,
 					       0, 0, src_size, src_size,
-					       0, 0, dst_size, dst_size,
+					       0, 0, size, size,
 					       GL_COLOR_BUFFER_BIT,
 					       GL_LINEAR);
 		}
-		glGenerateTextureMipmap(*cubemap_with_mips_to);
+		glGenerateTextureMipmap(*source_mips);
 	}
 
-	rc::texture_handle specular_cube_to;
-	glCreateTextures(GL_TEXTURE_CUBE_MAP_ARRAY, 1, specular_cube_to.get());
-	glTextureStorage3D(*specular_cube_to, dst_numlevels, GL_RGBA16F, dst_size, dst_size, 6);
+	if (texture_width(result) != size) {
+		result.reset();
+		glCreateTextures(GL_TEXTURE_CUBE_MAP_ARRAY, 1, result.get());
+		glTextureStorage3D(*result, levels, GL_RGBA16F, size, size, 6);
+	}
 
 	// Copy 0th mipmap level into destination environment map.
-	glCopyImageSubData(*cubemap_with_mips_to, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0,
-	                   *specular_cube_to,     GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 0,
-	                   dst_size, dst_size, 6);
+	glCopyImageSubData(*source_mips, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0,
+	                   *result,      GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 0,
+	                   size, size, 6);
+}
+
+void SpecularConvolution::filter_next_level()
+{
+	assert(compute_specular_env_map_shader);
+	const int level = next_level++;
+	const int level_size = std::max(size >> (level - 1), 1);
+	const GLuint numGroups = std::max(1, level_size/32);
+	const float deltaRoughness = 1.0f / zcm::max(float(levels-1), 1.0f);
 
 	glUseProgram(*compute_specular_env_map_shader);
-	glBindTextureUnit(0, *cubemap_with_mips_to);
+	glBindTextureUnit(0, *source_mips);
+	glBindImageTexture(0, *result, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	unif::f1(*compute_specular_env_map_shader, 0, level * deltaRoughness);
+	glDispatchCompute(numGroups, numGroups, 6);
+}
+
+// Runs steps of amortized GPU work until per-frame budget is spent, step cost is estimated
+// from timer queries of previous frames.
+struct StepBudget
+{
+	rc::PerfQuery perfquery;
+	float step_ms = 1000.0f; // until first result, one step per frame
+	std::vector<uint32_t> query_steps;
+
+	// step returns false once there is nothing left to do
+	template<typename Step>
+	void run(float budget_ms, Step&& step)
+	{
+		if (perfquery.collect() > 0) {
+			const auto q = static_cast<size_t>(perfquery.query_num);
+			if (q < query_steps.size() && query_steps[q] > 0)
+				step_ms = perfquery.time_last / query_steps[q];
+		}
+
+		const auto query = static_cast<size_t>(perfquery.begin());
+		uint32_t steps = 0;
+		float spent_ms = 0.0f;
+		bool more;
+		do {
+			more = step();
+			++steps;
+			spent_ms += step_ms;
+		} while (more && spent_ms + step_ms <= budget_ms);
+		perfquery.end();
+
+		if (query >= query_steps.size())
+			query_steps.resize(query + 1);
+		query_steps[query] = steps;
+	}
+};
+
+}
+
+Cubemap Cubemap::convolve_specular(const Cubemap & source)
+{
+	assert(compute_specular_env_map_shader);
+	Cubemap res;
+	if (!source.m_cubemap)
+		return res;
+
+	ZoneScoped;
+	TracyGpuZone("cubemap_convolve_specular");
 
 	// Pre-filter rest of the mip chain.
-	const float deltaRoughness = 1.0f / zcm::max(float(dst_numlevels-1), 1.0f);
-	for(int level=1; level <= dst_numlevels; ++level, dst_size/=2) {
-		const GLuint numGroups = std::max(1, dst_size/32);
-		glBindImageTexture(0, *specular_cube_to, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	SpecularConvolution convolution;
+	convolution.begin(*source.m_cubemap);
+	while (!convolution.done())
+		convolution.filter_next_level();
+	set_tex_params(*convolution.result, true);
+
+	res.m_cubemap = std::move(convolution.result);
+	return res;
+}
+
+namespace {
+
+using image_ptr = std::unique_ptr<float, void(*)(void*)>;
+
+// Worker part of skybox loading: either complete bake cache entries or decoded source.
+struct DecodedSkybox
+{
+	uint64_t key = 0;
+	bool     cached = false;
+	Texture::BakeCache::Entry baked[2]; // sky, specular environment
+	std::vector<image_ptr>    images;   // equirectangular map or six faces, RGB float
+	int width = 0;
+	int height = 0;
+};
+
+std::unique_ptr<DecodedSkybox> decode_skybox(const std::filesystem::path& source, uint64_t shaders_hash)
+{
+	ZoneScoped;
+	std::vector<std::filesystem::path> files;
+	std::error_code ec;
+	if (std::filesystem::is_directory(source, ec)) {
+		for (const auto& face : face_names_hdr)
+			files.push_back(source / face);
+	} else {
+		files.push_back(source);
+	}
 
-		unif::f1(*compute_specular_env_map_shader, 0, level * deltaRoughness);
-		glDispatchCompute(numGroups, numGroups, 6);
+	// bake cache key covers contents of source and shaders converting and convolving it
+	auto res = std::make_unique<DecodedSkybox>();
+	std::vector<std::vector<uint8_t>> contents(files.size());
+	uint64_t hash = 0x69626c; // "ibl"
+	for (size_t i = 0; i < files.size(); ++i) {
+		if (!util::read_file(files[i], contents[i])) {
+			fmt::print(stderr, "[cubemap] could not read '{}'\n", files[i].u8string());
+			std::fflush(stderr);
+			return nullptr;
+		}
+		hash = hash * 31 + Texture::content_hash(contents[i].data(), contents[i].size());
 	}
-	set_tex_params(*specular_cube_to, true);
+	res->key = Texture::BakeCache::key({hash, shaders_hash});
 
+	// skybox and its convolution are stored under consecutive keys
+	res->cached = Texture::BakeCache::read(res->key, res->baked[0])
+	              && Texture::BakeCache::read(res->key + 1, res->baked[1]);
+	if (res->cached)
+		return res;
 
-	res.m_cubemap = std::move(specular_cube_to);
+	for (size_t i = 0; i < files.size(); ++i) {
+		ZoneScopedN("decode");
+		int width, height, chan;
+		image_ptr data(stbi_loadf_from_memory(contents[i].data(), static_cast<int>(contents[i].size()), &width, &height, &chan, 3),
+		               stbi_image_free);
+		if (!data || chan != 3) {
+			fmt::print(stderr, "[cubemap] could not decode '{}'\n", files[i].u8string());
+			if (data)
+				fmt::print(stderr, "[cubemap] invalid channel count: {}\n", chan);
+			std::fflush(stderr);
+			return nullptr;
+		}
+		if (i > 0 && (width != res->width || height != res->height)) {
+			fmt::print(stderr, "[cubemap] bad face '{}': "
+			           "face size does not match (current {}x{}, previous {}x{})\n",
+			           files[i].u8string(), width, height, res->width, res->height);
+			std::fflush(stderr);
+			return nullptr;
+		}
+		res->width = width;
+		res->height = height;
+		res->images.push_back(std::move(data));
+		contents[i] = {};
+	}
 	return res;
 }
 
+}
+
+struct CubemapLoader::State
+{
+	enum class Stage
+	{
+		Idle,
+		Decoding,
+		Restore,       // one cached map per step
+		Upload,        // equirectangular conversion, or one face per step
+		SpecularSetup,
+		Specular,      // one mip level per step
+		Save,          // one map per step, read back stalls
+		Done
+	};
+
+	Stage stage = Stage::Idle;
+	std::filesystem::path source;
+	std::filesystem::path next_source; // requested while worker was busy
+	std::future<std::unique_ptr<DecodedSkybox>> decoding;
+	std::unique_ptr<DecodedSkybox> decoded;
+	unsigned substep = 0;
+	rc::texture_handle faces;
+	SpecularConvolution specular;
+
+	StepBudget budget;
+};
+
+CubemapLoader::CubemapLoader() : m_state(std::make_unique<State>())
+{
+}
+
+CubemapLoader::~CubemapLoader() = default;
+
+bool CubemapLoader::busy() const noexcept
+{
+	return m_state->stage != State::Stage::Idle;
+}
+
+void CubemapLoader::start(const std::filesystem::path& source)
+{
+	assert(shaders);
+	auto& s = *m_state;
+	if (s.stage == State::Stage::Decoding) {
+		// worker can't be interrupted, next load starts once it is done
+		s.next_source = source;
+		return;
+	}
+
+	ZoneScoped;
+	const uint64_t shaders_hash = Texture::BakeCache::key({shaders->source_hash(cubemap_load_shader),
+	                                                       shaders->source_hash(compute_specular_env_map_shader)});
+	s.stage = State::Stage::Decoding;
+	s.source = source;
+	s.decoded.reset();
+	s.substep = 0;
+	s.faces.reset();
+	s.specular = {};
+	s.decoding = std::async(std::launch::async, decode_skybox, source, shaders_hash);
+}
+
+bool CubemapLoader::update(float budget_ms)
+{
+	using Stage = State::Stage;
+	auto& s = *m_state;
+	if (s.stage == Stage::Idle)
+		return false;
+
+	ZoneScoped;
+	if (s.stage == Stage::Decoding) {
+		if (s.decoding.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			return false;
+
+		s.decoded = s.decoding.get();
+		s.stage = Stage::Idle;
+		if (!s.next_source.empty()) {
+			start(std::exchange(s.next_source, {}));
+			return false;
+		}
+		if (!s.decoded)
+			return false;
+		s.stage = s.decoded->cached ? Stage::Restore : Stage::Upload;
+	}
+
+	s.budget.run(budget_ms, [&]
+	{
+		step(s);
+		return s.stage != Stage::Done && s.stage != Stage::Idle;
+	});
+
+	if (s.stage != Stage::Done)
+		return false;
+
+	s.stage = Stage::Idle;
+	s.decoded.reset();
+	return true;
+}
+
+void CubemapLoader::step(State& s)
+{
+	using Stage = State::Stage;
+	auto& d = *s.decoded;
+	const auto name = s.source.u8string();
+	Cubemap* maps[] = {&sky, &specular_environment};
+
+	switch (s.stage) {
+	case Stage::Restore: {
+		ZoneScopedN("restore baked");
+		static constexpr const char* kinds[] = {"cubemap", "specular environment"};
+		auto& entry = d.baked[s.substep];
+		rc::texture_handle tex;
+		if (!Texture::BakeCache::create(entry, tex)) {
+			fmt::print(stderr, "[cubemap] invalid bake cache entry for '{}'\n", name);
+			std::fflush(stderr);
+			s.stage = Stage::Idle;
+			return;
+		}
+		set_tex_params(*tex, entry.levels > 1);
+		rcObjectLabel(tex, fmt::format("{}: {} (baked)", kinds[s.substep], name));
+		maps[s.substep]->m_cubemap = std::move(tex);
+		entry = {};
+		if (++s.substep == std::size(maps))
+			s.stage = Stage::Done;
+		break;
+	}
+	case Stage::Upload:
+		if (d.images.size() == 1) {
+			sky.from_equirectangular(d.images[0].get(), d.width, d.height, name);
+			d.images.clear();
+			s.stage = Stage::SpecularSetup;
+			break;
+		}
+		if (s.substep == 0) {
+			// BUG: AMD driver cannot upload faces of single cubemap, only cubemap array (size of 1 still works)
+			glCreateTextures(GL_TEXTURE_CUBE_MAP_ARRAY, 1, s.faces.get());
+			glTextureStorage3D(*s.faces, 1, GL_RGB16F, d.width, d.height, 6);
+			set_tex_params(*s.faces);
+		}
+		glTextureSubImage3D(*s.faces, 0, 0, 0, s.substep, d.width, d.height, 1, GL_RGB, GL_FLOAT, d.images[s.substep].get());
+		d.images[s.substep].reset();
+		if (++s.substep == 6) {
+			rcObjectLabel(s.faces, fmt::format("cubemap: {} ({}x{})", name, d.width, d.height));
+			sky.m_cubemap = std::move(s.faces);
+			s.stage = Stage::SpecularSetup;
+		}
+		break;
+	case Stage::SpecularSetup:
+		s.specular.begin(*sky.m_cubemap);
+		s.stage = Stage::Specular;
+		break;
+	case Stage::Specular:
+		if (!s.specular.done())
+			s.specular.filter_next_level();
+		if (s.specular.done()) {
+			set_tex_params(*s.specular.result, true);
+			specular_environment.m_cubemap = std::move(s.specular.result);
+			s.specular = {};
+			s.substep = 0;
+			s.stage = Stage::Save;
+		}
+		break;
+	case Stage::Save:
+		// shared exponent keeps full HDR range in 4 bytes per texel, sky has no alpha
+		Texture::BakeCache::save(d.key + s.substep, maps[s.substep]->m_cubemap, Texture::BakeCache::Encoding::RGB9E5);
+		if (++s.substep == std::size(maps))
+			s.stage = Stage::Done;
+		break;
+	case Stage::Idle:
+	case Stage::Decoding:
+	case Stage::Done:
+		break;
+	}
+}
+
+struct SkyUpdater::State
+{
+	enum class Stage
+	{
+		Idle,
+		Bake,          // one face per step
+		Irradiance,
+		SpecularSetup,
+		Specular,      // one mip level per step
+		Done
+	};
+
+	Stage stage = Stage::Idle;
+	AtmosphereParams params;
+	int  size = 0;
+	bool diffuse = false;
+	bool specular_enabled = false;
+	int  face = 0;
+	rc::buffer_handle sh; // copied to renderer's buffer once sky is complete
+	SpecularConvolution specular;
+	StepBudget budget;
+};
+
+SkyUpdater::SkyUpdater() : m_state(std::make_unique<State>())
+{
+	const float no_irradiance[9 * 4]{};
+	glCreateBuffers(1, m_state->sh.get());
+	glNamedBufferStorage(*m_state->sh, sizeof(no_irradiance), no_irradiance, gl::GL_NONE_BIT);
+	rcObjectLabel(m_state->sh, "sky update irradiance SH");
+}
+
+SkyUpdater::~SkyUpdater() = default;
+
+bool SkyUpdater::busy() const noexcept
+{
+	return m_state->stage != State::Stage::Idle;
+}
+
+void SkyUpdater::start(const AtmosphereParams& params, int size, bool diffuse, bool specular)
+{
+	auto& s = *m_state;
+	s.stage = State::Stage::Bake;
+	s.params = params;
+	s.size = size;
+	s.diffuse = diffuse;
+	s.specular_enabled = specular;
+	s.face = 0;
+
+	// maps swapped out of scene by previous update become targets of this one
+	if (specular_environment.m_cubemap)
+		s.specular.result = std::move(specular_environment.m_cubemap);
+}
+
+bool SkyUpdater::update(float budget_ms, uint32_t sh_buffer)
+{
+	using Stage = State::Stage;
+	auto& s = *m_state;
+	if (s.stage == Stage::Idle)
+		return false;
+
+	ZoneScoped;
+	s.budget.run(budget_ms, [&]
+	{
+		step(s);
+		return s.stage != Stage::Done;
+	});
+
+	if (s.stage != Stage::Done)
+		return false;
+
+	if (s.diffuse)
+		glCopyNamedBufferSubData(*s.sh, sh_buffer, 0, 0, 9 * 4 * sizeof(float));
+	s.stage = Stage::Idle;
+	return true;
+}
+
+void SkyUpdater::step(State& s)
+{
+	using Stage = State::Stage;
+	switch (s.stage) {
+	case Stage::Bake:
+		Cubemap::draw_atmosphere_to_cube(sky, s.size, s.params, s.face, 1);
+		if (++s.face == 6)
+			s.stage = s.diffuse ? Stage::Irradiance : Stage::SpecularSetup;
+		break;
+	case Stage::Irradiance:
+		Cubemap::project_irradiance_sh(sky, *s.sh);
+		s.stage = Stage::SpecularSetup;
+		break;
+	case Stage::SpecularSetup:
+		if (!s.specular_enabled) {
+			s.stage = Stage::Done;
+			break;
+		}
+		s.specular.begin(*sky.m_cubemap);
+		s.stage = Stage::Specular;
+		break;
+	case Stage::Specular:
+		if (!s.specular.done())
+			s.specular.filter_next_level();
+		if (s.specular.done()) {
+			set_tex_params(*s.specular.result, true);
+			specular_environment.m_cubemap = std::move(s.specular.result);
+			s.stage = Stage::Done;
+		}
+		break;
+	case Stage::Idle:
+	case Stage::Done:
+		break;
+	}
+}
+
 void Cubemap::compile_shaders(ShaderSet& shader_set)
 {
+	shaders = &shader_set;
 	cubemap_draw_shader = shader_set.load_program({"cubemap.vert", "cubemap.frag"});
 	cubemap_load_shader = shader_set.load_program({"cubemap_from_equirectangular.comp"});
-	compute_diffuse_irradiance_shader = shader_set.load_program({"cubemap_diffuse_irradiance.comp"});
+	compute_irradiance_sh_shader = shader_set.load_program({"cubemap_irradiance_sh.comp"});
 	compute_specular_env_map_shader = shader_set.load_program({"cubemap_specular_envmap.comp"});
 	minimal_atmosphere_shader = shader_set.load_program({"cubemap.vert", "cubemap_atmosphere.frag"});
 	compute_minimal_atmosphere_bake_shader = shader_set.load_program({"cubemap_bake.comp"});
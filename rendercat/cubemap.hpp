@@ -2,7 +2,10 @@
 #include <rendercat/common.hpp>
 #include <rendercat/util/gl_unique_handle.hpp>
 #include <filesystem>
+#include <memory>
+#include <string_view>
 #include <zcm/fwd.hpp>
+#include <zcm/vec3.hpp>
 
 namespace rc {
 
@@ -13,6 +16,15 @@ namespace Texture {
 	bool bind_to_unit(const Cubemap& cubemap, uint32_t unit) noexcept;
 }
 
+// Lighting procedural sky is baked with. SkyUpdater keeps it fixed for whole update, so
+// faces baked in different frames match.
+struct AtmosphereParams
+{
+	zcm::vec3 light_dir;
+	zcm::vec3 light_color;
+	bool      draw_planet = false;
+};
+
 class Cubemap
 {
 public:
@@ -23,22 +35,88 @@ public:
 	RC_DEFAULT_MOVE_NOEXCEPT(Cubemap)
 	RC_DISABLE_COPY(Cubemap)
 
-	void load_cube(const std::filesystem::path& dir);
-	void load_equirectangular(const std::filesystem::path& file);
+	// Both keep previous contents and return false if source can't be loaded.
+	bool load_cube(const std::filesystem::path& dir);
+	bool load_equirectangular(const std::filesystem::path& file);
 
-	[[nodiscard]] static Cubemap integrate_diffuse_irradiance(const Cubemap& source);
+	// Reduces diffuse irradiance of source to L2 spherical harmonics, written as 9 vec4
+	// to sh_buffer (see spherical_harmonics.glsl).
+	static void project_irradiance_sh(const Cubemap& source, uint32_t sh_buffer) noexcept;
 	[[nodiscard]] static Cubemap convolve_specular(const Cubemap& source);
 
+
 	static void compile_shaders(ShaderSet& shader_set);
 	static void draw(const Cubemap& cubemap, const zcm::mat4& view, const zcm::mat4& projection, int mip_level = 0) noexcept;
+	static void draw_irradiance_sh(uint32_t sh_buffer, const zcm::mat4& view, const zcm::mat4& projection) noexcept;
 	static void draw_atmosphere(const zcm::mat4& view, const zcm::mat4& projection, bool draw_planet) noexcept;
-	static void draw_atmosphere_to_cube(Cubemap& cube, int size, bool draw_planet) noexcept;
+	// Bakes faces [first_face, first_face + num_faces) of sky, cube is (re)allocated if size differs.
+	static void draw_atmosphere_to_cube(Cubemap& cube, int size, const AtmosphereParams& params, int first_face = 0, int num_faces = 6) noexcept;
 
 private:
 	friend bool Texture::bind_to_unit(const Cubemap& cubemap, uint32_t unit) noexcept;
+	friend class CubemapLoader;
+	friend class SkyUpdater;
+	void from_equirectangular(const float* rgb, int width, int height, std::string_view name);
 	texture_handle m_cubemap;
 };
 
+// Loads skybox from image file or directory of faces together with its specular
+// environment map, spread over frames. Files are read and decoded on worker
+// thread, then GPU work is done in steps (faces, mip levels) that fit into per-frame budget
+// measured with timer queries. Maps are bake cached, cache hits skip decoding and convolution.
+class CubemapLoader
+{
+public:
+	CubemapLoader();
+	~CubemapLoader();
+	RC_DISABLE_COPY(CubemapLoader)
+
+	// Restarts with new source if loading is in progress.
+	void start(const std::filesystem::path& source);
+
+	// Runs loading steps that fit into budget, but at least one. Returns true once all maps
+	// are complete, they can be moved out then.
+	bool update(float budget_ms);
+	bool busy() const noexcept;
+
+	Cubemap sky;
+	Cubemap specular_environment;
+
+private:
+	struct State;
+	void step(State& state);
+
+	std::unique_ptr<State> m_state;
+};
+
+// Rebakes procedural sky, its irradiance SH and specular environment incrementally, a face
+// or mip level per step within per-frame GPU budget, like CubemapLoader. Results replace
+// current maps only once all of them are done; swapping them with scene ones lets next
+// update reuse textures.
+class SkyUpdater
+{
+public:
+	SkyUpdater();
+	~SkyUpdater();
+	RC_DISABLE_COPY(SkyUpdater)
+
+	// Restarts if update is in progress.
+	void start(const AtmosphereParams& params, int size, bool diffuse, bool specular);
+
+	// Returns true once sky is complete. Irradiance SH is then copied to sh_buffer, unless
+	// diffuse update was off, and specular_environment is valid if specular one was on.
+	bool update(float budget_ms, uint32_t sh_buffer);
+	bool busy() const noexcept;
+
+	Cubemap sky;
+	Cubemap specular_environment;
+
+private:
+	struct State;
+	void step(State& state);
+
+	std::unique_ptr<State> m_state;
+};
 
 
 } // namespace rc
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <chrono>
+#include <optional>
 #include <thread>
 #include <fmt/format.h>
 #include <sstream>
@@ -19,9 +21,13 @@
 #include <rendercat/shader_set.hpp>
 #include <rendercat/scene.hpp>
 #include <rendercat/renderer.hpp>
+#include <rendercat/texture_cache.hpp>
+#include <rendercat/texture_sampler.hpp>
+#include <rendercat/texture_streamer.hpp>
 #include <rendercat/util/gl_debug.hpp>
 #include <rendercat/util/gl_screenshot.hpp>
 #include <rendercat/util/gl_meta.hpp>
+#include <rendercat/util/task_graph.hpp>
 
 #include <imgui.h>
 #include <imguizmo/ImGuizmo.h>
@@ -584,20 +590,58 @@ int main(int argc, char *argv[]) try
 	return -1;
 }
 
+static void run_startup(GLFWwindow* window,
+                        rc::ShaderSet& shader_set,
+                        rc::Scene& scene,
+                        std::optional<rc::Renderer>& renderer)
+{
+	ZoneScoped;
+	using Thread = rc::TaskGraph::Thread;
+	rc::TaskGraph startup;
+
+	auto renderer_ready = startup.add("renderer", Thread::Main, [&]
+	{
+		rc::Cubemap::compile_shaders(shader_set);
+		renderer.emplace(scene, shader_set);
+		renderer->resize(globals::glfw_framebuffer_width,
+		                 globals::glfw_framebuffer_height,
+		                 globals::glfw_device_pixel_ratio);
+		glfwPollEvents();
+		renderer->clear_screen();
+		glfwSwapBuffers(window);
+		init_glfw_callbacks(window);
+	});
+	auto scene_ready = scene.init(startup);
+	startup.add("finish shaders", Thread::Main, [&]
+	{
+		shader_set.finish();
+	}, {renderer_ready, scene_ready});
+
+	// GL work runs here as soon as its inputs are ready, files are read and processed on
+	// workers meanwhile. Shaders keep compiling on driver threads, polling them while idle
+	// lets finished compiles move on to linking.
+	auto hw_threads = std::thread::hardware_concurrency();
+	unsigned num_workers = std::clamp(hw_threads > 1 ? hw_threads - 1 : 1u, 1u, 4u);
+	startup.run(num_workers, [&]
+	{
+		shader_set.check_updates();
+		glfwPollEvents();
+	});
+
+	startup.write_timeline("logs/startup_timeline.log");
+	fmt::print(stderr, "[startup] done in {:.1f} ms, see logs/startup_timeline.log\n", startup.duration_ms());
+	std::fflush(stderr);
+}
+
 static void main_loop(GLFWwindow* window) {
 	TracyGpuContext;
+	rc::Texture::Streamer::init();
 	rc::ShaderSet shader_set;
-	rc::Cubemap::compile_shaders(shader_set);
 	rc::Scene scene;
-	rc::Renderer renderer(scene, shader_set);
-	renderer.resize(globals::glfw_framebuffer_width,
-	                globals::glfw_framebuffer_height,
-	                globals::glfw_device_pixel_ratio);
-	glfwPollEvents();
-	renderer.clear_screen();
-	glfwSwapBuffers(window);
-	init_glfw_callbacks(window);
-	scene.init();
+	std::optional<rc::Renderer> startup_renderer;
+	run_startup(window, shader_set, scene, startup_renderer);
+	shader_set.log_load_stats();
+	auto& renderer = *startup_renderer;
 	globals::last_frame_time = glfwGetTime();
 	TracyGpuCollect;
 	FrameMark;
@@ -634,6 +678,9 @@ static void main_loop(GLFWwindow* window) {
 		}
 
 		scene.update();
+		rc::Texture::Streamer::update();
+		rc::Texture::Cache::update();
+		rc::Texture::Samplers::update();
 
 		renderer.draw();
 		renderer.draw_gui(params);
@@ -679,4 +726,7 @@ static void main_loop(GLFWwindow* window) {
 			std::this_thread::sleep_for(std::chrono::duration<float>(st));
 		}
 	}
+	rc::Texture::Cache::clear();
+	rc::Texture::Samplers::clear();
+	rc::Texture::Streamer::shutdown();
 }
@@ -1,11 +1,19 @@
 #include <rendercat/material.hpp>
 #include <rendercat/texture_cache.hpp>
+#include <rendercat/texture_streamer.hpp>
 #include <rendercat/uniform.hpp>
+#include <rendercat/util/gl_debug.hpp>
+#include <rendercat/util/gl_unique_handle.hpp>
+#include <algorithm>
 #include <string>
+#include <vector>
+#include <new>
 #include <fmt/core.h>
 #include <stb_image.h>
 #include <zcm/vec2.hpp>
 #include <cassert>
+#include <cstddef>
+#include <cstring>
 
 #include <glbinding/gl45core/boolean.h>
 #include <glbinding/gl45core/bitfield.h>
@@ -28,6 +36,10 @@ static inline constexpr uint32_t clear_mask(uint32_t val, uint32_t mask)
 	return val & ~mask;
 }
 
+// must match std430 layout of Material in material.glsl, where uvec2 handles follow 'type'
+static_assert(offsetof(Material::UniformData, handles) == 56);
+static_assert(sizeof(Material::UniformData) == 96);
+
 static inline constexpr bool test(uint32_t flags, Texture::Kind kind)
 {
 	return (flags & repr(kind)) == repr(kind);
@@ -35,25 +47,176 @@ static inline constexpr bool test(uint32_t flags, Texture::Kind kind)
 
 
 static ImageTexture2D  _default_diffuse;
+// bound in place of textures that are still streaming in
+static ImageTexture2D  _neutral_white;
+static ImageTexture2D  _neutral_normal;
+
+
+static ImageTexture2D make_solid_texture(uint8_t r, uint8_t g, uint8_t b, std::string_view label)
+{
+	const uint8_t pixel[] = {r, g, b, 255};
+	uint8_t pixels[4 * 4 * 4];
+	for (size_t i = 0; i < std::size(pixels); i += 4)
+		std::copy(std::begin(pixel), std::end(pixel), pixels + i);
+
+	TextureStorage2D storage(4, 4, Texture::InternalFormat::RGBA_8, 1);
+	storage.sub_image(0, 4, 4, Texture::TexelDataType::UnsignedByte, pixels);
+	storage.set_label(label);
+	auto ret = ImageTexture2D::fromStorage(std::move(storage));
+	ret.set_filtering(Texture::MinFilter::Nearest, Texture::MagFilter::Nearest);
+	return ret;
+}
+
+
+namespace {
+
+// Parameters of all materials live in one persistently mapped SSBO indexed by material ID.
+// Modified slots are accumulated into a dirty range and flushed once before drawing.
+class MaterialStorage
+{
+public:
+	static MaterialStorage& instance() noexcept
+	{
+		static MaterialStorage s;
+		return s;
+	}
+
+	uint32_t allocate();
+	void release(uint32_t index) noexcept;
+	void reset() noexcept;
+
+	Material::UniformData* data(uint32_t index) const noexcept
+	{
+		return index < m_count ? m_data + index : nullptr;
+	}
+
+	void mark_dirty(uint32_t index) noexcept
+	{
+		m_dirty_begin = std::min(m_dirty_begin, index);
+		m_dirty_end = std::max(m_dirty_end, index + 1);
+	}
+
+	// Writes part of slot in command stream order, for data changing while frame is recorded.
+	void update(uint32_t index, size_t offset, size_t size, const void* src) noexcept;
+	void bind() noexcept;
+
+private:
+	void grow(uint32_t capacity);
+
+	static constexpr uint32_t initial_capacity = 256;
+
+	rc::buffer_handle      m_buffer;
+	Material::UniformData* m_data = nullptr;
+	uint32_t               m_capacity = 0;
+	uint32_t               m_count = 0; // slots ever allocated
+	std::vector<uint32_t>  m_free;
+	uint32_t               m_dirty_begin = ~0u;
+	uint32_t               m_dirty_end = 0;
+};
+
+uint32_t MaterialStorage::allocate()
+{
+	uint32_t index;
+	if(!m_free.empty()) {
+		index = m_free.back();
+		m_free.pop_back();
+	} else {
+		if(m_count == m_capacity)
+			grow(std::max(initial_capacity, m_capacity * 2));
+		index = m_count++;
+	}
+	new(m_data + index) Material::UniformData{};
+	mark_dirty(index);
+	return index;
+}
+
+void MaterialStorage::release(uint32_t index) noexcept
+{
+	if(index < m_count)
+		m_free.push_back(index);
+}
+
+void MaterialStorage::reset() noexcept
+{
+	m_buffer.reset();
+	m_data = nullptr;
+	m_capacity = 0;
+	m_count = 0;
+	m_free.clear();
+	m_dirty_begin = ~0u;
+	m_dirty_end = 0;
+}
+
+void MaterialStorage::grow(uint32_t capacity)
+{
+	ZoneScoped;
+	static constexpr auto flags = GL_MAP_WRITE_BIT | GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT;
+	const auto size = capacity * sizeof(Material::UniformData);
+
+	rc::buffer_handle buffer;
+	glCreateBuffers(1, buffer.get());
+	rcObjectLabel(buffer, "material storage");
+	glNamedBufferStorage(*buffer, size, nullptr, flags | GL_DYNAMIC_STORAGE_BIT);
+	auto data = static_cast<Material::UniformData*>(glMapNamedBufferRange(*buffer, 0, size, flags | GL_MAP_FLUSH_EXPLICIT_BIT));
+	assert(data);
+
+	// old buffer is still mapped, so existing slots are copied on CPU and flushed with the next bind
+	if(m_count) {
+		std::memcpy(data, m_data, m_count * sizeof(Material::UniformData));
+		mark_dirty(0);
+		mark_dirty(m_count - 1);
+	}
+	m_buffer = std::move(buffer);
+	m_data = data;
+	m_capacity = capacity;
+}
+
+void MaterialStorage::update(uint32_t index, size_t offset, size_t size, const void* src) noexcept
+{
+	assert(index < m_count && offset + size <= sizeof(Material::UniformData));
+	const auto buffer_offset = index * sizeof(Material::UniformData) + offset;
+
+	// keep mapped copy in sync, so that flush of dirty range does not overwrite new data
+	std::memcpy(reinterpret_cast<char*>(m_data) + buffer_offset, src, size);
+	glNamedBufferSubData(*m_buffer, buffer_offset, size, src);
+}
+
+void MaterialStorage::bind() noexcept
+{
+	if(unlikely(!m_buffer)) return;
+
+	if(m_dirty_begin < m_dirty_end) {
+		glFlushMappedNamedBufferRange(*m_buffer,
+		                              m_dirty_begin * sizeof(Material::UniformData),
+		                              (m_dirty_end - m_dirty_begin) * sizeof(Material::UniformData));
+		m_dirty_begin = ~0u;
+		m_dirty_end = 0;
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, RC_SHADER_STORAGE_BINDING_MATERIALS, *m_buffer);
+}
+
+} // namespace
 
 
 Material::Material(const std::string_view name_) : name(name_) {
-	m_unif_data.set_label(fmt::format("material: {}", name));
+	m_index = MaterialStorage::instance().allocate();
 }
 
 Material::~Material()
 {
-	unmap();
+	MaterialStorage::instance().release(m_index);
 }
 
 
 #define IMPLEMENT_MATERIAL_MOVE(x, ret) x {                                    \
 	name = std::move(o.name);                                              \
 	textures = std::move(o.textures);                                      \
-	m_unif_data = std::move(o.m_unif_data);                                \
+	std::swap(m_index, o.m_index);                                         \
+	m_handles = o.m_handles;                                               \
 	m_double_sided = o.m_double_sided;                                     \
 	m_alpha_mode = o.m_alpha_mode;                                         \
 	m_flags = o.m_flags;                                                   \
+	m_shader_flags = o.m_shader_flags;                                     \
 	ret;                                                                   \
 }
 
@@ -71,11 +234,17 @@ void Material::set_default_diffuse(const std::string_view path) noexcept
 
 	_default_diffuse.set_filtering(Texture::MinFilter::Nearest, Texture::MagFilter::Nearest);
 	_default_diffuse.set_anisotropy(1);
+
+	// all texture kinds except base color are multiplied by factors, so white is a no-op
+	_neutral_white = make_solid_texture(255, 255, 255, "neutral white");
+	_neutral_normal = make_solid_texture(128, 128, 255, "neutral normal");
 }
 
 void Material::delete_default_diffuse() noexcept
 {
 	_default_diffuse.reset();
+	_neutral_white.reset();
+	_neutral_normal.reset();
 }
 
 Material Material::create_default_material()
@@ -101,50 +270,111 @@ bool Material::valid() const
 
 void Material::flush()
 {
-	m_unif_data.flush();
+	MaterialStorage::instance().mark_dirty(m_index);
+}
+
+uint32_t Material::index() const noexcept
+{
+	return m_index;
 }
 
-void Material::map()
+void Material::bind_storage() noexcept
 {
-	m_unif_data.map(false);
+	MaterialStorage::instance().bind();
 }
 
-void Material::unmap()
+void Material::release_storage() noexcept
 {
-	m_unif_data.unmap();
+	MaterialStorage::instance().reset();
 }
 
 
-void Material::bind(uint32_t) const noexcept
+void Material::bind(uint32_t shader) const noexcept
 {
 	using namespace Texture;
-	assert(m_unif_data);
-	m_unif_data.bind(0);
+	assert(data());
+	unif::i1(shader, RC_SHADER_MATERIAL_INDEX_LOCATION, static_cast<int>(m_index));
 
-	if(has_texture_kind(Kind::BaseColor)) {
-		if(!bind_to_unit(textures.base_color_map, RC_FRAGMENT_SHADER_TEXTURE_BINDING_DIFFUSE)) {
-			bind_to_unit(_default_diffuse, RC_FRAGMENT_SHADER_TEXTURE_BINDING_DIFFUSE);
+	if(bindless_supported()) {
+		update_texture_handles();
+		return;
+	}
+
+	auto bind_or_fallback = [](const ImageTexture2D& texture, uint32_t unit, const ImageTexture2D& fallback)
+	{
+		if(!bind_to_unit(texture, unit)) {
+			bind_to_unit(fallback, unit);
 		}
+	};
+
+	if(has_texture_kind(Kind::BaseColor)) {
+		bind_or_fallback(textures.base_color_map, RC_FRAGMENT_SHADER_TEXTURE_BINDING_DIFFUSE, _default_diffuse);
 	}
 	if(has_texture_kind(Kind::Normal)) {
-		bind_to_unit(textures.normal_map, RC_FRAGMENT_SHADER_TEXTURE_BINDING_NORMAL);
+		bind_or_fallback(textures.normal_map, RC_FRAGMENT_SHADER_TEXTURE_BINDING_NORMAL, _neutral_normal);
 	}
 
 	if (has_texture_kind(Kind::OcclusionSeparate)) {
-		bind_to_unit(textures.occlusion_map, RC_FRAGMENT_SHADER_TEXTURE_BINDING_OCCLUSION);
-	} else if (has_texture_kind(Kind::Occlusion)) {
-		bind_to_unit(textures.occlusion_roughness_metallic_map, RC_FRAGMENT_SHADER_TEXTURE_BINDING_OCCLUSION);
+		bind_or_fallback(textures.occlusion_map, RC_FRAGMENT_SHADER_TEXTURE_BINDING_OCCLUSION, _neutral_white);
 	}
 
-	if (has_texture_kind(Kind::RoughnessMetallic)) {
-		bind_to_unit(textures.occlusion_roughness_metallic_map, RC_FRAGMENT_SHADER_TEXTURE_BINDING_ROUGHNESS_METALLIC);
+	// packed occlusion is sampled together with roughness and metallic
+	if (has_packed_orm()) {
+		bind_or_fallback(textures.occlusion_roughness_metallic_map, RC_FRAGMENT_SHADER_TEXTURE_BINDING_ROUGHNESS_METALLIC, _neutral_white);
 	}
 
 	if (has_texture_kind(Kind::Emission)) {
-		bind_to_unit(textures.emission_map, RC_FRAGMENT_SHADER_TEXTURE_BINDING_EMISSION);
+		bind_or_fallback(textures.emission_map, RC_FRAGMENT_SHADER_TEXTURE_BINDING_EMISSION, _neutral_white);
 	}
 }
 
+// Bindless counterpart of texture unit binds: handles live in material storage and are
+// only re-uploaded when they change (streamed texture becomes resident or is reallocated).
+void Material::update_texture_handles() const noexcept
+{
+	using namespace Texture;
+
+	auto handle_or_fallback = [](const ImageTexture2D& texture, const ImageTexture2D& fallback)
+	{
+		const auto handle = texture.bindless_handle();
+		return handle ? handle : fallback.bindless_handle();
+	};
+
+	UniformData::TextureHandles handles;
+	if(has_texture_kind(Kind::BaseColor)) {
+		handles.diffuse = handle_or_fallback(textures.base_color_map, _default_diffuse);
+	}
+	if(has_texture_kind(Kind::Normal)) {
+		handles.normal = handle_or_fallback(textures.normal_map, _neutral_normal);
+	}
+
+	if (has_texture_kind(Kind::OcclusionSeparate)) {
+		handles.occlusion = handle_or_fallback(textures.occlusion_map, _neutral_white);
+	}
+
+	if (has_packed_orm()) {
+		handles.roughness_metallic = handle_or_fallback(textures.occlusion_roughness_metallic_map, _neutral_white);
+	}
+
+	if (has_texture_kind(Kind::Emission)) {
+		handles.emission = handle_or_fallback(textures.emission_map, _neutral_white);
+	}
+
+	if(std::memcmp(&handles, &m_handles, sizeof(handles)) != 0) {
+		m_handles = handles;
+		MaterialStorage::instance().update(m_index, offsetof(UniformData, handles), sizeof(handles), &handles);
+	}
+}
+
+void Material::request_texture_detail(float uv_per_pixel) const noexcept
+{
+	Texture::Streamer::request_detail(textures.base_color_map, uv_per_pixel);
+	Texture::Streamer::request_detail(textures.normal_map, uv_per_pixel);
+	Texture::Streamer::request_detail(textures.occlusion_roughness_metallic_map, uv_per_pixel);
+	Texture::Streamer::request_detail(textures.occlusion_map, uv_per_pixel);
+	Texture::Streamer::request_detail(textures.emission_map, uv_per_pixel);
+}
+
 Texture::AlphaMode Material::alpha_mode() const noexcept
 {
 	return m_alpha_mode;
@@ -241,6 +471,13 @@ bool Material::has_texture_kind(Texture::Kind k) const noexcept
 	return test(m_flags, k);
 }
 
+bool Material::has_packed_orm() const noexcept
+{
+	using namespace Texture;
+	return has_texture_kind(Kind::RoughnessMetallic)
+	    || (has_texture_kind(Kind::Occlusion) && !has_texture_kind(Kind::OcclusionSeparate));
+}
+
 bool Material::set_texture_kind(Texture::Kind k, bool has_map) noexcept
 {
 	using namespace Texture;
@@ -301,24 +538,27 @@ void Material::set_shader_flags()
 		}
 	}
 	data()->type = flags;
+	m_shader_flags = flags;
+}
+
+uint32_t Material::shader_flags() const noexcept
+{
+	return m_shader_flags;
 }
 
 Material::UniformData * Material::data() const
 {
-	return m_unif_data.data();
+	return MaterialStorage::instance().data(m_index);
 }
 
-ImageTexture2D Material::load_image_texture(const std::filesystem::path& path, Texture::ColorSpace space)
+ImageTexture2D Material::load_image_texture(const std::filesystem::path& path, Texture::ColorSpace space, Texture::Kind kind, float alpha_cutoff)
 {
 	ZoneScoped;
-	ImageTexture2D ret;
-	auto cached = Texture::Cache::get(path);
-	if(cached) {
-		ret = cached->share();
-	} else {
-		ret = ImageTexture2D::fromFile(path, space);
+	auto ret = Texture::Cache::get(path, space, kind, alpha_cutoff);
+	if(!ret.valid()) {
+		ret = Texture::Streamer::request(path, space, kind, alpha_cutoff);
 		if(ret.valid()) {
-			Texture::Cache::add(path, ret.share());
+			Texture::Cache::add(path, space, kind, alpha_cutoff, ret.share());
 		}
 	}
 	return ret;
@@ -1,7 +1,6 @@
 #pragma once
 #include <rendercat/common.hpp>
 #include <rendercat/texture2d.hpp>
-#include <rendercat/uniform.hpp>
 #include <zcm/vec4.hpp>
 #include <zcm/vec3.hpp>
 #include <string>
@@ -21,14 +20,21 @@ struct Material
 
 	static void set_default_diffuse(const std::string_view path) noexcept;
 	static void delete_default_diffuse() noexcept;
+	// Flushes modified parameters of all materials and binds their storage buffer.
+	static void bind_storage() noexcept;
+	static void release_storage() noexcept;
 	static Material create_default_material();
-	static ImageTexture2D load_image_texture(const std::filesystem::path& file_path, Texture::ColorSpace colorspace);
+	static ImageTexture2D load_image_texture(const std::filesystem::path& file_path,
+	                                         Texture::ColorSpace colorspace,
+	                                         Texture::Kind kind = Texture::Kind::None,
+	                                         float alpha_cutoff = -1.0f);
 
 	bool valid() const;
 	void flush();
-	void map();
-	void unmap();
-	void bind(uint32_t s) const noexcept;
+	void bind(uint32_t shader) const noexcept;
+	uint32_t index() const noexcept;
+	// Requests mip levels of streamed textures fine enough for given sampling rate.
+	void request_texture_detail(float uv_per_pixel) const noexcept;
 
 	void set_base_color_factor(zcm::vec4) noexcept;
 	void set_emissive_factor(zcm::vec3) noexcept;
@@ -46,10 +52,14 @@ struct Material
 	void set_occlusion_map(ImageTexture2D&&);
 
 	bool has_texture_kind(Texture::Kind) const noexcept;
+	// True if occlusion_roughness_metallic_map is sampled, for any of its channels.
+	bool has_packed_orm() const noexcept;
 	bool set_texture_kind(Texture::Kind, bool has_map) noexcept;
 
 	Texture::AlphaMode alpha_mode() const noexcept;
 	bool double_sided() const noexcept;
+	// Feature flags seen by shaders as material.type, see RC_SHADER_TEXTURE_* in shaders/common.h.
+	uint32_t shader_flags() const noexcept;
 
 	struct UniformData {
 		zcm::vec4          base_color_factor  = 1.0f;
@@ -60,6 +70,14 @@ struct Material
 		float              occlusion_strength = 1.0f;
 		float              alpha_cutoff = 0.5f;
 		int                type = 0;
+		// ARB_bindless_texture handles, written by bind() when supported
+		struct TextureHandles {
+			uint64_t   diffuse = 0;
+			uint64_t   normal = 0;
+			uint64_t   roughness_metallic = 0;
+			uint64_t   occlusion = 0;
+			uint64_t   emission = 0;
+		} handles;
 	};
 
 	struct Textures {
@@ -77,15 +95,18 @@ private:
 	friend struct Scene;
 	void cleanup(uint32_t prev_flags, uint32_t new_flags) noexcept;
 	void set_shader_flags();
+	void update_texture_handles() const noexcept;
 
-	unif::buf<UniformData> m_unif_data;
+	uint32_t           m_index = ~0u; // slot in material storage buffer
+	mutable UniformData::TextureHandles m_handles; // last written to storage
 	uint32_t           m_flags = 0;
+	uint32_t           m_shader_flags = 0;
 	Texture::AlphaMode m_alpha_mode = Texture::AlphaMode::Opaque;
 	bool               m_double_sided = true;
 
 public:
 
-	UniformData *data() const; // pointer to mapped params UBO
+	UniformData *data() const; // pointer to mapped params in storage buffer, invalidated when it grows
 
 };
 
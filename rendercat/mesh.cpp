@@ -1,13 +1,23 @@
 #include <rendercat/mesh.hpp>
 #include <rendercat/material.hpp>
+#include <rendercat/texture_packer.hpp>
 #include <rendercat/util/gl_debug.hpp>
 #include <fx/gltf.h>
 #include <fmt/core.h>
+#include <stb_image.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
 #include <numeric>
+#include <unordered_map>
 #include <utility>
 
+#include <zcm/vec2.hpp>
 #include <zcm/vec3.hpp>
 #include <zcm/vec4.hpp>
+#include <zcm/common.hpp>
+#include <zcm/geometric.hpp>
 
 #include <glbinding/gl45core/boolean.h>
 #include <glbinding/gl45core/bitfield.h>
@@ -90,7 +100,132 @@ static void apply_gltf_sampler(const fx::gltf::Sampler* s, ImageTexture2D& tex)
 }
 
 
-static Material load_gltf_material(const fx::gltf::Document& doc, int mat_idx, const std::filesystem::path& texture_path)
+// Precompressed sibling of referenced image, e.g. foo.ktx2 or foo.dds next to foo.png.
+static std::filesystem::path precompressed_sibling(const std::filesystem::path& path)
+{
+	for (const char* ext : {".ktx2", ".dds"}) {
+		auto sibling = path;
+		sibling.replace_extension(ext);
+		std::error_code ec;
+		if (std::filesystem::is_regular_file(sibling, ec))
+			return sibling;
+	}
+	return {};
+}
+
+static ImageTexture2D load_gltf_texture(const std::filesystem::path& path,
+                                        Texture::ColorSpace space,
+                                        Texture::Kind kind,
+                                        float alpha_cutoff = -1.0f)
+{
+	auto sibling = precompressed_sibling(path);
+	if (!sibling.empty())
+		return Material::load_image_texture(sibling, space, kind);
+	return Material::load_image_texture(path, space, kind, alpha_cutoff);
+}
+
+
+// Repacks separately authored occlusion, roughness and metallic images into one image.
+// Returns empty path if material already has them in one image or they can't be packed.
+// Only decodes and writes files, so it runs while staging the model.
+static std::filesystem::path pack_orm_textures(const fx::gltf::Document& doc,
+                                               const fx::gltf::Material& mat,
+                                               const std::filesystem::path& texture_path)
+{
+	ZoneScoped;
+	const auto roughness_path = get_texture_uri(doc, mat.pbrMetallicRoughness.metallicRoughnessTexture);
+	const auto occlusion_path = get_texture_uri(doc, mat.occlusionTexture);
+	if (roughness_path.empty() && occlusion_path.empty())
+		return {};
+	if (roughness_path == occlusion_path)
+		return {};
+
+	std::vector<Texture::OrmSource> sources;
+	if (!roughness_path.empty()) {
+		const auto path = texture_path / roughness_path;
+		if (!precompressed_sibling(path).empty())
+			return {};
+
+		int width, height, channels;
+		if (!stbi_info(path.u8string().data(), &width, &height, &channels))
+			return {};
+
+		Texture::OrmSource source;
+		source.path = path;
+		if (channels >= 3) {
+			if (occlusion_path.empty())
+				return {}; // already in glTF layout
+			source.channels[1] = 1;
+			source.channels[2] = 2;
+		} else {
+			// single-channel map, kind is guessed from file name
+			auto name = roughness_path;
+			std::transform(name.begin(), name.end(), name.begin(), [](auto ch)
+			{
+				return std::tolower(ch);
+			});
+			if (name.find("roughness") != std::string::npos) {
+				source.channels[1] = 0;
+			} else if (name.find("metallic") != std::string::npos) {
+				source.channels[2] = 0;
+			} else if (name.find("occlusion") != std::string::npos) {
+				source.channels[0] = 0;
+			} else {
+				fmt::print(stderr, "Cannot determine single-channel map kind: {}\n", roughness_path);
+				return {};
+			}
+		}
+		sources.push_back(std::move(source));
+	}
+	if (!occlusion_path.empty()) {
+		const auto path = texture_path / occlusion_path;
+		if (!precompressed_sibling(path).empty())
+			return {};
+
+		Texture::OrmSource source;
+		source.path = path;
+		source.channels[0] = 0;
+		sources.push_back(std::move(source));
+	}
+
+	return Texture::pack_orm(sources);
+}
+
+// Loads image produced by pack_orm_textures() in place of separate maps.
+static bool load_packed_orm_texture(const fx::gltf::Document& doc,
+                                    const fx::gltf::Material& mat,
+                                    const std::filesystem::path& packed_path,
+                                    Material& material)
+{
+	ZoneScoped;
+	if (packed_path.empty())
+		return false;
+
+	auto map = Material::load_image_texture(packed_path, Texture::ColorSpace::Linear, Texture::Kind::OcclusionRoughnessMetallic);
+	if (!map.valid())
+		return false;
+
+	const auto roughness_path = get_texture_uri(doc, mat.pbrMetallicRoughness.metallicRoughnessTexture);
+	const auto occlusion_path = get_texture_uri(doc, mat.occlusionTexture);
+
+	material.textures.occlusion_roughness_metallic_map = std::move(map);
+	const auto& sampler_texture = roughness_path.empty() ? mat.occlusionTexture : mat.pbrMetallicRoughness.metallicRoughnessTexture;
+	apply_gltf_sampler(get_gltf_sampler(doc, sampler_texture), material.textures.occlusion_roughness_metallic_map);
+
+	if (!roughness_path.empty())
+		material.set_texture_kind(Texture::Kind::RoughnessMetallic, true);
+	if (!occlusion_path.empty()) {
+		material.set_texture_kind(Texture::Kind::Occlusion, true);
+		material.data()->occlusion_strength = mat.occlusionTexture.strength;
+	}
+	return true;
+}
+
+
+static Material load_gltf_material(const fx::gltf::Document& doc,
+                                   int mat_idx,
+                                   const std::filesystem::path& texture_path,
+                                   const std::filesystem::path& packed_orm_path)
 {
 	ZoneScoped;
 	fx::gltf::Material mat;
@@ -101,7 +236,9 @@ static Material load_gltf_material(const fx::gltf::Document& doc, int mat_idx, c
 	{
 		auto diffuse_path = get_texture_uri(doc, mat.pbrMetallicRoughness.baseColorTexture);
 		if (!diffuse_path.empty()) {
-			auto map = Material::load_image_texture(texture_path / diffuse_path, Texture::ColorSpace::sRGB);
+			// mips of alpha-tested textures keep coverage at material's cutoff
+			const float alpha_cutoff = material.alpha_mode() == Texture::AlphaMode::Mask ? mat.alphaCutoff : -1.0f;
+			auto map = load_gltf_texture(texture_path / diffuse_path, Texture::ColorSpace::sRGB, Texture::Kind::BaseColor, alpha_cutoff);
 			if (map.valid()) {
 				material.set_base_color_map(std::move(map));
 				apply_gltf_sampler(get_gltf_sampler(doc, mat.pbrMetallicRoughness.baseColorTexture),
@@ -112,7 +249,7 @@ static Material load_gltf_material(const fx::gltf::Document& doc, int mat_idx, c
 	{
 		auto normal_path = get_texture_uri(doc, mat.normalTexture);
 		if (!normal_path.empty()) {
-			auto map = Material::load_image_texture(texture_path / normal_path, Texture::ColorSpace::Linear);
+			auto map = load_gltf_texture(texture_path / normal_path, Texture::ColorSpace::Linear, Texture::Kind::Normal);
 			if (map.valid()) {
 				if (map.channels() < 2) {
 					fmt::print(stderr, "Normal map has less than 2 channels: {}\n", normal_path);
@@ -128,7 +265,7 @@ static Material load_gltf_material(const fx::gltf::Document& doc, int mat_idx, c
 	{
 		auto emission_path = get_texture_uri(doc, mat.emissiveTexture);
 		if (!emission_path.empty()) {
-			auto map = Material::load_image_texture(texture_path / emission_path, Texture::ColorSpace::Linear);
+			auto map = load_gltf_texture(texture_path / emission_path, Texture::ColorSpace::Linear, Texture::Kind::Emission);
 			if (map.valid()) {
 				if (map.channels() < 3) {
 					fmt::print(stderr, "Emission map has less than 3 channels: {}\n", emission_path);
@@ -140,10 +277,10 @@ static Material load_gltf_material(const fx::gltf::Document& doc, int mat_idx, c
 			}
 		}
 	}
-	{
+	if (!load_packed_orm_texture(doc, mat, packed_orm_path, material)) {
 		auto roughness_path = get_texture_uri(doc, mat.pbrMetallicRoughness.metallicRoughnessTexture);
 		if (!roughness_path.empty()) {
-			auto map = Material::load_image_texture(texture_path / roughness_path, Texture::ColorSpace::Linear);
+			auto map = load_gltf_texture(texture_path / roughness_path, Texture::ColorSpace::Linear, Texture::Kind::RoughnessMetallic);
 			if (map.valid()) {
 				if (map.channels() == 1) {
 					std::transform(roughness_path.begin(), roughness_path.end(), roughness_path.begin(), [](auto ch)
@@ -186,7 +323,7 @@ static Material load_gltf_material(const fx::gltf::Document& doc, int mat_idx, c
 		auto occlusion_path = get_texture_uri(doc, mat.occlusionTexture);
 		if (!occlusion_path.empty()) {
 			if (occlusion_path != roughness_path) {
-				auto map = Material::load_image_texture(texture_path / occlusion_path, Texture::ColorSpace::Linear);
+				auto map = load_gltf_texture(texture_path / occlusion_path, Texture::ColorSpace::Linear, Texture::Kind::OcclusionSeparate);
 				if (map.valid()) {
 					material.set_occlusion_map(std::move(map));
 					apply_gltf_sampler(get_gltf_sampler(doc, mat.occlusionTexture),
@@ -199,8 +336,7 @@ static Material load_gltf_material(const fx::gltf::Document& doc, int mat_idx, c
 			material.data()->occlusion_strength = mat.occlusionTexture.strength;
 		}
 	}
-
-	material.unmap();
+	material.flush();
 
 	return material;
 }
@@ -283,6 +419,25 @@ struct rc::model::attr_description_t {
 };
 
 
+// Packed vertex and index data of depth-only stream, see build_depth_stream().
+struct DepthStreamData
+{
+	std::vector<uint8_t> vertex_data;
+	std::vector<uint8_t> index_data;
+	uint32_t stride = 0;
+};
+
+// Mesh data prepared by Mesh::stage_data() for upload on render thread.
+struct rc::model::staged_mesh
+{
+	attr_description_t index;
+	std::vector<attr_description_t> attrs; // data is moved into storage, offsets point there
+	std::vector<uint8_t> storage;
+	DepthStreamData depth_position;
+	DepthStreamData depth_position_uv;
+};
+
+
 static rc::model::attr_description_t gltf_attr_data(int accessor_idx, const fx::gltf::Document& doc)
 {
 	const auto& accessor = doc.accessors.at(accessor_idx);
@@ -357,29 +512,6 @@ static rc::model::attr_description_t load_gltf_primitive_indices(
 }
 
 
-static std::vector<std::pair<model::Mesh, int>> load_gltf_mesh(const fx::gltf::Mesh& mesh, const fx::gltf::Document& doc)
-{
-	ZoneScoped;
-	std::vector<std::pair<model::Mesh, int>> res;
-
-	for (const auto& primitive : mesh.primitives) {
-
-		std::vector<rc::model::attr_description_t> attrs;
-
-		for (auto& attr : primitive.attributes) {
-			attrs.push_back(load_gltf_primitive_attr(doc, primitive, attr.first));
-		}
-
-		auto m = model::Mesh(mesh.name);
-
-		m.upload_data(load_gltf_primitive_indices(doc, primitive), std::move(attrs));
-		m.draw_mode = static_cast<uint32_t>(primitive.mode);
-
-		res.emplace_back(std::make_pair(std::move(m), primitive.material));
-	}
-	return res;
-}
-
 struct node_transform {
 
 	zcm::vec3 translate;
@@ -413,110 +545,132 @@ struct node_transform {
 };
 
 
-static void load_gltf_mesh_with_material(model::data& res,
-                                         std::map<int, int>& materials_cache,
-                                         const std::filesystem::path& material_path,
-                                         const fx::gltf::Document& doc,
-                                         const node_transform& transform,
-                                         size_t mesh_id) {
+// Primitive of glTF mesh with transform of its node, ready for upload.
+struct staged_primitive
+{
+	model::Mesh mesh;
+	model::staged_mesh data;
+	node_transform transform;
+	int material;
+};
+
+struct rc::model::staged_file
+{
+	fx::gltf::Document doc;
+	std::filesystem::path material_path;
+	std::vector<staged_primitive> primitives;
+	std::map<int, std::filesystem::path> packed_orm; // glTF material index -> packed ORM image
+};
+
+
+static void stage_gltf_mesh(model::staged_file& res, const node_transform& transform, size_t mesh_id)
+{
 	ZoneScoped;
+	const auto& mesh = res.doc.meshes.at(mesh_id);
 
-	const auto& mesh = doc.meshes[mesh_id];
-	auto meshes_materials = load_gltf_mesh(mesh, doc);
+	for (const auto& primitive : mesh.primitives) {
 
-	for (auto&& mm : meshes_materials) {
+		std::vector<rc::model::attr_description_t> attrs;
 
-		res.primitives.push_back(std::move(mm.first));
-		res.scale.push_back(transform.scale);
-		res.translate.push_back(transform.translate);
-		res.rotation.push_back(transform.rotate);
+		for (auto& attr : primitive.attributes) {
+			attrs.push_back(load_gltf_primitive_attr(res.doc, primitive, attr.first));
+		}
 
-		auto matcache_pos = materials_cache.find(mm.second);
+		auto& staged = res.primitives.emplace_back(staged_primitive{model::Mesh(mesh.name), {}, transform, primitive.material});
+		staged.mesh.draw_mode = static_cast<uint32_t>(primitive.mode);
+		staged.mesh.stage_data(staged.data, load_gltf_primitive_indices(res.doc, primitive), std::move(attrs));
 
-		if (matcache_pos != materials_cache.end()) {
-			res.primitive_material.push_back(matcache_pos->second);
-		} else {
-			res.primitive_material.push_back(res.materials.size());
-			materials_cache.insert(std::make_pair(mm.second, (int)res.materials.size()));
-			res.materials.push_back(load_gltf_material(doc, mm.second, material_path));
+		if (res.packed_orm.count(primitive.material) == 0) {
+			fx::gltf::Material mat;
+			if (primitive.material >= 0)
+				mat = res.doc.materials.at(primitive.material);
+			res.packed_orm.emplace(primitive.material, pack_orm_textures(res.doc, mat, res.material_path));
 		}
 	}
 }
 
 
-
-static void load_node_recursive(model::data& res,
-                                const fx::gltf::Document& doc,
-                                std::map<int, int>& materials_cache,
-                                const std::filesystem::path& material_path,
-                                const node_transform& parent_transform,
-                                size_t node_idx)
+static void stage_node_recursive(model::staged_file& res,
+                                 const node_transform& parent_transform,
+                                 size_t node_idx)
 {
 	ZoneScoped;
-	const auto& node = doc.nodes.at(node_idx);
+	const auto& node = res.doc.nodes.at(node_idx);
 	auto transform = parent_transform * node_transform{node};
 
 	for (auto ch : node.children)
-		load_node_recursive(res, doc, materials_cache, material_path, transform, ch);
+		stage_node_recursive(res, transform, ch);
 
-	if (node.mesh >= 0) {
-
-		zcm::vec3 node_scale{zcm::no_init_t{}}, node_translate{zcm::no_init_t{}};
-		zcm::quat node_rotate{zcm::no_init_t{}};
-
-
-
-		load_gltf_mesh_with_material(res,
-		                             materials_cache,
-		                             material_path,
-		                             doc,
-		                             transform,
-		                             node.mesh);
-	}
+	if (node.mesh >= 0)
+		stage_gltf_mesh(res, transform, node.mesh);
 }
 
 
-bool model::load_gltf_file(data& res, const std::filesystem::path& path)
+std::shared_ptr<model::staged_file> model::stage_gltf_file(const std::filesystem::path& path)
 {
 	ZoneScoped;
-
-	std::map<int, int> materials_cache;
-
-	fx::gltf::Document doc;
+	auto res = std::make_shared<staged_file>();
 	{
 		ZoneScopedN("parse gltf file");
-		doc = fx::gltf::LoadFromText(path, fx::gltf::ReadQuotas{32, 1024*1024*1024, 1024*1024*1024});
+		res->doc = fx::gltf::LoadFromText(path, fx::gltf::ReadQuotas{32, 1024*1024*1024, 1024*1024*1024});
 	}
 
-	auto material_path = path.parent_path();
+	res->material_path = path.parent_path();
 
-	if (doc.scenes.empty()) {
+	if (res->doc.scenes.empty()) {
+		for (size_t i = 0; i < res->doc.meshes.size(); ++i)
+			stage_gltf_mesh(*res, node_transform{}, i);
+	}
 
-		for (size_t i = 0; i < doc.meshes.size(); ++i) {
+	for (const auto& scene : res->doc.scenes) {
+		for (const auto& node_idx : scene.nodes) {
+			// FixMe: rewrite non-recursively
+			stage_node_recursive(*res, node_transform{}, node_idx);
+		}
+	}
+	return res;
+}
 
-			load_gltf_mesh_with_material(res,
-			                             materials_cache,
-			                             material_path,
-			                             doc,
-			                             node_transform{},
-			                             i);
 
-		}
+bool model::upload_gltf_file(data& res, staged_file& staged)
+{
+	ZoneScoped;
+	std::map<int, int> materials_cache;
 
-	}
+	for (auto& primitive : staged.primitives) {
 
+		primitive.mesh.upload_data(primitive.data);
+		res.primitives.push_back(std::move(primitive.mesh));
+		res.scale.push_back(primitive.transform.scale);
+		res.translate.push_back(primitive.transform.translate);
+		res.rotation.push_back(primitive.transform.rotate);
 
-	for (const auto& scene : doc.scenes) {
+		auto matcache_pos = materials_cache.find(primitive.material);
 
-		for (const auto& node_idx : scene.nodes) {
-			// FixMe: rewrite non-recursively
-			load_node_recursive(res, doc, materials_cache, material_path, node_transform{}, node_idx);
+		if (matcache_pos != materials_cache.end()) {
+			res.primitive_material.push_back(matcache_pos->second);
+		} else {
+			res.primitive_material.push_back(res.materials.size());
+			materials_cache.insert(std::make_pair(primitive.material, (int)res.materials.size()));
+			res.materials.push_back(load_gltf_material(staged.doc,
+			                                           primitive.material,
+			                                           staged.material_path,
+			                                           staged.packed_orm[primitive.material]));
 		}
 	}
+	staged.primitives.clear();
 	return true;
 }
 
 
+bool model::load_gltf_file(data& res, const std::filesystem::path& path)
+{
+	ZoneScoped;
+	auto staged = stage_gltf_file(path);
+	return upload_gltf_file(res, *staged);
+}
+
+
 enum class AttrIndex
 {
 	Invalid = -1,
@@ -552,6 +706,206 @@ static AttrIndex get_attr_index(const std::string_view name)
 }
 
 
+// Vertex of a depth-only stream. Compared bitwise so that deduplication never merges
+// vertices that would rasterize differently.
+struct DepthVertex
+{
+	float pos[3];
+	float uv[2];
+
+	bool operator==(const DepthVertex& o) const noexcept
+	{
+		return std::memcmp(this, &o, sizeof(DepthVertex)) == 0;
+	}
+};
+
+struct DepthVertexHash
+{
+	size_t operator()(const DepthVertex& v) const noexcept
+	{
+		uint32_t words[5];
+		std::memcpy(words, &v, sizeof(words));
+		uint64_t h = 14695981039346656037ull;
+		for (auto w : words) {
+			h ^= w;
+			h *= 1099511628211ull;
+		}
+		return h;
+	}
+};
+
+
+static uint32_t read_index(const rc::model::attr_description_t& index, uint32_t i)
+{
+	switch (static_cast<GLenum>(index.comp_type)) {
+	case GL_UNSIGNED_BYTE:
+		return index.data[i];
+	case GL_UNSIGNED_SHORT:
+	{
+		uint16_t v;
+		std::memcpy(&v, index.data.data() + i * sizeof(v), sizeof(v));
+		return v;
+	}
+	case GL_UNSIGNED_INT:
+	{
+		uint32_t v;
+		std::memcpy(&v, index.data.data() + i * sizeof(v), sizeof(v));
+		return v;
+	}
+	default:
+		assert(false);
+		return 0;
+	}
+}
+
+
+// Average texture coordinate density of triangle mesh: square root of the ratio of
+// total UV area to total surface area. Used to pick mip levels to stream in.
+static float compute_uv_density(const rc::model::attr_description_t& index,
+                                const rc::model::attr_description_t& position,
+                                const rc::model::attr_description_t& texcoord)
+{
+	if (position.comp_count != 3 || static_cast<GLenum>(position.comp_type) != GL_FLOAT
+	    || texcoord.comp_count != 2 || static_cast<GLenum>(texcoord.comp_type) != GL_FLOAT)
+		return 0.0f;
+
+	const uint32_t count = index.data.empty() ? position.elem_count : index.elem_count;
+	double world_area = 0.0;
+	double uv_area = 0.0;
+	for (uint32_t i = 0; i + 2 < count; i += 3) {
+		zcm::vec3 p[3];
+		zcm::vec2 t[3];
+		for (int k = 0; k < 3; ++k) {
+			uint32_t src = index.data.empty() ? i + k : read_index(index, i + k);
+			if (src >= position.elem_count || src >= texcoord.elem_count)
+				return 0.0f;
+			std::memcpy(&p[k], position.data.data() + src * position.elem_byte_size, sizeof(p[k]));
+			std::memcpy(&t[k], texcoord.data.data() + src * texcoord.elem_byte_size, sizeof(t[k]));
+		}
+		world_area += zcm::length(zcm::cross(p[1] - p[0], p[2] - p[0]));
+		const auto e1 = t[1] - t[0];
+		const auto e2 = t[2] - t[0];
+		uv_area += zcm::abs(e1.x * e2.y - e1.y * e2.x);
+	}
+
+	if (world_area <= 0.0 || uv_area <= 0.0)
+		return 0.0f;
+	return static_cast<float>(std::sqrt(uv_area / world_area));
+}
+
+
+// Builds deduplicated vertex stream for depth-only passes: only attributes that affect
+// rasterized depth are kept, so vertices split for normals/tangents/seams get merged back.
+static void build_depth_stream(model::Mesh::DepthStream& stream,
+                               DepthStreamData& packed,
+                               const std::string& name,
+                               const rc::model::attr_description_t& index,
+                               const rc::model::attr_description_t& position,
+                               const rc::model::attr_description_t* texcoord)
+{
+	ZoneScoped;
+
+	// glTF positions are always float vec3; only float texcoords are supported here,
+	// meshes with quantized UVs keep using full VAO for masked shadows.
+	if (position.comp_count != 3 || static_cast<GLenum>(position.comp_type) != GL_FLOAT)
+		return;
+	if (texcoord && (texcoord->comp_count != 2 || static_cast<GLenum>(texcoord->comp_type) != GL_FLOAT))
+		return;
+
+	const uint32_t count = index.data.empty() ? position.elem_count : index.elem_count;
+	if (count == 0)
+		return;
+
+	std::vector<DepthVertex> vertices;
+	std::vector<uint32_t> indices;
+	std::unordered_map<DepthVertex, uint32_t, DepthVertexHash> unique;
+	indices.reserve(count);
+	unique.reserve(position.elem_count);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t src = index.data.empty() ? i : read_index(index, i);
+		if (src >= position.elem_count || (texcoord && src >= texcoord->elem_count)) {
+			fmt::print(stderr, "[mesh] Vertex index out of range in mesh '{}'\n", name);
+			std::fflush(stderr);
+			return;
+		}
+
+		DepthVertex v{};
+		std::memcpy(v.pos, position.data.data() + src * position.elem_byte_size, sizeof(v.pos));
+		if (texcoord)
+			std::memcpy(v.uv, texcoord->data.data() + src * texcoord->elem_byte_size, sizeof(v.uv));
+
+		auto [it, inserted] = unique.try_emplace(v, static_cast<uint32_t>(vertices.size()));
+		if (inserted)
+			vertices.push_back(v);
+		indices.push_back(it->second);
+	}
+
+	// pack vertices tightly: either 3 or 5 floats per vertex
+	const uint32_t stride = texcoord ? 5 * sizeof(float) : 3 * sizeof(float);
+	auto& vertex_data = packed.vertex_data;
+	vertex_data.resize(vertices.size() * stride);
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		std::memcpy(vertex_data.data() + i * stride, &vertices[i], stride);
+	}
+	packed.stride = stride;
+
+	auto& index_data = packed.index_data;
+	if (vertices.size() <= 0xFFFF) {
+		index_data.resize(indices.size() * sizeof(uint16_t));
+		for (size_t i = 0; i < indices.size(); ++i) {
+			uint16_t v = static_cast<uint16_t>(indices[i]);
+			std::memcpy(index_data.data() + i * sizeof(v), &v, sizeof(v));
+		}
+		stream.index_type = static_cast<uint32_t>(GL_UNSIGNED_SHORT);
+	} else {
+		index_data.resize(indices.size() * sizeof(uint32_t));
+		std::memcpy(index_data.data(), indices.data(), index_data.size());
+		stream.index_type = static_cast<uint32_t>(GL_UNSIGNED_INT);
+	}
+
+	stream.numverts = count;
+	stream.numverts_unique = static_cast<uint32_t>(vertices.size());
+}
+
+static void upload_depth_stream(model::Mesh::DepthStream& stream,
+                                const DepthStreamData& packed,
+                                const std::string& name)
+{
+	if (packed.vertex_data.empty())
+		return;
+
+	const auto& vertex_data = packed.vertex_data;
+	const auto& index_data = packed.index_data;
+	const uint32_t stride = packed.stride;
+	const bool texcoord = stride > 3 * sizeof(float);
+	const char* kind = texcoord ? "depth+uv" : "depth";
+	glCreateVertexArrays(1, stream.vao.get());
+	rcObjectLabel(stream.vao, fmt::format("mesh {} vao: {}", kind, name));
+	glCreateBuffers(1, stream.vbo.get());
+	rcObjectLabel(stream.vbo, fmt::format("mesh {} vbo: {}", kind, name));
+	glNamedBufferStorage(*stream.vbo, vertex_data.size(), vertex_data.data(), gl::GL_NONE_BIT);
+	glCreateBuffers(1, stream.ebo.get());
+	rcObjectLabel(stream.ebo, fmt::format("mesh {} ebo: {}", kind, name));
+	glNamedBufferStorage(*stream.ebo, index_data.size(), index_data.data(), gl::GL_NONE_BIT);
+
+	glVertexArrayElementBuffer(*stream.vao, *stream.ebo);
+	glVertexArrayVertexBuffer(*stream.vao, 0, *stream.vbo, 0, stride);
+
+	const auto pos_attr = static_cast<GLuint>(AttrIndex::Position);
+	glVertexArrayAttribBinding(*stream.vao, pos_attr, 0);
+	glVertexArrayAttribFormat(*stream.vao, pos_attr, 3, GL_FLOAT, GL_FALSE, 0);
+	glEnableVertexArrayAttrib(*stream.vao, pos_attr);
+
+	if (texcoord) {
+		const auto uv_attr = static_cast<GLuint>(AttrIndex::TexCoord0);
+		glVertexArrayAttribBinding(*stream.vao, uv_attr, 0);
+		glVertexArrayAttribFormat(*stream.vao, uv_attr, 2, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+		glEnableVertexArrayAttrib(*stream.vao, uv_attr);
+	}
+}
+
+
 bool model::Mesh::valid() const noexcept
 {
 	return numverts != 0 && vao;
@@ -563,27 +917,18 @@ model::Mesh::Mesh(std::string name_) : name(std::move(name_))
 }
 
 
-void model::Mesh::upload_data(attr_description_t index, std::vector<attr_description_t> attrs) {
+void model::Mesh::stage_data(staged_mesh& staged, attr_description_t index, std::vector<attr_description_t> attrs)
+{
 	ZoneScoped;
-	TracyGpuZone("mesh_upload_data");
-
-	// set up GPU objects --------------------------------------------------
-	glCreateVertexArrays(1, vao.get());
-	rcObjectLabel(vao, fmt::format("mesh vao: {}", name));
 	if (!index.data.empty()) {
-		glCreateBuffers(1, ebo.get());
-		rcObjectLabel(ebo, fmt::format("mesh ebo: {}", name));
-		glNamedBufferStorage(*ebo, index.data.size(), index.data.data(), gl::GL_NONE_BIT);
 		index_type = index.comp_type;
 		numverts = index.elem_count;
 
 		index_min = index.min_idx;
 		index_max = index.max_idx;
-
-		glVertexArrayElementBuffer(*vao, *ebo);
 	}
 
-	std::vector<uint8_t> storage;
+	auto& storage = staged.storage;
 
 	attrs.erase(std::remove_if(attrs.begin(), attrs.end(), [](const auto& attr)
 	{
@@ -607,15 +952,10 @@ void model::Mesh::upload_data(attr_description_t index, std::vector<attr_descrip
 		return;
 	}
 
-	glCreateBuffers(1, vbo.get());
-	rcObjectLabel(vbo, fmt::format("mesh vbo: {}", name));
-	glNamedBufferStorage(*vbo, storage.size(), storage.data(), gl::GL_NONE_BIT);
-
-	int binding_index = 0;
-	for (auto& attr : attrs) {
-
+	const attr_description_t* position = nullptr;
+	const attr_description_t* texcoord = nullptr;
+	for (const auto& attr : attrs) {
 		auto attr_index = get_attr_index(attr.name);
-		assert(attr_index != AttrIndex::Invalid);
 
 		if (attr_index == AttrIndex::Position) {
 			bbox = attr.bbox;
@@ -623,10 +963,58 @@ void model::Mesh::upload_data(attr_description_t index, std::vector<attr_descrip
 			if (numverts == 0) {
 				numverts = attr.elem_count;
 			}
+			position = &attr;
+		} else if (attr_index == AttrIndex::TexCoord0) {
+			texcoord = &attr;
+		} else if (attr_index == AttrIndex::Tangent) {
+			has_tangents = true;
 		}
+	}
 
-		if (attr_index == AttrIndex::Tangent)
-			has_tangents = true;
+	if (position && texcoord && draw_mode == static_cast<uint32_t>(GL_TRIANGLES))
+		uv_density = compute_uv_density(index, *position, *texcoord);
+
+	if (position) {
+		build_depth_stream(depth_position, staged.depth_position, name, index, *position, nullptr);
+		if (texcoord)
+			build_depth_stream(depth_position_uv, staged.depth_position_uv, name, index, *position, texcoord);
+	}
+
+	// vertex data now lives in storage, only layout is kept
+	for (auto& attr : attrs)
+		attr.data = {};
+
+	staged.index = std::move(index);
+	staged.attrs = std::move(attrs);
+}
+
+void model::Mesh::upload_data(const staged_mesh& staged)
+{
+	ZoneScoped;
+	TracyGpuZone("mesh_upload_data");
+
+	if (staged.storage.empty())
+		return;
+
+	// set up GPU objects --------------------------------------------------
+	glCreateVertexArrays(1, vao.get());
+	rcObjectLabel(vao, fmt::format("mesh vao: {}", name));
+	if (!staged.index.data.empty()) {
+		glCreateBuffers(1, ebo.get());
+		rcObjectLabel(ebo, fmt::format("mesh ebo: {}", name));
+		glNamedBufferStorage(*ebo, staged.index.data.size(), staged.index.data.data(), gl::GL_NONE_BIT);
+		glVertexArrayElementBuffer(*vao, *ebo);
+	}
+
+	glCreateBuffers(1, vbo.get());
+	rcObjectLabel(vbo, fmt::format("mesh vbo: {}", name));
+	glNamedBufferStorage(*vbo, staged.storage.size(), staged.storage.data(), gl::GL_NONE_BIT);
+
+	int binding_index = 0;
+	for (auto& attr : staged.attrs) {
+
+		auto attr_index = get_attr_index(attr.name);
+		assert(attr_index != AttrIndex::Invalid);
 
 		auto attribute_index = static_cast<GLuint>(attr_index);
 
@@ -641,4 +1029,7 @@ void model::Mesh::upload_data(attr_description_t index, std::vector<attr_descrip
 
 		++binding_index;
 	}
+
+	upload_depth_stream(depth_position, staged.depth_position, name);
+	upload_depth_stream(depth_position_uv, staged.depth_position_uv, name);
 }
@@ -6,6 +6,7 @@
 #include <rendercat/util/gl_unique_handle.hpp>
 #include <string>
 #include <filesystem>
+#include <memory>
 #include <vector>
 #include <zcm/quat.hpp>
 
@@ -13,9 +14,24 @@ namespace rc {
 namespace model {
 
 	struct attr_description_t;
+	struct staged_mesh;
+	struct staged_file;
 
 	struct Mesh
 	{
+		// Compact deduplicated vertex stream used by depth-only passes.
+		struct DepthStream
+		{
+			buffer_handle ebo;
+			buffer_handle vbo;
+			vertex_array_handle vao;
+			uint32_t numverts = 0;
+			uint32_t numverts_unique = 0;
+			uint32_t index_type{};
+
+			bool valid() const noexcept { return numverts != 0 && vao; }
+		};
+
 		std::string name;
 		buffer_handle ebo;
 		buffer_handle vbo;
@@ -27,14 +43,20 @@ namespace model {
 		uint32_t index_type{};
 		uint32_t draw_mode{};
 		bbox3 bbox;
+		float uv_density = 0.0f; // TEXCOORD_0 units per object space unit, 0 if unknown
 		bool has_tangents = false;
 
+		DepthStream depth_position;     // positions only, for opaque casters
+		DepthStream depth_position_uv;  // positions + TEXCOORD_0, for alpha-masked casters
+
 		bool valid() const noexcept;
 
 		explicit Mesh(std::string name_);
 		~Mesh() = default;
 
-		void upload_data(attr_description_t index, std::vector<attr_description_t> attrs);
+		// Fills mesh properties and packs vertex data for upload, without touching GL.
+		void stage_data(staged_mesh& staged, attr_description_t index, std::vector<attr_description_t> attrs);
+		void upload_data(const staged_mesh& staged);
 
 		RC_DEFAULT_MOVE_NOEXCEPT(Mesh)
 		RC_DISABLE_COPY(Mesh)
@@ -50,6 +72,13 @@ namespace model {
 		std::vector<zcm::vec3> translate;
 	};
 
+	// Parses glTF file, prepares vertex data and packs textures. Makes no GL calls, so it
+	// may run on worker thread; throws if file can't be parsed.
+	std::shared_ptr<staged_file> stage_gltf_file(const std::filesystem::path& path);
+
+	// Creates meshes and materials of staged file on render thread.
+	bool upload_gltf_file(data& res, staged_file& staged);
+
 	bool load_gltf_file(data& res, const std::filesystem::path& path);
 } // namespace model
 } // namespace rc
@@ -1,12 +1,17 @@
 #include <rendercat/common.hpp>
 #include <rendercat/renderer.hpp>
 #include <rendercat/scene.hpp>
+#include <rendercat/texture_bake_cache.hpp>
+#include <rendercat/texture_cache.hpp>
+#include <rendercat/texture_streamer.hpp>
 #include <rendercat/uniform.hpp>
 #include <rendercat/util/gl_screenshot.hpp>
 #include <rendercat/util/gl_debug.hpp>
 #include <rendercat/util/turbo_colormap.hpp>
 #include <fmt/core.h>
 #include <string>
+#include <algorithm>
+#include <limits>
 #include <stdexcept>
 #include <imgui.h>
 
@@ -20,7 +25,9 @@
 #include <debug_draw.hpp>
 #include <tracy/Tracy.hpp>
 
+#include <zcm/angle_and_trigonometry.hpp>
 #include <zcm/ivec2.hpp>
+#include <zcm/geometric.hpp>
 #include <zcm/hash.hpp>
 #include <zcm/mat3.hpp>
 #include <zcm/exponential.hpp>
@@ -42,9 +49,73 @@ static GLint max_framebuffer_height;
 static GLint max_uniform_locations;
 static GLenum frag_derivative_quality_hint;
 
+static constexpr uint32_t SHADOWS_DIRECTIONAL = 1 << 1;
+static constexpr uint32_t SHADOWS_POINT       = 1 << 2;
+static constexpr uint32_t SHADOWS_SPOT        = 1 << 3;
+
+// Generic program variant key: material flags in low 16 bits, then tangents and shadow flags.
+static constexpr uint32_t VARIANT_MATERIAL_MASK = RC_SHADER_TEXTURE_KIND_BASE_COLOR
+                                                | RC_SHADER_TEXTURE_KIND_NORMAL
+                                                | RC_SHADER_TEXTURE_KIND_ROUGNESS_METALLIC
+                                                | RC_SHADER_TEXTURE_KIND_OCCLUSION
+                                                | RC_SHADER_TEXTURE_KIND_EMISSION
+                                                | RC_SHADER_TEXTURE_NORMAL_WITHOUT_Z
+                                                | RC_SHADER_TEXTURE_SEPARATE_OCCLUSION
+                                                | RC_SHADER_TEXTURE_ALPHA_MASK;
+static constexpr uint32_t VARIANT_TANGENTS = 1 << 16;
+static constexpr uint32_t VARIANT_SHADOWS_SHIFT = 16;
+
+static uint32_t generic_variant_key(const Material& material, const model::Mesh& submesh)
+{
+	return (material.shader_flags() & VARIANT_MATERIAL_MASK) | (submesh.has_tangents ? VARIANT_TANGENTS : 0);
+}
+
+// Defines for programs sampling material textures.
+static ShaderSet::macros_t material_macros(ShaderSet::macros_t&& macros = ShaderSet::macros_t())
+{
+	if(Texture::bindless_supported())
+		macros.emplace_back("RC_BINDLESS_TEXTURES");
+	return std::move(macros);
+}
+
+uint32_t Renderer::shadow_flags() const
+{
+	uint32_t flags = 0;
+	if (do_shadow_mapping) {
+		bool do_directional = enable_directional_shadows && m_scene->directional_light.color_intensity.w > 0.0f;
+		flags |= do_directional ? SHADOWS_DIRECTIONAL : 0;
+		flags |= enable_point_shadows       ? SHADOWS_POINT : 0;
+		flags |= enable_spot_shadows        ? SHADOWS_SPOT : 0;
+	}
+	return flags;
+}
+
+uint32_t Renderer::generic_program(uint32_t variant)
+{
+	if (!use_shader_variants)
+		return *m_shader;
+
+	auto it = m_generic_variants.find(variant);
+	if (it == m_generic_variants.end()) {
+		ZoneScoped;
+		auto program = m_shader_set.load_program({"generic.vert", "generic.frag"}, material_macros({
+		        ShaderMacro("RC_MATERIAL_VARIANT", variant & VARIANT_MATERIAL_MASK)
+		                .specialization_constant(RC_SPEC_CONSTANT_MATERIAL_VARIANT),
+		        ShaderMacro("RC_VARIANT_TANGENTS", (variant & VARIANT_TANGENTS) ? 1 : 0)
+		                .specialization_constant(RC_SPEC_CONSTANT_TANGENTS_VARIANT),
+		        ShaderMacro("RC_SHADOW_VARIANT", variant >> VARIANT_SHADOWS_SHIFT)
+		                .specialization_constant(RC_SPEC_CONSTANT_SHADOW_VARIANT)}));
+		it = m_generic_variants.emplace(variant, program).first;
+	}
+	// still compiling or failed to build
+	if (!it->second || !*it->second)
+		return *m_shader;
+	return *it->second;
+}
+
 Renderer::Renderer(Scene& s, ShaderSet& shader_set) : m_shader_set(shader_set), m_scene(&s)
 {
-	m_shader = m_shader_set.load_program({"generic.vert", "generic.frag"});
+	m_shader = m_shader_set.load_program({"generic.vert", "generic.frag"}, material_macros());
 	m_hdr_shader = m_shader_set.load_program({"fullscreen_triangle.vert", "hdr.frag"});
 	m_bloom_downscale_shader = m_shader_set.load_program({"downscale_bloom_luma.comp"});
 
@@ -84,6 +155,11 @@ Renderer::Renderer(Scene& s, ShaderSet& shader_set) : m_shader_set(shader_set),
 	m_per_frame.set_label("per-frame generic uniforms");
 	m_light_per_frame.set_label("per-frame light uniforms");
 
+	const zcm::vec4 no_irradiance[9]{};
+	glCreateBuffers(1, m_irradiance_sh.get());
+	glNamedBufferStorage(*m_irradiance_sh, sizeof(no_irradiance), no_irradiance, gl::GL_NONE_BIT);
+	rcObjectLabel(m_irradiance_sh, "irradiance SH");
+
 
 	dd::initialize(&debug_draw_ctx);
 	init_shadow_resources();
@@ -96,14 +172,14 @@ void Renderer::init_shadow_resources()
 	ZoneScoped;
 	TracyGpuZone("init_shadow_resources");
 	RC_DEBUG_GROUP("init_shadow_resources");
-	m_shadow_shader = m_shader_set.load_program({"shadow_mapping.vert", "shadow_mapping.frag"});
+	m_shadow_shader = m_shader_set.load_program({"shadow_mapping.vert", "shadow_mapping.frag"}, material_macros());
 	m_shadow_point_shader = m_shader_set.load_program({"shadow_mapping.vert", "shadow_mapping.frag"},
-	                                                   {{"POINT_LIGHT"}});
+	                                                   material_macros({{"POINT_LIGHT"}}));
 
-	// create texture for directional light shadowmap
-	glCreateTextures(GL_TEXTURE_2D, 1, m_shadowmap_depth_to.get());
-	rcObjectLabel(m_shadowmap_depth_to, "directional shadow depth");
-	glTextureStorage2D(*m_shadowmap_depth_to, 1, GL_DEPTH_COMPONENT32F, ShadowMapWidth, ShadowMapHeight);
+	// create texture array for directional light shadow cascades
+	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, m_shadowmap_depth_to.get());
+	rcObjectLabel(m_shadowmap_depth_to, "directional shadow cascades depth");
+	glTextureStorage3D(*m_shadowmap_depth_to, 1, GL_DEPTH_COMPONENT32F, ShadowMapWidth, ShadowMapHeight, RC_SHADOW_CASCADES);
 
 	auto set_shadow_sampling_params = [](auto texture){
 		float borderColor[] = {0.0f, 0.0f, 0.0f, 1.0f };
@@ -115,65 +191,53 @@ void Renderer::init_shadow_resources()
 	};
 	set_shadow_sampling_params(*m_shadowmap_depth_to);
 
-	glCreateFramebuffers(1, m_shadowmap_fbo.get());
-	rcObjectLabel(m_shadowmap_fbo, "directional shadow FBO");
-	glNamedFramebufferTexture(*m_shadowmap_fbo, GL_DEPTH_ATTACHMENT, *m_shadowmap_depth_to, 0);
-
-	if (glCheckNamedFramebufferStatus(*m_shadowmap_fbo, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-		fmt::print(stderr, "[renderer] could not init shadow framebuffer!");
-		std::fflush(stderr);
-	}
+	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, m_static_shadowmap_depth_to.get());
+	rcObjectLabel(m_static_shadowmap_depth_to, "directional static shadow cascades depth");
+	glTextureStorage3D(*m_static_shadowmap_depth_to, 1, GL_DEPTH_COMPONENT32F, ShadowMapWidth, ShadowMapHeight, RC_SHADOW_CASCADES);
 
-	// create texture array for spot light shadowmaps
-	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, m_spot_shadow_depth_to.get());
-	rcObjectLabel(m_spot_shadow_depth_to, "spot shadow depth");
-	glTextureStorage3D(*m_spot_shadow_depth_to, 1, GL_DEPTH_COMPONENT16, PointShadowWidth, PointShadowHeight, MaxLights);
-	set_shadow_sampling_params(*m_spot_shadow_depth_to);
+	for (size_t i = 0; i < RC_SHADOW_CASCADES; ++i) {
+		glCreateFramebuffers(1, m_cascade_fbos[i].get());
+		rcObjectLabel(m_cascade_fbos[i], fmt::format("directional shadow cascade FBO #{}", i));
+		glNamedFramebufferTextureLayer(*m_cascade_fbos[i], GL_DEPTH_ATTACHMENT, *m_shadowmap_depth_to, 0, i);
 
-	glCreateFramebuffers(1, m_spot_shadow_fbo.get());
-	rcObjectLabel(m_spot_shadow_fbo, "spot shadow FBO");
-	glNamedFramebufferTexture(*m_spot_shadow_fbo, GL_DEPTH_ATTACHMENT, *m_spot_shadow_depth_to, 0);
-	if (glCheckNamedFramebufferStatus(*m_spot_shadow_fbo, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-		fmt::print(stderr, "[renderer] could not init spot shadow framebuffer!");
-		std::fflush(stderr);
-	}
+		glCreateFramebuffers(1, m_static_cascade_fbos[i].get());
+		rcObjectLabel(m_static_cascade_fbos[i], fmt::format("directional static shadow cascade FBO #{}", i));
+		glNamedFramebufferTextureLayer(*m_static_cascade_fbos[i], GL_DEPTH_ATTACHMENT, *m_static_shadowmap_depth_to, 0, i);
 
-	// create framebuffers for clearing individual layers in spot shadow texture array
-	for (int i = 0; i < MaxLights; ++i) {
-		glCreateFramebuffers(1, m_spot_layer_fbos[i].get());
-		rcObjectLabel(m_spot_layer_fbos[i], fmt::format("spot clearing FBO #{}", i));
-		glNamedFramebufferTextureLayer(*m_spot_layer_fbos[i], GL_DEPTH_ATTACHMENT, *m_spot_shadow_depth_to, 0, i);
-		if (glCheckNamedFramebufferStatus(*m_spot_layer_fbos[i], GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-			fmt::print(stderr, "[renderer] could not init spot shadow clearing framebuffer!");
+		if (glCheckNamedFramebufferStatus(*m_cascade_fbos[i], GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE
+		    || glCheckNamedFramebufferStatus(*m_static_cascade_fbos[i], GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			fmt::print(stderr, "[renderer] could not init shadow cascade framebuffer!");
 			std::fflush(stderr);
 		}
 	}
 
-	// create texture array for point light shadowmaps
-	glCreateTextures(GL_TEXTURE_CUBE_MAP_ARRAY, 1, m_point_shadow_depth_to.get());
-	rcObjectLabel(m_point_shadow_depth_to, "point shadow depth");
-	glTextureStorage3D(*m_point_shadow_depth_to, 1, GL_DEPTH_COMPONENT16, PointShadowWidth, PointShadowHeight, MaxLights * 6);
-	set_shadow_sampling_params(*m_point_shadow_depth_to);
-	glTextureParameteri(*m_point_shadow_depth_to, GL_TEXTURE_CUBE_MAP_SEAMLESS, GL_TRUE);
+	// create shared atlas for spot and point light shadowmaps
+	glCreateTextures(GL_TEXTURE_2D, 1, m_shadow_atlas_depth_to.get());
+	rcObjectLabel(m_shadow_atlas_depth_to, "shadow atlas depth");
+	glTextureStorage2D(*m_shadow_atlas_depth_to, 1, GL_DEPTH_COMPONENT16, ShadowAtlasSize, ShadowAtlasSize);
+	set_shadow_sampling_params(*m_shadow_atlas_depth_to);
 
-	glCreateFramebuffers(1, m_point_shadow_fbo.get());
-	rcObjectLabel(m_point_shadow_fbo, "point shadow FBO");
-	glNamedFramebufferTexture(*m_point_shadow_fbo, GL_DEPTH_ATTACHMENT, *m_point_shadow_depth_to, 0);
+	glCreateFramebuffers(1, m_shadow_atlas_fbo.get());
+	rcObjectLabel(m_shadow_atlas_fbo, "shadow atlas FBO");
+	glNamedFramebufferTexture(*m_shadow_atlas_fbo, GL_DEPTH_ATTACHMENT, *m_shadow_atlas_depth_to, 0);
 
-	if (glCheckNamedFramebufferStatus(*m_point_shadow_fbo, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-		fmt::print(stderr, "[renderer] could not init point shadow framebuffer!");
+	if (glCheckNamedFramebufferStatus(*m_shadow_atlas_fbo, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fmt::print(stderr, "[renderer] could not init shadow atlas framebuffer!");
 		std::fflush(stderr);
 	}
 
-	// create framebuffers for clearing individual layers in point shadow texture array
-	for (int i = 0; i < MaxLights * 6; ++i) {
-		glCreateFramebuffers(1, m_point_layer_fbos[i].get());
-		rcObjectLabel(m_point_layer_fbos[i], fmt::format("point clearing FBO #{}", i));
-		glNamedFramebufferTextureLayer(*m_point_layer_fbos[i], GL_DEPTH_ATTACHMENT, *m_point_shadow_depth_to, 0, i);
-		if (glCheckNamedFramebufferStatus(*m_point_layer_fbos[i], GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-			fmt::print(stderr, "[renderer] could not init point shadow clearing framebuffer!");
-			std::fflush(stderr);
-		}
+	// static layer of the atlas, mirrors its layout
+	glCreateTextures(GL_TEXTURE_2D, 1, m_static_shadow_atlas_depth_to.get());
+	rcObjectLabel(m_static_shadow_atlas_depth_to, "static shadow atlas depth");
+	glTextureStorage2D(*m_static_shadow_atlas_depth_to, 1, GL_DEPTH_COMPONENT16, ShadowAtlasSize, ShadowAtlasSize);
+
+	glCreateFramebuffers(1, m_static_shadow_atlas_fbo.get());
+	rcObjectLabel(m_static_shadow_atlas_fbo, "static shadow atlas FBO");
+	glNamedFramebufferTexture(*m_static_shadow_atlas_fbo, GL_DEPTH_ATTACHMENT, *m_static_shadow_atlas_depth_to, 0);
+
+	if (glCheckNamedFramebufferStatus(*m_static_shadow_atlas_fbo, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fmt::print(stderr, "[renderer] could not init static shadow atlas framebuffer!");
+		std::fflush(stderr);
 	}
 }
 
@@ -183,23 +247,30 @@ void Renderer::init_brdf()
 	TracyGpuZone("init_brdf");
 	RC_DEBUG_GROUP("init_brdf");
 
+	int size = 256;
+
+	// LUT only depends on shader, so on cache hit there is nothing to wait for
 	m_brdf_shader = m_shader_set.load_program({"brdf_lut.comp"});
-	if (!m_brdf_shader) {
-		fmt::print(stderr, "[renderer] could not init BRDF LUT compute shader!\n");
-		std::fflush(stderr);
-		return;
-	}
+	const auto key = Texture::BakeCache::key({m_shader_set.source_hash(m_brdf_shader), uint64_t(size)});
+	if (m_brdf_shader && Texture::BakeCache::load(key, m_brdf_lut_to)) {
+		m_shader_set.deleteProgram(&m_brdf_shader);
+	} else {
+		if (!m_shader_set.wait(m_brdf_shader)) {
+			fmt::print(stderr, "[renderer] could not init BRDF LUT compute shader!\n");
+			std::fflush(stderr);
+			return;
+		}
 
-	int size = 256;
+		glCreateTextures(GL_TEXTURE_2D, 1, m_brdf_lut_to.get());
+		glTextureStorage2D(*m_brdf_lut_to, 1, GL_RG16F, size, size);
 
-	glCreateTextures(GL_TEXTURE_2D, 1, m_brdf_lut_to.get());
+		glBindImageTexture(0, *m_brdf_lut_to, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+		glUseProgram(*m_brdf_shader);
+		glDispatchCompute(size/8, size/8, 1);
+		m_shader_set.deleteProgram(&m_brdf_shader);
+		Texture::BakeCache::save(key, m_brdf_lut_to, Texture::BakeCache::Encoding::RG16F);
+	}
 	rcObjectLabel(m_brdf_lut_to, "BRDF LUT");
-	glTextureStorage2D(*m_brdf_lut_to, 1, GL_RG16F, size, size);
-
-	glBindImageTexture(0, *m_brdf_lut_to, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
-	glUseProgram(*m_brdf_shader);
-	glDispatchCompute(size/8, size/8, 1);
-	m_shader_set.deleteProgram(&m_brdf_shader);
 	glTextureParameteri(*m_brdf_lut_to, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTextureParameteri(*m_brdf_lut_to, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTextureParameteri(*m_brdf_lut_to, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -398,7 +469,10 @@ void Renderer::set_uniforms()
 	m_per_frame.bind(1);
 
 	per_frame->proj_view = proj_view;
-	per_frame->light_proj_view = m_shadow_matrix;
+	for (size_t i = 0; i < RC_SHADOW_CASCADES; ++i) {
+		per_frame->cascade_proj_view[i] = m_cascades[i].proj_view;
+		per_frame->cascade_splits[i] = m_cascades[i].split_far;
+	}
 	per_frame->znear           = m_scene->main_camera.state.znear;
 	per_frame->camera_forward  = -m_scene->main_camera.state.get_backward();
 	per_frame->viewPos         = m_scene->main_camera.state.position;
@@ -435,24 +509,16 @@ void Renderer::set_uniforms()
 
 	per_frame->num_msaa_samples = MSAASampleCount;
 
-	const uint32_t SHADOWS_DIRECTIONAL          = 1 << 1;
-	const uint32_t SHADOWS_POINT                = 1 << 2;
-	const uint32_t SHADOWS_SPOT                 = 1 << 3;
-
-	uint32_t flags = 0;
-	if (do_shadow_mapping) {
-		bool do_directional = enable_directional_shadows && m_scene->directional_light.color_intensity.w > 0.0f;
-		flags |= do_directional ? SHADOWS_DIRECTIONAL : 0;
-		flags |= enable_point_shadows       ? SHADOWS_POINT : 0;
-		flags |= enable_spot_shadows        ? SHADOWS_SPOT : 0;
-	}
-	per_frame->flags = flags;
+	per_frame->flags = shadow_flags();
 
 	m_per_frame.flush();
 
+	// projected on GPU, so it never goes through mapped memory
+	const auto irradiance_sh_offset = reinterpret_cast<const char*>(per_frame->irradiance_sh) - reinterpret_cast<const char*>(per_frame);
+	m_per_frame.copy_from(*m_irradiance_sh, irradiance_sh_offset, sizeof(per_frame->irradiance_sh));
+
 	// ------
 
-	Texture::bind_to_unit(m_scene->cubemap_diffuse_irradiance, 34);
 	Texture::bind_to_unit(m_scene->cubemap_specular_environment, 33);
 	glBindTextureUnit(30, *m_turbo_colormap_to);
 	glBindTextureUnit(31, *m_brdf_lut_to);
@@ -481,7 +547,7 @@ static int process_point_lights(const std::vector<PointLight>& point_lights,
 			}
 		}
 	}
-	unif::i1(shader, "num_point_lights", point_light_count);
+	unif::i1(shader, 8, point_light_count); // num_point_lights
 	return point_light_count;
 }
 
@@ -511,7 +577,7 @@ static int process_spot_lights(const std::vector<SpotLight>& spot_lights,
 			}
 		}
 	}
-	unif::i1(shader, "num_spot_lights", spot_light_count);
+	unif::i1(shader, 9, spot_light_count); // num_spot_lights
 	return spot_light_count;
 }
 
@@ -562,6 +628,34 @@ static void submit_draw_call(const model::Mesh& submesh, int num_instances=1)
 	}
 }
 
+// Draws mesh through its compact depth-only stream, falling back to full VAO
+// if the stream could not be built for this mesh.
+template<bool instanced=false>
+static void submit_depth_draw_call(const model::Mesh& submesh, bool alpha_masked, int num_instances=1)
+{
+	const auto& stream = alpha_masked ? submesh.depth_position_uv : submesh.depth_position;
+	if (unlikely(!stream.valid())) {
+		submit_draw_call<instanced>(submesh, num_instances);
+		return;
+	}
+
+	glBindVertexArray(*stream.vao);
+	if constexpr(!instanced) {
+		glDrawRangeElements((GLenum)submesh.draw_mode,
+		                    0,
+		                    stream.numverts_unique - 1,
+		                    stream.numverts,
+		                    GLenum(stream.index_type),
+		                    nullptr);
+	} else {
+		glDrawElementsInstanced((GLenum)submesh.draw_mode,
+		                        stream.numverts,
+		                        GLenum(stream.index_type),
+		                        nullptr,
+		                        num_instances);
+	}
+}
+
 static void render_generic(const model::Mesh& submesh,
                            const Material& material,
                            uint32_t shader)
@@ -573,11 +667,69 @@ static void render_generic(const model::Mesh& submesh,
 	}
 
 	material.bind(shader);
-	unif::b1(shader, "has_tangents", submesh.has_tangents);
+	unif::b1(shader, 7, submesh.has_tangents); // has_baked_tangents
 	submit_draw_call(submesh);
 }
 
 
+// Hashes of caster bboxes, kept separately for static and dynamic casters.
+struct CasterHashes
+{
+	size_t static_casters = 0;
+	size_t dynamic_casters = 0;
+
+	void include(const bbox3& bbox, bool is_static) noexcept
+	{
+		auto& hash = is_static ? static_casters : dynamic_casters;
+		hash ^= zcm::hash(bbox.min());
+		hash ^= zcm::hash(bbox.max());
+	}
+};
+
+// Practical split scheme: blend between logarithmic and uniform splits by \p lambda.
+static void calc_cascade_splits(float near, float far, float lambda, float* splits, size_t count)
+{
+	for (size_t i = 1; i <= count; ++i) {
+		const float p = float(i) / count;
+		const float log_split = near * zcm::pow(far / near, p);
+		const float uniform_split = near + (far - near) * p;
+		splits[i-1] = lambda * log_split + (1.0f - lambda) * uniform_split;
+	}
+}
+
+// Bounding sphere of camera frustum slice between \p near and \p far.
+// Radius depends only on slice shape, so it does not change when camera rotates.
+static zcm::vec4 frustum_slice_sphere(const CameraState& cam, float near, float far)
+{
+	const zcm::vec3 forward = -cam.get_backward();
+	const zcm::vec3 up = cam.get_up();
+	const zcm::vec3 right = cam.get_right();
+	const float tan_y = zcm::tan(cam.fov * 0.5f);
+	const float tan_x = tan_y * cam.aspect;
+
+	zcm::vec3 corners[8];
+	zcm::vec3 center{0.0f};
+	int i = 0;
+	for (float dist : {near, far}) {
+		for (float sx : {-1.0f, 1.0f}) {
+			for (float sy : {-1.0f, 1.0f}) {
+				corners[i] = cam.position + forward * dist + right * (sx * tan_x * dist) + up * (sy * tan_y * dist);
+				center += corners[i];
+				++i;
+			}
+		}
+	}
+	center = center / 8.0f;
+
+	float radius = 0.0f;
+	for (const auto& corner : corners)
+		radius = zcm::max(radius, zcm::length(corner - center));
+
+	// quantize to get rid of float noise
+	radius = std::ceil(radius * 16.0f) / 16.0f;
+	return zcm::vec4{center, radius};
+}
+
 void Renderer::draw_directional_shadow()
 {
 	ZoneScoped;
@@ -589,57 +741,177 @@ void Renderer::draw_directional_shadow()
 	glEnable(GL_CULL_FACE);
 	glCullFace(GL_BACK); // TODO: use front face culling
 
-	glBindFramebuffer(GL_FRAMEBUFFER, *m_shadowmap_fbo);
-	glViewport(0,0, ShadowMapWidth, ShadowMapHeight);
-	glClear(GL_DEPTH_BUFFER_BIT);
+	const auto& cam = m_scene->main_camera.state;
+	const zcm::vec3 light_dir = m_scene->directional_light.direction * zcm::vec3{0.0f, 0.0f, 1.0f};
+	const zcm::vec3 light_up = zcm::abs(light_dir.y) > 0.99f ? zcm::vec3{0.0f, 0.0f, 1.0f} : zcm::vec3{0.0f, 1.0f, 0.0f};
+	const zcm::mat4 light_view = zcm::lookAtRH(zcm::vec3{0.0f}, -light_dir, light_up);
+	const size_t light_hash = zcm::hash(light_dir);
+
+	{
+		ZoneScopedN("light space bboxes");
+		m_light_space_bboxes.resize(m_transform_cache.size());
+		for (size_t i = 0; i < m_transform_cache.size(); ++i)
+			m_light_space_bboxes[i] = bbox3::transformed(m_transform_cache[i].transformed_bbox, light_view);
+	}
+
+	float splits[RC_SHADOW_CASCADES];
+	const float near = cam.znear;
+	const float far = zcm::max(shadow_distance, near * 2.0f);
+	calc_cascade_splits(near, far, cascade_split_lambda, splits, RC_SHADOW_CASCADES);
+
+	// gathers casters overlapping cascade box in light space
+	auto collect_casters = [this, light_hash](const zcm::vec3& center, float radius, float* max_z,
+	                                          std::vector<ModelMeshIdx>* opaque,
+	                                          std::vector<ModelMeshIdx>* masked) {
+		CasterHashes hashes;
+		hashes.static_casters = light_hash;
+		auto process = [&](const std::vector<ModelMeshIdx>& meshes, std::vector<ModelMeshIdx>* out) {
+			for (const auto& idx : meshes) {
+				const auto& ls = m_light_space_bboxes[idx.transform_idx];
+				if (ls.max().x < center.x - radius || ls.min().x > center.x + radius
+				    || ls.max().y < center.y - radius || ls.min().y > center.y + radius
+				    || ls.max().z < center.z - radius) // behind all receivers
+					continue;
+
+				const auto& transform = m_transform_cache[idx.transform_idx];
+				hashes.include(transform.transformed_bbox, transform.is_static);
+				if (max_z)
+					*max_z = zcm::max(*max_z, ls.max().z);
+				if (out)
+					out->push_back(idx);
+			}
+		};
+		process(m_opaque_meshes, opaque);
+		process(m_masked_meshes, masked);
+		return hashes;
+	};
+
+	auto draw_casters = [this](const ShadowCascade& cascade, bool static_casters) {
+		{
+			RC_DEBUG_GROUP("opaque meshes");
+			unif::b1(*m_shadow_shader, 0, false); // alpha-masked
+			for (const auto& idx : cascade.opaque_casters) {
+				const MeshTransform& transform = m_transform_cache[idx.transform_idx];
+				if (transform.is_static != static_casters)
+					continue;
+
+				const auto& shaded_mesh = m_scene->shaded_meshes[idx.submesh_idx];
+				const model::Mesh& submesh = m_scene->submeshes[shaded_mesh.mesh];
+
+				unif::m4(*m_shadow_shader, 1, transform.mat);
+				submit_depth_draw_call(submesh, false);
+			}
+		}
+		{
+			RC_DEBUG_GROUP("masked meshes");
+			unif::b1(*m_shadow_shader, 0, true); // alpha-masked
+
+			for (const auto& idx : cascade.masked_casters) {
+				const MeshTransform& transform = m_transform_cache[idx.transform_idx];
+				if (transform.is_static != static_casters)
+					continue;
+
+				const auto& shaded_mesh = m_scene->shaded_meshes[idx.submesh_idx];
+				const model::Mesh& submesh = m_scene->submeshes[shaded_mesh.mesh];
+				const auto& material = m_scene->materials[shaded_mesh.material];
+
+				unif::m4(*m_shadow_shader, 1, transform.mat);
+				material.bind(*m_shadow_shader);
+				submit_depth_draw_call(submesh, true);
+			}
+		}
+	};
 
 	glUseProgram(*m_shadow_shader);
+	glViewport(0,0, ShadowMapWidth, ShadowMapHeight);
+	// casters in front of near plane get flattened onto it instead of being clipped,
+	// near plane of cached cascades may be out of date for dynamic casters
+	glEnable(GL_DEPTH_CLAMP);
 
-	// TODO: determine frustum size dynamically
-	static float near_plane = -25.0f, far_plane = 25.0f;
-	static zcm::vec4 params = zcm::vec4(-15.0f, 15.0f, -15.0f, 15.0f);
-	auto pos = m_scene->directional_light.direction * zcm::vec3{0.0f, 0.0f, 1.0f};
+	int64_t num_updated = 0;
 
-	zcm::mat4 lightProjection = zcm::orthoRH_ZO(params[0], params[1], params[2],params[3], near_plane, far_plane);
-	auto lightView = zcm::lookAtRH(pos,
-	                             zcm::vec3(0.0f, 0.0f, 0.0f),
-	                             zcm::vec3(0.0f, 1.0f, 0.0f));
+	for (size_t c = 0; c < RC_SHADOW_CASCADES; ++c) {
+		auto& cascade = m_cascades[c];
+		cascade.split_far = splits[c];
 
-	auto proj_view = lightProjection * lightView;
+		const auto sphere = frustum_slice_sphere(cam, c == 0 ? near : splits[c-1], splits[c]);
+		const float radius = sphere.w;
+		zcm::vec3 center = (light_view * zcm::vec4{sphere.xyz, 1.0f}).xyz;
 
-	unif::m4(*m_shadow_shader, 4, proj_view);
-	m_shadow_matrix = proj_view;
-	unif::b1(*m_shadow_shader, 0, false); // alpha-masked
+		// snap to texel grid so that shadow edges do not shimmer as camera moves
+		const float texel = 2.0f * radius / ShadowMapWidth;
+		center.x = zcm::floor(center.x / texel) * texel;
+		center.y = zcm::floor(center.y / texel) * texel;
 
-	{
-		RC_DEBUG_GROUP("opaque meshes");
-		for (const auto& idx : m_opaque_meshes) {
-			const MeshTransform& transform = m_transform_cache[idx.transform_idx];
+		const size_t view_hash = zcm::hash(zcm::vec4{center, radius}) ^ light_hash;
 
-			const auto& shaded_mesh = m_scene->shaded_meshes[idx.submesh_idx];
-			const model::Mesh& submesh = m_scene->submeshes[shaded_mesh.mesh];
+		bool full_update = !enable_shadow_caching || cascade.last_update_frame == 0;
+		if (!full_update && view_hash != cascade.view_hash) {
+			// near cascade always follows camera, distant ones take turns
+			const int interval = std::max(cascade_update_interval, 1);
+			full_update = c == 0 || (m_frame_number % interval) == (c % interval);
+		}
 
-			unif::m4(*m_shadow_shader, 1, transform.mat);
-			submit_draw_call(submesh);
+		bool dynamic_update = false;
+		if (!full_update) {
+			// casters moving inside cached cascade box invalidate it regardless
+			cascade.opaque_casters.clear();
+			cascade.masked_casters.clear();
+			const auto hashes = collect_casters(cascade.center, cascade.radius, nullptr,
+			                                    &cascade.opaque_casters, &cascade.masked_casters);
+			full_update = hashes.static_casters != cascade.static_hash;
+			dynamic_update = hashes.dynamic_casters != cascade.dynamic_hash;
+			cascade.dynamic_hash = hashes.dynamic_casters;
 		}
-	}
-	{
-		RC_DEBUG_GROUP("masked meshes");
-		unif::b1(*m_shadow_shader, 0, true); // alpha-masked
 
-		for (const auto& idx : m_masked_meshes) {
-			const MeshTransform& transform = m_transform_cache[idx.transform_idx];
+		if (!full_update && !dynamic_update)
+			continue;
 
-			const auto& shaded_mesh = m_scene->shaded_meshes[idx.submesh_idx];
-			const model::Mesh& submesh = m_scene->submeshes[shaded_mesh.mesh];
-			const auto& material = m_scene->materials[shaded_mesh.material];
+		RC_DEBUG_GROUP(fmt::format("cascade {}", c));
+		++num_updated;
+
+		if (full_update) {
+			cascade.opaque_casters.clear();
+			cascade.masked_casters.clear();
+			float max_z = center.z + radius;
+			const auto hashes = collect_casters(center, radius, &max_z, &cascade.opaque_casters, &cascade.masked_casters);
+			cascade.static_hash = hashes.static_casters;
+			cascade.dynamic_hash = hashes.dynamic_casters;
+			cascade.view_hash = view_hash;
+			cascade.center = center;
+			cascade.radius = radius;
+			cascade.last_update_frame = m_frame_number;
+
+			// extend near plane towards the light to catch casters outside of view
+			const zcm::mat4 light_proj = zcm::orthoRH_ZO(center.x - radius, center.x + radius,
+			                                             center.y - radius, center.y + radius,
+			                                             -max_z, -(center.z - radius));
+			cascade.proj_view = light_proj * light_view;
+		}
 
-			unif::m4(*m_shadow_shader, 1, transform.mat);
-			material.bind(*m_shadow_shader);
-			submit_draw_call(submesh);
+		unif::m4(*m_shadow_shader, 4, cascade.proj_view);
+
+		if (full_update) {
+			RC_DEBUG_GROUP("static casters");
+			glBindFramebuffer(GL_FRAMEBUFFER, *m_static_cascade_fbos[c]);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			draw_casters(cascade, true);
+		}
+
+		glCopyImageSubData(*m_static_shadowmap_depth_to, GL_TEXTURE_2D_ARRAY, 0, 0, 0, c,
+		                   *m_shadowmap_depth_to, GL_TEXTURE_2D_ARRAY, 0, 0, 0, c,
+		                   ShadowMapWidth, ShadowMapHeight, 1);
+
+		{
+			RC_DEBUG_GROUP("dynamic casters");
+			glBindFramebuffer(GL_FRAMEBUFFER, *m_cascade_fbos[c]);
+			draw_casters(cascade, false);
 		}
 	}
 
+	TracyPlot("Updated shadow cascades", num_updated);
+
+	glDisable(GL_DEPTH_CLAMP);
 	glUseProgram(0);
 	glBindVertexArray(0);
 }
@@ -668,21 +940,249 @@ static bool light_culled_by_bbox(const PointLight& light, const bbox3& bbox) {
 
 
 template<typename LightT, typename Cont>
-static size_t light_hash(const LightT& light, const Cont& transform_cache) {
-	size_t transform_hash = zcm::hash(light.position());
-	transform_hash ^= zcm::hash(light.radius());
+static CasterHashes light_hash(const LightT& light, const Cont& transform_cache) {
+	CasterHashes hashes;
+	// light itself moving invalidates everything, so it goes into static hash
+	hashes.static_casters = zcm::hash(light.position());
+	hashes.static_casters ^= zcm::hash(light.radius());
 
 	if constexpr(std::is_same_v<LightT, SpotLight>) {
-		transform_hash ^= zcm::hash(light.orientation());
+		hashes.static_casters ^= zcm::hash(light.orientation());
+	}
+
+	for (const auto& transform : transform_cache) {
+		if (light_culled_by_bbox(light, transform.transformed_bbox))
+			continue;
+		hashes.include(transform.transformed_bbox, transform.is_static);
+	}
+	return hashes;
+}
+
+
+// Picks atlas region size for light covering approximately \p projected_size pixels on screen.
+static uint32_t choose_shadow_tier(float projected_size, uint32_t current_tier)
+{
+	// hysteresis, so that lights hovering around tier boundary do not get reallocated every frame
+	if (current_tier && projected_size >= current_tier * 0.8f && projected_size < current_tier * 2.5f)
+		return current_tier;
+
+	uint32_t tier = Renderer::ShadowTierMax;
+	while (tier > Renderer::ShadowTierMin && projected_size < tier)
+		tier /= 2;
+	return tier;
+}
+
+static zcm::vec4 atlas_rect(const ShadowAtlas::Region& region, uint32_t atlas_size)
+{
+	if (!region.valid())
+		return zcm::vec4{0.0f};
+
+	const float scale = 1.0f / atlas_size;
+	return zcm::vec4{region.x * scale, region.y * scale, region.size * scale, region.size * scale};
+}
+
+void Renderer::clear_shadow_atlas_region(const ShadowAtlas::Region& region)
+{
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(region.x, region.y, region.size, region.size);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+}
+
+void Renderer::update_shadow_atlas()
+{
+	ZoneScoped;
+	TracyGpuZone("update_shadow_atlas");
+	RC_DEBUG_GROUP("update shadow atlas");
+
+	const auto& camera = m_scene->main_camera;
+	const float screen_scale = m_backbuffer_height / zcm::tan(camera.state.fov * 0.5f);
+
+	// approximate diameter in pixels of light's sphere of influence
+	auto projected_size = [&camera, screen_scale](const PointLight& light) {
+		const float dist = zcm::max(zcm::distance(camera.state.position, light.position()), 0.001f);
+		return screen_scale * light.radius() / dist;
+	};
+
+	auto light_visible = [&camera](const PointLight& light) {
+		return (light.state & PointLight::Enabled)
+		        && !camera.frustum.sphere_culled(light.position(), light.radius());
+	};
+
+	struct Allocation {
+		ShadowAtlas::Region* regions;
+		int      count;
+		uint32_t tier;
+		float    size;
+		bool     point;
+		uint32_t index;
+	};
+	std::array<Allocation, MaxLights * 2> pending;
+	size_t pending_count = 0;
+
+	auto current_tier = [](const ShadowAtlas::Region* regions) {
+		return regions[0].valid() ? uint32_t(regions[0].size) : 0u;
+	};
+
+	auto release = [this](ShadowAtlas::Region* regions, int count) {
+		for (int i = 0; i < count; ++i)
+			m_shadow_atlas.release(regions[i]);
+	};
+
+	for (size_t i = 0; i < MaxLights; ++i) {
+		auto& state = m_point_shadow_state[i];
+		const bool visible = enable_point_shadows
+		                     && i < m_scene->point_lights.size()
+		                     && light_visible(m_scene->point_lights[i]);
+		if (!visible) {
+			// give space to visible lights, shadows are redrawn when light comes back into view
+			release(state.regions, 6);
+			continue;
+		}
+		const float size = projected_size(m_scene->point_lights[i]);
+		const uint32_t tier = choose_shadow_tier(size, current_tier(state.regions));
+		if (tier == current_tier(state.regions))
+			continue;
+
+		if (tier < current_tier(state.regions))
+			release(state.regions, 6); // downgrade always fits into space just released
+		pending[pending_count++] = Allocation{state.regions, 6, tier, size, true, uint32_t(i)};
+	}
+
+	for (size_t i = 0; i < MaxLights; ++i) {
+		auto& state = m_spot_shadow_state[i];
+		const bool visible = enable_spot_shadows
+		                     && i < m_scene->spot_lights.size()
+		                     && light_visible(m_scene->spot_lights[i]);
+		if (!visible) {
+			release(&state.region, 1);
+			continue;
+		}
+		const float size = projected_size(m_scene->spot_lights[i]);
+		const uint32_t tier = choose_shadow_tier(size, current_tier(&state.region));
+		if (tier == current_tier(&state.region))
+			continue;
+
+		if (tier < current_tier(&state.region))
+			release(&state.region, 1);
+		pending[pending_count++] = Allocation{&state.region, 1, tier, size, false, uint32_t(i)};
 	}
 
+	// biggest on screen first, they get the best pick
+	std::sort(pending.begin(), pending.begin() + pending_count, [](const auto& a, const auto& b){
+		return a.size > b.size;
+	});
+
+	glBindFramebuffer(GL_FRAMEBUFFER, *m_shadow_atlas_fbo);
+
+	for (size_t p = 0; p < pending_count; ++p) {
+		auto& alloc = pending[p];
+		ShadowAtlas::Region regions[6];
+		bool allocated = false;
+
+		// fall back to lower tiers when atlas is full
+		for (uint32_t tier = alloc.tier; !allocated && tier >= ShadowTierMin; tier /= 2) {
+			if (alloc.regions[0].valid() && tier <= alloc.regions[0].size)
+				break; // no point moving to the same or smaller size
+
+			allocated = true;
+			for (int i = 0; i < alloc.count; ++i) {
+				regions[i] = m_shadow_atlas.allocate(tier);
+				if (!regions[i].valid()) {
+					release(regions, i);
+					allocated = false;
+					break;
+				}
+			}
+		}
+
+		if (!allocated)
+			continue; // keep whatever light had before, or go without shadows
+
+		release(alloc.regions, alloc.count);
+		for (int i = 0; i < alloc.count; ++i) {
+			alloc.regions[i] = regions[i];
+			clear_shadow_atlas_region(regions[i]);
+		}
+
+		if (alloc.point) {
+			auto& state = m_point_shadow_state[alloc.index];
+			std::fill(std::begin(state.static_face_hashes), std::end(state.static_face_hashes), 0);
+			std::fill(std::begin(state.dynamic_face_hashes), std::end(state.dynamic_face_hashes), 0);
+			state.stale_faces = 0x3f;
+			state.stale_static_faces = 0x3f;
+			state.last_update_frame = 0;
+		} else {
+			m_spot_shadow_state[alloc.index].static_hash = 0;
+			m_spot_shadow_state[alloc.index].dynamic_hash = 0;
+		}
+	}
+
+	if (!enable_shadow_caching) {
+		glClear(GL_DEPTH_BUFFER_BIT); // everything visible is redrawn this frame anyway
+	}
+
+	TracyPlot("Shadow atlas usage", (float)rc::math::percent(m_shadow_atlas.used_area(), uint64_t(ShadowAtlasSize) * ShadowAtlasSize));
+}
+
+
+static std::array<ShadowFrustum, 6> point_shadow_frusta(const PointLight& light, float near)
+{
+	return {
+		ShadowFrustum{light.position(), zcm::vec3( 1.0, 0.0, 0.0), zcm::vec3(0.0,-1.0, 0.0), near, light.radius()},
+		ShadowFrustum{light.position(), zcm::vec3(-1.0, 0.0, 0.0), zcm::vec3(0.0,-1.0, 0.0), near, light.radius()},
+		ShadowFrustum{light.position(), zcm::vec3( 0.0, 1.0, 0.0), zcm::vec3(0.0, 0.0, 1.0), near, light.radius()},
+		ShadowFrustum{light.position(), zcm::vec3( 0.0,-1.0, 0.0), zcm::vec3(0.0, 0.0,-1.0), near, light.radius()},
+		ShadowFrustum{light.position(), zcm::vec3( 0.0, 0.0, 1.0), zcm::vec3(0.0,-1.0, 0.0), near, light.radius()},
+		ShadowFrustum{light.position(), zcm::vec3( 0.0, 0.0,-1.0), zcm::vec3(0.0,-1.0, 0.0), near, light.radius()}
+	};
+}
+
+static std::array<zcm::mat4, 6> point_shadow_transforms(const PointLight& light, float near)
+{
+	const zcm::mat4 proj = zcm::perspectiveRH_ZO(zcm::radians(90.0f), 1, near, light.radius());
+	return {
+		proj * zcm::lookAtRH(light.position(), light.position() + zcm::vec3( 1.0, 0.0, 0.0), zcm::vec3(0.0,-1.0, 0.0)),
+		proj * zcm::lookAtRH(light.position(), light.position() + zcm::vec3(-1.0, 0.0, 0.0), zcm::vec3(0.0,-1.0, 0.0)),
+		proj * zcm::lookAtRH(light.position(), light.position() + zcm::vec3( 0.0, 1.0, 0.0), zcm::vec3(0.0, 0.0, 1.0)),
+		proj * zcm::lookAtRH(light.position(), light.position() + zcm::vec3( 0.0,-1.0, 0.0), zcm::vec3(0.0, 0.0,-1.0)),
+		proj * zcm::lookAtRH(light.position(), light.position() + zcm::vec3( 0.0, 0.0, 1.0), zcm::vec3(0.0,-1.0, 0.0)),
+		proj * zcm::lookAtRH(light.position(), light.position() + zcm::vec3( 0.0, 0.0,-1.0), zcm::vec3(0.0,-1.0, 0.0))
+	};
+}
+
+
+template<typename Cont>
+static std::array<CasterHashes, 6> point_light_face_hashes(const PointLight& light,
+                                                           const std::array<ShadowFrustum, 6>& frusta,
+                                                           const Cont& transform_cache)
+{
+	std::array<CasterHashes, 6> hashes;
+	for (auto& h : hashes)
+		h.static_casters = zcm::hash(light.position()) ^ zcm::hash(light.radius());
+
 	for (const auto& transform : transform_cache) {
 		if (light_culled_by_bbox(light, transform.transformed_bbox))
 			continue;
-		transform_hash ^= zcm::hash(transform.transformed_bbox.min());
-		transform_hash ^= zcm::hash(transform.transformed_bbox.max());
+
+		for (int i = 0; i < 6; ++i) {
+			if (!frusta[i].bbox_culled(transform.transformed_bbox))
+				hashes[i].include(transform.transformed_bbox, transform.is_static);
+		}
 	}
-	return transform_hash;
+	return hashes;
+}
+
+
+// Higher priority means the light's stale faces are re-rendered sooner.
+static float shadow_update_priority(const zcm::vec3& camera_pos, const PointLight& light, uint64_t frames_since_update)
+{
+	const float dist = zcm::distance(camera_pos, light.position());
+	// rough estimate of how much of the screen is covered by light's sphere of influence
+	const float coverage = zcm::min(1.0f, light.radius() / zcm::max(dist, 0.001f));
+	const float proximity = 1.0f / (1.0f + dist);
+	const float staleness = zcm::min(float(frames_since_update), 120.0f) / 120.0f;
+	return coverage * coverage + proximity + staleness;
 }
 
 
@@ -692,134 +1192,210 @@ void Renderer::draw_point_shadow(Renderer::LightPerframeData *per_frame)
 	TracyGpuZone("draw_point_shadow");
 	RC_DEBUG_GROUP("point shadows");
 
-	glViewport(0,0, PointShadowWidth, PointShadowHeight);
 	glUseProgram(*m_shadow_point_shader);
-	if (!enable_shadow_caching) {
-		glBindFramebuffer(GL_FRAMEBUFFER, *m_point_shadow_fbo);
-		glClear(GL_DEPTH_BUFFER_BIT);
-	}
+	glBindFramebuffer(GL_FRAMEBUFFER, *m_shadow_atlas_fbo);
+	std::fill(std::begin(per_frame->point_shadow_rects), std::end(per_frame->point_shadow_rects), zcm::vec4{0.0f});
 
 	const float near = 0.1f;
+	const auto camera_pos = m_scene->main_camera.state.position;
 	int point_shadowmap_count = 0;
-	int updated_count = 0;
 
-	for(size_t scene_index = 0; scene_index < m_scene->point_lights.size() && scene_index < MaxLights; ++scene_index) {
-		const auto& light = m_scene->point_lights[scene_index];
+	{
+		ZoneScopedN("schedule point shadow updates");
+		m_shadow_update_queue.clear();
 
-		RC_DEBUG_GROUP(fmt::format("point light {} (#{})", scene_index, point_shadowmap_count));
+		for(size_t scene_index = 0; scene_index < m_scene->point_lights.size() && scene_index < MaxLights; ++scene_index) {
+			const auto& light = m_scene->point_lights[scene_index];
 
-		if(!(light.state & SpotLight::Enabled))
-			continue;
+			if(!(light.state & PointLight::Enabled))
+				continue;
 
-		if(m_scene->main_camera.frustum.sphere_culled(light.position(), light.radius()))
-			continue;
+			if(m_scene->main_camera.frustum.sphere_culled(light.position(), light.radius()))
+				continue;
 
-		if(light.state & PointLight::ShowWireframe) {
-			dd::sphere(light.position(), light.color(), 0.01f * light.radius(), 0, false);
-			dd::sphere(light.position(), light.color(), light.radius());
-		}
+			if(light.state & PointLight::ShowWireframe) {
+				dd::sphere(light.position(), light.color(), 0.01f * light.radius(), 0, false);
+				dd::sphere(light.position(), light.color(), light.radius());
+			}
 
-		if (enable_shadow_caching) {
-			size_t transform_hash = light_hash(light, m_transform_cache);
-			if (transform_hash == m_point_light_hashes[scene_index]) {
-				++point_shadowmap_count;
-				continue;
+			auto& state = m_point_shadow_state[scene_index];
+			if (!state.regions[0].valid())
+				continue; // did not fit into atlas
+
+			++point_shadowmap_count;
+
+			const auto transforms = point_shadow_transforms(light, near);
+			for (int i = 0; i < 6; ++i) {
+				per_frame->point_light_matrices[scene_index * 6 + i] = transforms[i];
+				per_frame->point_shadow_rects[scene_index * 6 + i] = atlas_rect(state.regions[i], ShadowAtlasSize);
 			}
-			m_point_light_hashes[scene_index] = transform_hash;
 
-			{
-				ZoneScopedN("Clear layer");
-				TracyGpuZone("Clear layer")
+			if (enable_shadow_caching) {
+				const auto hashes = point_light_face_hashes(light, point_shadow_frusta(light, near), m_transform_cache);
 				for (int i = 0; i < 6; ++i) {
-					glBindFramebuffer(GL_FRAMEBUFFER, *m_point_layer_fbos[scene_index*6 + i]);
-					glClear(GL_DEPTH_BUFFER_BIT);
+					if (hashes[i].static_casters != state.static_face_hashes[i]) {
+						state.static_face_hashes[i] = hashes[i].static_casters;
+						state.stale_static_faces |= 1u << i;
+						state.stale_faces |= 1u << i;
+					}
+					if (hashes[i].dynamic_casters != state.dynamic_face_hashes[i]) {
+						state.dynamic_face_hashes[i] = hashes[i].dynamic_casters;
+						state.stale_faces |= 1u << i;
+					}
 				}
-				glBindFramebuffer(GL_FRAMEBUFFER, *m_point_shadow_fbo);
+			} else {
+				state.stale_faces = 0x3f;
+				state.stale_static_faces = 0x3f;
 			}
+
+			if (state.stale_faces == 0)
+				continue;
+
+			float priority = shadow_update_priority(camera_pos, light, m_frame_number - state.last_update_frame);
+			if (state.last_update_frame == 0)
+				priority += 10.0f; // never rendered, light has no shadows at all yet
+
+			m_shadow_update_queue.push_back(ShadowUpdateRequest{uint32_t(scene_index), state.stale_faces, priority});
 		}
-		++updated_count;
 
+		std::sort(m_shadow_update_queue.begin(), m_shadow_update_queue.end(), [](const auto& a, const auto& b){
+			return a.priority > b.priority;
+		});
+	}
 
-		const zcm::mat4 proj = zcm::perspectiveRH_ZO(zcm::radians(90.0f), 1, near, light.radius());
-		const std::array<zcm::mat4, 6> shadowTransforms {
-			proj * zcm::lookAtRH(light.position(), light.position() + zcm::vec3( 1.0, 0.0, 0.0), zcm::vec3(0.0,-1.0, 0.0)),
-			proj * zcm::lookAtRH(light.position(), light.position() + zcm::vec3(-1.0, 0.0, 0.0), zcm::vec3(0.0,-1.0, 0.0)),
-			proj * zcm::lookAtRH(light.position(), light.position() + zcm::vec3( 0.0, 1.0, 0.0), zcm::vec3(0.0, 0.0, 1.0)),
-			proj * zcm::lookAtRH(light.position(), light.position() + zcm::vec3( 0.0,-1.0, 0.0), zcm::vec3(0.0, 0.0,-1.0)),
-			proj * zcm::lookAtRH(light.position(), light.position() + zcm::vec3( 0.0, 0.0, 1.0), zcm::vec3(0.0,-1.0, 0.0)),
-			proj * zcm::lookAtRH(light.position(), light.position() + zcm::vec3( 0.0, 0.0,-1.0), zcm::vec3(0.0,-1.0, 0.0))
-		};
+	// without caching the whole atlas was cleared, so everything visible has to be redrawn
+	int budget = enable_shadow_caching ? std::max(shadow_face_budget, 1) : MaxLights * 6;
+	int updated_faces = 0;
 
-		const std::array<ShadowFrustum, 6> shadowFrusta {
-			ShadowFrustum{light.position(), zcm::vec3( 1.0, 0.0, 0.0), zcm::vec3(0.0,-1.0, 0.0), near, light.radius()},
-			ShadowFrustum{light.position(), zcm::vec3(-1.0, 0.0, 0.0), zcm::vec3(0.0,-1.0, 0.0), near, light.radius()},
-			ShadowFrustum{light.position(), zcm::vec3( 0.0, 1.0, 0.0), zcm::vec3(0.0, 0.0, 1.0), near, light.radius()},
-			ShadowFrustum{light.position(), zcm::vec3( 0.0,-1.0, 0.0), zcm::vec3(0.0, 0.0,-1.0), near, light.radius()},
-			ShadowFrustum{light.position(), zcm::vec3( 0.0, 0.0, 1.0), zcm::vec3(0.0,-1.0, 0.0), near, light.radius()},
-			ShadowFrustum{light.position(), zcm::vec3( 0.0, 0.0,-1.0), zcm::vec3(0.0,-1.0, 0.0), near, light.radius()}
-		};
+	for (auto& request : m_shadow_update_queue) {
+		if (budget <= 0)
+			break;
 
-		for (int i = 0; i < 6; ++i) {
-			unif::m4(*m_shadow_point_shader, 4 + i, shadowTransforms[i]);
+		uint8_t faces = 0;
+		for (int i = 0; i < 6 && budget > 0; ++i) {
+			if (request.faces & (1u << i)) {
+				faces |= 1u << i;
+				--budget;
+				++updated_faces;
+			}
 		}
 
-		unif::b1(*m_shadow_point_shader, 0, false); // alpha-masked
-		unif::i1(*m_shadow_point_shader, 2, scene_index);
+		draw_point_shadow_faces(request.light_index, faces, near);
 
-		auto face_culled = [&shadowFrusta](const auto& bbox, int index) {
-			return shadowFrusta[index].bbox_culled(bbox);
-		};
+		auto& state = m_point_shadow_state[request.light_index];
+		state.stale_faces &= ~faces;
+		state.stale_static_faces &= ~faces;
+		if (state.stale_faces == 0)
+			state.last_update_frame = m_frame_number;
 
-		auto process_mesh = [this, &face_culled](const auto& meshes, const auto& light, bool use_material=false){
-			for (const auto& idx : meshes) {
-				const MeshTransform& transform = m_transform_cache[idx.transform_idx];
+		request.faces &= ~faces;
+	}
 
-				if (light_culled_by_bbox(light, transform.transformed_bbox))
-					continue;
+	// keep only what is still pending, for display in GUI
+	m_shadow_update_queue.erase(std::remove_if(m_shadow_update_queue.begin(), m_shadow_update_queue.end(),
+	                                           [](const auto& r){ return r.faces == 0; }),
+	                            m_shadow_update_queue.end());
 
-				int num_faces = 0;
-				for (int i = 0; i < 6; ++i) {
-					if (!face_culled(transform.transformed_bbox, i)) {
-						unif::i1(*m_shadow_point_shader, 11+num_faces, i);
-						++num_faces;
-					}
-				}
+	per_frame->num_visible_point_lights = point_shadowmap_count;
+	per_frame->point_near_plane = near;
+	TracyPlot("Visible point lights", int64_t(point_shadowmap_count));
+	TracyPlot("Updated point shadow faces", int64_t(updated_faces));
+	TracyPlot("Pending point shadow updates", int64_t(m_shadow_update_queue.size()));
+}
 
-				if (num_faces == 0)
-					continue;
+void Renderer::draw_point_shadow_faces(uint32_t scene_index, uint8_t faces, float near)
+{
+	const auto& light = m_scene->point_lights[scene_index];
+	RC_DEBUG_GROUP(fmt::format("point light {} (faces {:06b})", scene_index, faces));
 
-				const auto& shaded_mesh = m_scene->shaded_meshes[idx.submesh_idx];
-				const model::Mesh& submesh = m_scene->submeshes[shaded_mesh.mesh];
-				if (use_material) {
-					const auto& material = m_scene->materials[shaded_mesh.material];
-					material.bind(*m_shadow_point_shader);
-				}
+	const auto& state = m_point_shadow_state[scene_index];
+	const uint8_t static_faces = faces & state.stale_static_faces;
+
+	const auto shadowTransforms = point_shadow_transforms(light, near);
+	const auto shadowFrusta = point_shadow_frusta(light, near);
+
+	// each cube face goes into its own atlas region, selected via gl_ViewportIndex
+	for (int i = 0; i < 6; ++i) {
+		const auto& region = state.regions[i];
+		glViewportIndexedf(i, region.x, region.y, region.size, region.size);
+		unif::m4(*m_shadow_point_shader, 4 + i, shadowTransforms[i]);
+	}
+
+	auto process_mesh = [this, &shadowFrusta](const auto& meshes, const auto& light, uint8_t face_mask,
+	                                          bool static_casters, bool use_material) {
+		for (const auto& idx : meshes) {
+			const MeshTransform& transform = m_transform_cache[idx.transform_idx];
+
+			if (transform.is_static != static_casters)
+				continue;
+
+			if (light_culled_by_bbox(light, transform.transformed_bbox))
+				continue;
 
-				unif::m4(*m_shadow_point_shader, 1, transform.mat);
-				submit_draw_call<true>(submesh, num_faces);
+			int num_faces = 0;
+			for (int i = 0; i < 6; ++i) {
+				if ((face_mask & (1u << i)) && !shadowFrusta[i].bbox_culled(transform.transformed_bbox)) {
+					unif::i1(*m_shadow_point_shader, 11+num_faces, i);
+					++num_faces;
+				}
 			}
-		};
 
+			if (num_faces == 0)
+				continue;
+
+			const auto& shaded_mesh = m_scene->shaded_meshes[idx.submesh_idx];
+			const model::Mesh& submesh = m_scene->submeshes[shaded_mesh.mesh];
+			if (use_material) {
+				const auto& material = m_scene->materials[shaded_mesh.material];
+				material.bind(*m_shadow_point_shader);
+			}
 
+			unif::m4(*m_shadow_point_shader, 1, transform.mat);
+			submit_depth_draw_call<true>(submesh, use_material, num_faces);
+		}
+	};
 
+	auto draw_casters = [this, &process_mesh, &light](uint8_t face_mask, bool static_casters) {
 		{
 			RC_DEBUG_GROUP("opaque meshes");
-			process_mesh(m_opaque_meshes, light);
-
+			unif::b1(*m_shadow_point_shader, 0, false); // alpha-masked
+			process_mesh(m_opaque_meshes, light, face_mask, static_casters, false);
 		}
-
 		{
 			RC_DEBUG_GROUP("masked meshes");
 			unif::b1(*m_shadow_point_shader, 0, true); // alpha-masked
-			process_mesh(m_masked_meshes, light, true);
+			process_mesh(m_masked_meshes, light, face_mask, static_casters, true);
 		}
+	};
 
-		++point_shadowmap_count;
+	if (static_faces) {
+		RC_DEBUG_GROUP("static casters");
+		glBindFramebuffer(GL_FRAMEBUFFER, *m_static_shadow_atlas_fbo);
+		for (int i = 0; i < 6; ++i) {
+			if (static_faces & (1u << i))
+				clear_shadow_atlas_region(state.regions[i]);
+		}
+		draw_casters(static_faces, true);
+	}
+
+	{
+		ZoneScopedN("Copy static faces");
+		TracyGpuZone("Copy static faces")
+		for (int i = 0; i < 6; ++i) {
+			if (!(faces & (1u << i)))
+				continue;
+			const auto& region = state.regions[i];
+			glCopyImageSubData(*m_static_shadow_atlas_depth_to, GL_TEXTURE_2D, 0, region.x, region.y, 0,
+			                   *m_shadow_atlas_depth_to, GL_TEXTURE_2D, 0, region.x, region.y, 0,
+			                   region.size, region.size, 1);
+		}
+	}
+
+	{
+		RC_DEBUG_GROUP("dynamic casters");
+		glBindFramebuffer(GL_FRAMEBUFFER, *m_shadow_atlas_fbo);
+		draw_casters(faces, false);
 	}
-	per_frame->num_visible_point_lights = point_shadowmap_count;
-	per_frame->point_near_plane = near;
-	TracyPlot("Visible point lights", int64_t(point_shadowmap_count));
-	TracyPlot("Updated point lights", int64_t(updated_count));
 }
 
 void Renderer::draw_spot_shadow(LightPerframeData *per_frame)
@@ -828,12 +1404,9 @@ void Renderer::draw_spot_shadow(LightPerframeData *per_frame)
 	TracyGpuZone("draw_spot_shadow");
 	RC_DEBUG_GROUP("spot shadows");
 
-	glViewport(0,0, PointShadowWidth, PointShadowHeight);
 	glUseProgram(*m_shadow_shader);
-	if (!enable_shadow_caching) {
-		glBindFramebuffer(GL_FRAMEBUFFER, *m_spot_shadow_fbo);
-		glClear(GL_DEPTH_BUFFER_BIT);
-	}
+	glBindFramebuffer(GL_FRAMEBUFFER, *m_shadow_atlas_fbo);
+	std::fill(std::begin(per_frame->spot_shadow_rects), std::end(per_frame->spot_shadow_rects), zcm::vec4{0.0f});
 
 	int spot_shadowmaps_count = 0;
 	int updated_spot_count = 0;
@@ -851,6 +1424,12 @@ void Renderer::draw_spot_shadow(LightPerframeData *per_frame)
 				 light.angle_outer() * light.radius(), 0.0f);
 		}
 
+		auto& state = m_spot_shadow_state[scene_index];
+		if (!state.region.valid())
+			continue; // disabled or did not fit into atlas
+
+		per_frame->spot_shadow_rects[scene_index] = atlas_rect(state.region, ShadowAtlasSize);
+
 		auto light_camera_state = CameraState{zcm::conjugate(light.orientation()), light.position()};
 		light_camera_state.zfar = light.radius();
 		light_camera_state.znear = 0.1f;
@@ -864,26 +1443,21 @@ void Renderer::draw_spot_shadow(LightPerframeData *per_frame)
 		const auto light_mat = proj_mat * view_mat;
 		per_frame->spot_light_matrices[scene_index] = light_mat;
 
+		bool update_static = true;
 		if (enable_shadow_caching) {
-			size_t transform_hash = light_hash(light, m_transform_cache);
-			if (transform_hash == m_spot_light_hashes[scene_index]) {
+			const auto hashes = light_hash(light, m_transform_cache);
+			update_static = hashes.static_casters != state.static_hash;
+			if (!update_static && hashes.dynamic_casters == state.dynamic_hash) {
 				++spot_shadowmaps_count;
 				continue;
 			}
-			m_spot_light_hashes[scene_index] = transform_hash;
-			{
-				ZoneScopedN("Clear layer");
-				TracyGpuZone("Clear layer")
-				glBindFramebuffer(GL_FRAMEBUFFER, *m_spot_layer_fbos[scene_index]);
-				glClear(GL_DEPTH_BUFFER_BIT);
-				glBindFramebuffer(GL_FRAMEBUFFER, *m_spot_shadow_fbo);
-			}
+			state.static_hash = hashes.static_casters;
+			state.dynamic_hash = hashes.dynamic_casters;
 		}
 		++updated_spot_count;
 
-		unif::b1(*m_shadow_shader, 0, false); // alpha-masked
+		glViewport(state.region.x, state.region.y, state.region.size, state.region.size);
 		unif::m4(*m_shadow_shader, 4, light_mat);
-		unif::i1(*m_shadow_shader, 2, scene_index);
 
 		auto frustum = Frustum();
 		frustum.update(light_camera_state);
@@ -897,11 +1471,15 @@ void Renderer::draw_spot_shadow(LightPerframeData *per_frame)
 			                              light.radius()) == Intersection::Outside;
 		};
 
-		auto process_meshes = [this, &spot_culled, &frustum](const auto& meshes, const auto& light, bool use_material=false)
+		auto process_meshes = [this, &spot_culled, &frustum](const auto& meshes, const auto& light,
+		                                                     bool static_casters, bool use_material)
 		{
 			for (const auto& idx : meshes) {
 				const MeshTransform& transform = m_transform_cache[idx.transform_idx];
 
+				if (transform.is_static != static_casters)
+					continue;
+
 				if (spot_culled(transform.transformed_bbox, light))
 					continue;
 
@@ -917,19 +1495,43 @@ void Renderer::draw_spot_shadow(LightPerframeData *per_frame)
 				}
 
 				unif::m4(*m_shadow_shader, 1, transform.mat);
-				submit_draw_call(submesh);
+				submit_depth_draw_call(submesh, use_material);
 			}
 		};
 
+		auto draw_casters = [this, &process_meshes, &light](bool static_casters) {
+			{
+				RC_DEBUG_GROUP("opaque meshes");
+				unif::b1(*m_shadow_shader, 0, false); // alpha-masked
+				process_meshes(m_opaque_meshes, light, static_casters, false);
+			}
+			{
+				RC_DEBUG_GROUP("masked meshes");
+				unif::b1(*m_shadow_shader, 0, true); // alpha-masked
+				process_meshes(m_masked_meshes, light, static_casters, true);
+			}
+		};
+
+		if (update_static) {
+			RC_DEBUG_GROUP("static casters");
+			glBindFramebuffer(GL_FRAMEBUFFER, *m_static_shadow_atlas_fbo);
+			clear_shadow_atlas_region(state.region);
+			draw_casters(true);
+		}
+
 		{
-			RC_DEBUG_GROUP("opaque meshes");
-			process_meshes(m_opaque_meshes, light);
+			ZoneScopedN("Copy static region");
+			TracyGpuZone("Copy static region")
+			const auto& region = state.region;
+			glCopyImageSubData(*m_static_shadow_atlas_depth_to, GL_TEXTURE_2D, 0, region.x, region.y, 0,
+			                   *m_shadow_atlas_depth_to, GL_TEXTURE_2D, 0, region.x, region.y, 0,
+			                   region.size, region.size, 1);
 		}
 
 		{
-			RC_DEBUG_GROUP("masked meshes");
-			unif::b1(*m_shadow_shader, 0, true); // alpha-masked
-			process_meshes(m_masked_meshes, light, true);
+			RC_DEBUG_GROUP("dynamic casters");
+			glBindFramebuffer(GL_FRAMEBUFFER, *m_shadow_atlas_fbo);
+			draw_casters(false);
 		}
 
 		++spot_shadowmaps_count;
@@ -1051,18 +1653,20 @@ void Renderer::draw()
 				auto inv_final_transform_mat = shaded_mesh.transform.inv_mat * model.transform.inv_mat; // (AB)^-1 = B^-1 * A^-1
 				auto submesh_bbox = bbox3::transformed(submesh.bbox, final_transform_mat);
 
-				m_transform_cache.push_back({final_transform_mat, inv_final_transform_mat, submesh_bbox});
+				m_transform_cache.push_back({final_transform_mat, inv_final_transform_mat, submesh_bbox, model.is_static});
 				uint32_t transform_idx = m_transform_cache.size()-1;
 
+				const uint32_t variant = generic_variant_key(material, submesh);
+
 				if(material.alpha_mode() == Texture::AlphaMode::Mask) {
-					m_masked_meshes.push_back(ModelMeshIdx{model_idx, model.shaded_meshes[model_mesh_idx], transform_idx});
+					m_masked_meshes.push_back(ModelMeshIdx{model_idx, model.shaded_meshes[model_mesh_idx], transform_idx, variant});
 					continue;
 				}
 				if(material.alpha_mode() == Texture::AlphaMode::Blend) {
-					m_blended_meshes.push_back(ModelMeshIdx{model_idx, model.shaded_meshes[model_mesh_idx], transform_idx});
+					m_blended_meshes.push_back(ModelMeshIdx{model_idx, model.shaded_meshes[model_mesh_idx], transform_idx, variant});
 					continue;
 				}
-				m_opaque_meshes.push_back(ModelMeshIdx{model_idx, model.shaded_meshes[model_mesh_idx], transform_idx});
+				m_opaque_meshes.push_back(ModelMeshIdx{model_idx, model.shaded_meshes[model_mesh_idx], transform_idx, variant});
 			}
 
 			if (draw_model_bboxes) {
@@ -1071,11 +1675,20 @@ void Renderer::draw()
 			}
 		}
 
+		// bucket draws by program variant to minimize program switches
+		auto by_variant = [](const ModelMeshIdx& a, const ModelMeshIdx& b) { return a.variant < b.variant; };
+		std::stable_sort(m_opaque_meshes.begin(), m_opaque_meshes.end(), by_variant);
+		std::stable_sort(m_masked_meshes.begin(), m_masked_meshes.end(), by_variant);
+
 	}
 
+	update_sky();
+
 	TracyGpuZone("draw_generic");
 	RC_DEBUG_GROUP("draw generic");
 
+	Material::bind_storage();
+
 	m_perfquery.begin();
 
 	if (do_shadow_mapping) {
@@ -1085,6 +1698,7 @@ void Renderer::draw()
 		if (enable_point_shadows || enable_spot_shadows) {
 
 			auto data = begin_draw_light_shadows();
+			update_shadow_atlas();
 
 			if (enable_point_shadows)
 				draw_point_shadow(data);
@@ -1109,20 +1723,20 @@ void Renderer::draw()
 
 	set_uniforms();
 
-	glUseProgram(*m_shader);
-
 	if (do_shadow_mapping) {
 		// bind shadow map texture
 		glBindTextureUnit(32, *m_shadowmap_depth_to);
-		glBindTextureUnit(36, *m_spot_shadow_depth_to);
-		glBindTextureUnit(37, *m_point_shadow_depth_to);
+		glBindTextureUnit(36, *m_shadow_atlas_depth_to);
 	}
 
 	int64_t num_point_lights = 0;
 	int64_t num_spot_lights = 0;
 	int64_t num_drawcalls = 0;
 
-	auto render_mesh_by_index = [this, &num_point_lights, &num_spot_lights, &num_drawcalls](const ModelMeshIdx& idx, const zcm::vec3& bbox_color) {
+	// world space size of one pixel at unit distance from camera
+	const float pixel_world_scale = 2.0f * zcm::tan(m_scene->main_camera.state.fov * 0.5f) / m_backbuffer_height;
+
+	auto render_mesh_by_index = [this, pixel_world_scale, &num_point_lights, &num_spot_lights, &num_drawcalls](const ModelMeshIdx& idx, uint32_t shader, const zcm::vec3& bbox_color) {
 		const MeshTransform& transform = m_transform_cache[idx.transform_idx];
 		if(m_scene->main_camera.frustum.bbox_culled(transform.transformed_bbox))
 			return;
@@ -1131,25 +1745,47 @@ void Renderer::draw()
 		const model::Mesh& submesh = m_scene->submeshes[shaded_mesh.mesh];
 		const Material& material   = m_scene->materials[shaded_mesh.material];
 
-		unif::m4(*m_shader, "model", transform.mat);
-		unif::m3(*m_shader, "normal_matrix", zcm::transpose(zcm::mat3{transform.inv_mat}));
-
-		num_point_lights += process_point_lights<MaxLights>(m_scene->point_lights, m_scene->main_camera.frustum, transform.transformed_bbox, *m_shader);
-		num_spot_lights += process_spot_lights<MaxLights>(m_scene->spot_lights, m_scene->main_camera.frustum, transform.transformed_bbox, *m_shader);
+		// texture detail needed at the closest point of mesh, for mip streaming
+		const auto& camera_pos = m_scene->main_camera.state.position;
+		const float dist = zcm::length(camera_pos - transform.transformed_bbox.closest_point(camera_pos));
+		const float scale = zcm::max(zcm::length(zcm::vec3{transform.mat[0].xyz}),
+		                             zcm::max(zcm::length(zcm::vec3{transform.mat[1].xyz}),
+		                                      zcm::length(zcm::vec3{transform.mat[2].xyz})));
+		if (scale > 0.0f)
+			material.request_texture_detail(submesh.uv_density / scale * dist * pixel_world_scale);
+
+		// explicit locations, SPIR-V programs can't look up uniforms by name
+		unif::m4(shader, 5, transform.mat); // model
+		unif::m3(shader, 6, zcm::transpose(zcm::mat3{transform.inv_mat})); // normal_matrix
+
+		num_point_lights += process_point_lights<MaxLights>(m_scene->point_lights, m_scene->main_camera.frustum, transform.transformed_bbox, shader);
+		num_spot_lights += process_spot_lights<MaxLights>(m_scene->spot_lights, m_scene->main_camera.frustum, transform.transformed_bbox, shader);
 		++num_drawcalls;
-		render_generic(submesh, material, *m_shader);
+		render_generic(submesh, material, shader);
 
 		if(draw_mesh_bboxes)
 			dd::aabb(transform.transformed_bbox.min(), transform.transformed_bbox.max(), bbox_color);
 	};
 
+	const uint32_t shadow_variant = shadow_flags() << VARIANT_SHADOWS_SHIFT;
+	auto render_meshes = [this, shadow_variant, &render_mesh_by_index](const std::vector<ModelMeshIdx>& meshes, const zcm::vec3& bbox_color) {
+		uint32_t variant = ~0u;
+		uint32_t shader = 0;
+		for(const auto& idx : meshes) {
+			if(idx.variant != variant) {
+				variant = idx.variant;
+				shader = generic_program(variant | shadow_variant);
+				glUseProgram(shader);
+			}
+			render_mesh_by_index(idx, shader, bbox_color);
+		}
+	};
+
 	{
 		RC_DEBUG_GROUP("opaque meshes");
 		TracyGpuZoneC("draw_opaque", 0xaaaaaa);
 		ZoneScopedN("draw_opaque");
-		for(const auto& idx : m_opaque_meshes) {
-			render_mesh_by_index(idx, dd::colors::White);
-		}
+		render_meshes(m_opaque_meshes, dd::colors::White);
 	}
 
 
@@ -1163,10 +1799,7 @@ void Renderer::draw()
 		RC_DEBUG_GROUP("masked meshes");
 		TracyGpuZoneC("draw_masked", 0xaa4444);
 		ZoneScopedN("draw_masked");
-		for(const auto& idx : m_masked_meshes) {
-			render_mesh_by_index(idx, dd::colors::Red);
-
-		}
+		render_meshes(m_masked_meshes, dd::colors::Red);
 	}
 
 	if(MSAASampleCount > 1) {
@@ -1184,6 +1817,9 @@ void Renderer::draw()
 		frustum.draw_debug();
 	}
 
+	// following passes rely on sampling state of their own textures
+	Texture::Samplers::unbind(0, RC_FRAGMENT_SHADER_TEXTURE_BINDING_EMISSION + 1);
+
 	glEnable(GL_CULL_FACE);
 	draw_skybox();
 
@@ -1324,9 +1960,114 @@ void Renderer::draw_gui(Renderer::RenderParams& params)
 	ImGui::SameLine();
 	ImGui::Checkbox("Spot", &enable_spot_shadows);
 	ImGui::Checkbox("Shadow caching", &enable_shadow_caching);
+	ImGui::SliderFloat("Shadow distance", &shadow_distance, 10.0f, 500.0f);
+	ImGui::SliderFloat("Cascade split lambda", &cascade_split_lambda, 0.0f, 1.0f);
+	ImGui::SliderInt("Cascade update interval", &cascade_update_interval, 1, 16);
+	if (ImGui::TreeNode("Cascades")) {
+		for (size_t i = 0; i < RC_SHADOW_CASCADES; ++i) {
+			const auto& cascade = m_cascades[i];
+			ImGui::Text("#%d: up to %.1f m, %d casters, updated %d frames ago",
+			            int(i), cascade.split_far,
+			            int(cascade.opaque_casters.size() + cascade.masked_casters.size()),
+			            int(m_frame_number - cascade.last_update_frame));
+		}
+		ImGui::TreePop();
+	}
+	ImGui::SliderInt("Point shadow face budget", &shadow_face_budget, 1, MaxLights * 6);
+	if (ImGui::TreeNode("shadow_queue", "Pending point shadow updates (%d)", (int)m_shadow_update_queue.size())) {
+		for (const auto& request : m_shadow_update_queue) {
+			const auto& state = m_point_shadow_state[request.light_index];
+			ImGui::Text("light #%u: faces %d%d%d%d%d%d, priority %.2f, age %d frames",
+			            request.light_index,
+			            (request.faces >> 0) & 1, (request.faces >> 1) & 1, (request.faces >> 2) & 1,
+			            (request.faces >> 3) & 1, (request.faces >> 4) & 1, (request.faces >> 5) & 1,
+			            request.priority,
+			            state.last_update_frame ? int(m_frame_number - state.last_update_frame) : -1);
+		}
+		ImGui::TreePop();
+	}
+	if (ImGui::TreeNode("shadow_atlas", "Shadow atlas (%d%% used)",
+	                    int(rc::math::percent(m_shadow_atlas.used_area(), uint64_t(ShadowAtlasSize) * ShadowAtlasSize)))) {
+		const float canvas_size = 16 * ImGui::GetFontSize();
+		const float scale = canvas_size / ShadowAtlasSize;
+		const ImVec2 origin = ImGui::GetCursorScreenPos();
+		auto draw_list = ImGui::GetWindowDrawList();
+		draw_list->AddRectFilled(origin, ImVec2(origin.x + canvas_size, origin.y + canvas_size), IM_COL32(20, 20, 20, 255));
+
+		auto draw_region = [&](const ShadowAtlas::Region& region, ImU32 color, char kind, int index) {
+			if (!region.valid())
+				return;
+			// atlas origin is bottom-left
+			const ImVec2 min{origin.x + region.x * scale,
+			                 origin.y + (ShadowAtlasSize - region.y - region.size) * scale};
+			const ImVec2 max{min.x + region.size * scale, min.y + region.size * scale};
+			draw_list->AddRectFilled(min, max, color);
+			draw_list->AddRect(min, max, IM_COL32(0, 0, 0, 255));
+			char label[8];
+			snprintf(label, std::size(label), "%c%d", kind, index);
+			draw_list->AddText(ImVec2(min.x + 2, min.y + 1), IM_COL32(255, 255, 255, 255), label);
+		};
+
+		for (int i = 0; i < MaxLights; ++i) {
+			for (const auto& region : m_point_shadow_state[i].regions)
+				draw_region(region, IM_COL32(200, 120, 40, 200), 'P', i);
+			draw_region(m_spot_shadow_state[i].region, IM_COL32(40, 140, 200, 200), 'S', i);
+		}
+		ImGui::Dummy(ImVec2(canvas_size, canvas_size));
+		ImGui::TreePop();
+	}
 	ImGui::PopStyleVar();
 	ImGui::Spacing();
 
+	{
+		const auto stats = Texture::Streamer::stats();
+		int budget_mb = static_cast<int>(Texture::Streamer::upload_budget() / (1024 * 1024));
+		if (ImGui::SliderInt("Texture upload budget, MB/frame", &budget_mb, 1, 256)) {
+			Texture::Streamer::set_upload_budget(size_t(budget_mb) * 1024 * 1024);
+		}
+		ImGui::Text("Texture streaming: %u decoding, %u uploading, %u in flight",
+		            stats.pending_decode, stats.pending_upload, stats.in_flight);
+		ImGui::Text("Uploaded: %.1f MB/s, %.1f MB total, staging %.1f / %.1f MB",
+		            stats.upload_rate / (1024.0f * 1024.0f),
+		            stats.uploaded_bytes / (1024.0 * 1024.0),
+		            stats.staging_used / (1024.0 * 1024.0),
+		            stats.staging_size / (1024.0 * 1024.0));
+
+		int vram_budget_mb = static_cast<int>(Texture::Streamer::vram_budget() / (1024 * 1024));
+		if (ImGui::SliderInt("Streamed texture budget, MB", &vram_budget_mb, 32, 4096)) {
+			Texture::Streamer::set_vram_budget(size_t(vram_budget_mb) * 1024 * 1024);
+		}
+		ImGui::Text("Streamed textures: %u, resident %.1f MB, requested %.1f MB",
+		            stats.streamed_textures,
+		            stats.resident_bytes / (1024.0 * 1024.0),
+		            stats.requested_bytes / (1024.0 * 1024.0));
+
+		const auto cache = Texture::Cache::stats();
+		int cache_budget_mb = static_cast<int>(Texture::Cache::budget() / (1024 * 1024));
+		if (ImGui::SliderInt("Texture cache budget, MB", &cache_budget_mb, 64, 8192)) {
+			Texture::Cache::set_budget(size_t(cache_budget_mb) * 1024 * 1024);
+		}
+		ImGui::Text("Texture cache: %u entries (%u in use), %.1f MB",
+		            cache.entries, cache.pinned, cache.bytes / (1024.0 * 1024.0));
+		ImGui::Text("Hits: %llu, misses: %llu, deduped: %llu, evictions: %llu",
+		            (unsigned long long)cache.hits, (unsigned long long)cache.misses,
+		            (unsigned long long)cache.dedupes, (unsigned long long)cache.evictions);
+
+		int anisotropy = static_cast<int>(Texture::Samplers::anisotropy());
+		if (ImGui::SliderInt("Max anisotropy", &anisotropy, 1, static_cast<int>(Texture::Samplers::max_anisotropy()))) {
+			Texture::Samplers::set_anisotropy(anisotropy);
+		}
+		float mip_bias = Texture::Samplers::mip_bias();
+		if (ImGui::SliderFloat("Texture mip bias", &mip_bias, -2.0f, 2.0f)) {
+			Texture::Samplers::set_mip_bias(mip_bias);
+		}
+		ImGui::Text("Samplers: %u", Texture::Samplers::count());
+	}
+	ImGui::Checkbox("Specialized shader variants", &use_shader_variants);
+	ImGui::SameLine();
+	ImGui::Text("(%u variants)", static_cast<unsigned>(m_generic_variants.size()));
+	ImGui::Spacing();
+
 
 	ImGui::Checkbox("Show submesh bboxes", &draw_mesh_bboxes);
 	ImGui::SameLine();
@@ -1339,6 +2080,8 @@ void Renderer::draw_gui(Renderer::RenderParams& params)
 	ImGui::Checkbox("Update diffuse", &update_diffuse);
 	ImGui::SameLine();
 	ImGui::Checkbox("Update specular", &update_specular);
+	ImGui::SliderFloat("Sky update threshold, deg", &sky_update_threshold_deg, 0.01f, 5.0f);
+	ImGui::SliderFloat("Sky update budget, ms", &sky_update_budget_ms, 0.05f, 4.0f);
 
 	const char* labels_cube[] = {"Sky", "Diffuse Irradiance", "Specular Reflectance"};
 	ImGui::Combo("Cubemap", &selected_cubemap, labels_cube, std::size(labels_cube));
@@ -1360,8 +2103,46 @@ void Renderer::save_hdr_backbuffer(std::string_view path)
 }
 
 
-static size_t calc_directional_hash(const DirectionalLight& l) {
-	return zcm::hash(l.direction) ^ zcm::hash(l.color_intensity) ^ zcm::hash(l.ambient_intensity);
+static size_t calc_sky_hash(const DirectionalLight& l) {
+	return zcm::hash(l.color_intensity) ^ zcm::hash(l.ambient_intensity);
+}
+
+// Runs outside of frame timer query, since sky updater measures its own steps with one.
+void Renderer::update_sky()
+{
+	ZoneScoped;
+	RC_DEBUG_GROUP("update sky");
+	const auto& light = m_scene->directional_light;
+	const auto light_dir = light.direction * zcm::vec3{0.0f, 0.0f, 1.0f};
+	const auto sky_hash = calc_sky_hash(light) ^ show_ground << 1 ^ update_diffuse << 2 ^ update_specular << 3;
+	const bool sky_changed = sky_hash != m_sky_params_hash
+	                         || zcm::dot(light_dir, m_sky_light_dir) < zcm::cos(zcm::radians(sky_update_threshold_deg));
+	// update in progress is finished first, so sun moving every frame can't starve it
+	if (sky_changed && !m_sky_updater.busy()) {
+		m_sky_params_hash = sky_hash;
+		m_sky_light_dir = light_dir;
+		m_sky_update_specular = update_specular;
+
+		AtmosphereParams params;
+		params.light_dir = light_dir;
+		params.light_color = light.color_intensity.xyz * light.ambient_intensity;
+		params.draw_planet = show_ground;
+		m_sky_updater.start(params, 64, update_diffuse, update_specular);
+	}
+
+	// until there is any sky, it is baked in one go
+	const float budget_ms = m_sky_baked ? sky_update_budget_ms : std::numeric_limits<float>::infinity();
+	if (m_sky_updater.update(budget_ms, *m_irradiance_sh)) {
+		m_sky_baked = true;
+		std::swap(m_scene->cubemap, m_sky_updater.sky);
+		if (m_sky_update_specular)
+			std::swap(m_scene->cubemap_specular_environment, m_sky_updater.specular_environment);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT|GL_TEXTURE_FETCH_BARRIER_BIT);
+	} else if (m_environment_revision != m_scene->environment_revision) {
+		// skybox loaded from file replaced atmosphere
+		Cubemap::project_irradiance_sh(m_scene->cubemap, *m_irradiance_sh);
+	}
+	m_environment_revision = m_scene->environment_revision;
 }
 
 void Renderer::draw_skybox()
@@ -1373,19 +2154,6 @@ void Renderer::draw_skybox()
 	auto projection = make_projection(m_scene->main_camera.state);
 
 	//Cubemap::draw_atmosphere(view, projection, true);
-	auto dlh = calc_directional_hash(m_scene->directional_light) ^ show_ground << 1 ^ update_diffuse << 2 ^ update_specular << 3;
-	if (dlh != m_directional_light_hash){
-		m_directional_light_hash = dlh;
-
-		Cubemap::draw_atmosphere_to_cube(m_scene->cubemap, 64, show_ground);
-		if (update_diffuse)
-			m_scene->cubemap_diffuse_irradiance = Cubemap::integrate_diffuse_irradiance(m_scene->cubemap);
-		if (update_specular)
-			m_scene->cubemap_specular_environment = Cubemap::convolve_specular(m_scene->cubemap);
-
-		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT|GL_TEXTURE_FETCH_BARRIER_BIT);
-	}
-
 	int level = selected_cubemap == 2 ? cubemap_mip_level : 0;
 
 	switch (selected_cubemap) {
@@ -1393,7 +2161,7 @@ void Renderer::draw_skybox()
 		Cubemap::draw(m_scene->cubemap, view, projection, level);
 		break;
 	case 1:
-		Cubemap::draw(m_scene->cubemap_diffuse_irradiance, view, projection, level);
+		Cubemap::draw_irradiance_sh(*m_irradiance_sh, view, projection);
 		break;
 	case 2:
 		Cubemap::draw(m_scene->cubemap_specular_environment, view, projection, level);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <rendercat/cubemap.hpp>
 #include <rendercat/shader_set.hpp>
 #include <rendercat/util/gl_perfquery.hpp>
 #include <rendercat/util/gl_unique_handle.hpp>
@@ -8,6 +9,8 @@
 #include <zcm/mat3.hpp>
 #include <zcm/mat4.hpp>
 #include <rendercat/core/bbox.hpp>
+#include <rendercat/core/shadow_atlas.hpp>
+#include <unordered_map>
 #include <vector>
 
 namespace rc {
@@ -38,15 +41,17 @@ class Renderer
 
 	rc::texture_handle     m_brdf_lut_to;
 	rc::texture_handle     m_turbo_colormap_to;
+	rc::buffer_handle      m_irradiance_sh; // see Cubemap::project_irradiance_sh
 
-	rc::framebuffer_handle m_shadowmap_fbo;
 	rc::texture_handle     m_shadowmap_depth_to;
+	rc::texture_handle     m_static_shadowmap_depth_to;
 
-	rc::framebuffer_handle m_spot_shadow_fbo;
-	rc::texture_handle     m_spot_shadow_depth_to;
+	rc::framebuffer_handle m_shadow_atlas_fbo;
+	rc::texture_handle     m_shadow_atlas_depth_to;
 
-	rc::framebuffer_handle m_point_shadow_fbo;
-	rc::texture_handle     m_point_shadow_depth_to;
+	// depth of static casters only, copied into main atlas before dynamic casters are drawn
+	rc::framebuffer_handle m_static_shadow_atlas_fbo;
+	rc::texture_handle     m_static_shadow_atlas_depth_to;
 
 	rc::framebuffer_handle m_backbuffer_fbo;
 	rc::texture_handle     m_backbuffer_color_to;
@@ -66,6 +71,7 @@ class Renderer
 		zcm::mat4 mat;
 		zcm::mat4 inv_mat;
 		bbox3 transformed_bbox;
+		bool is_static;
 	};
 
 	std::vector<MeshTransform> m_transform_cache;
@@ -75,16 +81,38 @@ class Renderer
 		uint32_t model_idx;
 		uint32_t submesh_idx;
 		uint32_t transform_idx;
+		uint32_t variant = 0; // generic program permutation, draws are sorted by it
 	};
 	std::vector<ModelMeshIdx> m_opaque_meshes;
 	std::vector<ModelMeshIdx> m_masked_meshes;
 	std::vector<ModelMeshIdx> m_blended_meshes;
 
 	static constexpr size_t RC_MAX_LIGHTS = 16;
+	static constexpr size_t RC_SHADOW_CASCADES = 4;
+	static_assert(RC_SHADOW_CASCADES == 4, "cascade splits are packed into single vec4");
+
+	struct ShadowCascade {
+		zcm::mat4 proj_view;     // matrix the cascade was last rendered with
+		zcm::vec3 center;        // light-space center of cascade box
+		float     radius = 0.0f;
+		float     split_far = 0.0f;
+		size_t    view_hash = 0;
+		size_t    static_hash = 0;
+		size_t    dynamic_hash = 0;
+		uint64_t  last_update_frame = 0;
+		std::vector<ModelMeshIdx> opaque_casters;
+		std::vector<ModelMeshIdx> masked_casters;
+	};
+
+	ShadowCascade m_cascades[RC_SHADOW_CASCADES];
+	rc::framebuffer_handle m_cascade_fbos[RC_SHADOW_CASCADES];
+	rc::framebuffer_handle m_static_cascade_fbos[RC_SHADOW_CASCADES];
+	std::vector<bbox3> m_light_space_bboxes; // directional light space bboxes, indexed same as m_transform_cache
 
 	struct alignas(256) PerFrameData {
 		zcm::mat4 proj_view;
-		zcm::mat4 light_proj_view;
+		zcm::mat4 cascade_proj_view[RC_SHADOW_CASCADES];
+		zcm::vec4 cascade_splits; // view-space far distance of each cascade
 		zcm::vec3 camera_forward;
 		float     znear;
 		zcm::vec3 viewPos;
@@ -120,45 +148,89 @@ class Renderer
 
 		PointLight point_lights[RC_MAX_LIGHTS];
 		SpotLight spot_lights[RC_MAX_LIGHTS];
+		zcm::vec4 irradiance_sh[9]; // .rgb - diffuse irradiance, copied from m_irradiance_sh on GPU
 		int32_t num_msaa_samples;
 	};
 
 	struct alignas(256) LightPerframeData {
 		zcm::mat4 spot_light_matrices[RC_MAX_LIGHTS];
+		zcm::mat4 point_light_matrices[RC_MAX_LIGHTS * 6];
+		zcm::vec4 spot_shadow_rects[RC_MAX_LIGHTS];      // .xy - atlas offset, .zw - atlas scale
+		zcm::vec4 point_shadow_rects[RC_MAX_LIGHTS * 6];
 		int num_visible_point_lights;
 		int num_visible_spot_lights;
 		float point_near_plane;
 	};
 
-	size_t m_point_light_hashes[RC_MAX_LIGHTS] = {};
-	size_t m_spot_light_hashes[RC_MAX_LIGHTS] = {};
+	struct PointShadowState {
+		ShadowAtlas::Region regions[6];
+		size_t   static_face_hashes[6] = {};
+		size_t   dynamic_face_hashes[6] = {};
+		uint64_t last_update_frame = 0;
+		uint8_t  stale_faces = 0;        // bitmask of faces waiting to be re-rendered
+		uint8_t  stale_static_faces = 0; // subset of stale faces that need static layer re-rendered too
+	};
 
-	rc::framebuffer_handle m_spot_layer_fbos[RC_MAX_LIGHTS];
-	rc::framebuffer_handle m_point_layer_fbos[RC_MAX_LIGHTS * 6];
+	struct ShadowUpdateRequest {
+		uint32_t light_index;
+		uint8_t  faces;
+		float    priority;
+	};
+
+	struct SpotShadowState {
+		ShadowAtlas::Region region;
+		size_t static_hash = 0;
+		size_t dynamic_hash = 0;
+	};
+
+	ShadowAtlas m_shadow_atlas{ShadowAtlasSize, ShadowTierMin};
+	PointShadowState m_point_shadow_state[RC_MAX_LIGHTS];
+	SpotShadowState  m_spot_shadow_state[RC_MAX_LIGHTS];
+	std::vector<ShadowUpdateRequest> m_shadow_update_queue;
 
 	unif::buf<PerFrameData, 3> m_per_frame;
 	unif::buf<LightPerframeData, 3> m_light_per_frame;
 
-	zcm::mat4 m_shadow_matrix;
-
-	size_t m_directional_light_hash = 0;
+	// Procedural sky is rebaked incrementally when sun turns by more than threshold, or
+	// when any other sky parameter changes.
+	SkyUpdater m_sky_updater;
+	zcm::vec3  m_sky_light_dir{0.0f};
+	size_t     m_sky_params_hash = 0;
+	bool       m_sky_baked = false;
+	bool       m_sky_update_specular = false;
+	uint32_t   m_environment_revision = 0;
+
+	// Generic program permutations keyed by material features, mesh attributes and shadow
+	// flags. Compiled on first use, until then draws fall back to the unspecialized m_shader.
+	std::unordered_map<uint32_t, uint32_t*> m_generic_variants;
+	uint32_t generic_program(uint32_t variant);
+	uint32_t shadow_flags() const;
 
 	void set_uniforms();
 
 	void draw_directional_shadow();
 
+	void update_shadow_atlas();
+	void clear_shadow_atlas_region(const ShadowAtlas::Region& region);
+
 	LightPerframeData* begin_draw_light_shadows();
 	void draw_point_shadow(LightPerframeData* light_data);
+	void draw_point_shadow_faces(uint32_t scene_index, uint8_t faces, float near);
 	void draw_spot_shadow(LightPerframeData* light_data);
+	void update_sky();
 	void draw_skybox();
 	void end_draw_light_shadows();
 
 	void bloom_pass();
 
 public:
-	static const unsigned int PointShadowWidth = 512;
-	static const unsigned int PointShadowHeight = 512;
+	// point and spot shadows share single depth atlas, each light gets a tier
+	// between ShadowTierMin and ShadowTierMax depending on its size on screen
+	static const unsigned int ShadowAtlasSize = 4096;
+	static const unsigned int ShadowTierMax = 1024;
+	static const unsigned int ShadowTierMin = 128;
 
+	// size of each directional shadow cascade
 	static const unsigned int ShadowMapWidth = 2048;
 	static const unsigned int ShadowMapHeight = 2048;
 
@@ -178,16 +250,23 @@ public:
 	bool draw_mesh_bboxes = false;
 	bool draw_model_bboxes = false;
 	bool do_shadow_mapping = true;
+	bool use_shader_variants = true;
 	bool enable_directional_shadows = true;
 	bool enable_point_shadows = true;
 	bool enable_spot_shadows = true;
 	bool enable_shadow_caching = true;
+	float shadow_distance = 80.0f;
+	float cascade_split_lambda = 0.75f;
+	int  cascade_update_interval = 4; // distant cascades follow camera only every N frames
+	int  shadow_face_budget = 12; // max point shadow faces re-rendered per frame
 	bool window_shown = true;
 
 	bool show_ground = true;
 	bool update_diffuse = true;
 	bool update_specular = true;
 	bool indirect_only = false;
+	float sky_update_threshold_deg = 0.25f;
+	float sky_update_budget_ms = 0.5f; // GPU time per frame spent on rebaking sky
 
 	static constexpr int MaxLights = RC_MAX_LIGHTS;
 	static constexpr unsigned NumMipsBloomDownscale = 3u;
@@ -1,7 +1,8 @@
+#include <algorithm>
 #include <filesystem>
 #include <rendercat/scene.hpp>
-#include <rendercat/texture_cache.hpp>
 #include <rendercat/util/color_temperature.hpp>
+#include <rendercat/util/task_graph.hpp>
 #include <imgui.h>
 #include <imgui/misc/cpp/imgui_stdlib.h>
 #include <fmt/core.h>
@@ -18,19 +19,27 @@ using namespace rc;
 Scene::~Scene()
 {
 	Material::delete_default_diffuse();
+	Material::release_storage();
 }
 
-void Scene::init()
+static std::filesystem::path model_file_path(const std::filesystem::path& path)
+{
+	if (path.is_absolute())
+		return path;
+	return std::filesystem::path{rc::path::asset::model} / path;
+}
+
+uint32_t Scene::init(TaskGraph& startup)
 {
 	ZoneScoped;
+	auto default_material = startup.add("default material", TaskGraph::Thread::Main, [this]
 	{
-		ZoneScopedN("load default material");
 		Material::set_default_diffuse("assets/materials/missing.tga");
 		materials.emplace_back(Material::create_default_material());
-	}
+	});
 
 	current_cubemap = "assets/cubemaps/field_evening_late";
-	//load_skybox_cubemap(current_cubemap);
+	//load_skybox(current_cubemap);
 
 	main_camera.state.position = {0.0f, 1.7f, 1};
 	//main_camera.state.orientation = {0, 0, 1, 0};
@@ -159,22 +168,51 @@ void Scene::init()
 	spot.set_flux(600);
 	spot_lights.push_back(spot);
 
-	load_model_gltf("sponza/sponzahr.gltf");
-	load_model_gltf("2b_v6/2b_feather.gltf");
+	struct StartupModel
+	{
+		const char* file;
+		bool is_static;
+	};
+	const StartupModel startup_models[] = {
+		{"sponza/sponzahr.gltf", true},
+		{"2b_v6/2b_feather.gltf", false},
+	};
+
+	// files are parsed on workers in parallel, models are added in listed order,
+	// each after the default material which takes index 0
+	auto previous = default_material;
+	for (const auto& startup_model : startup_models) {
+		auto file = model_file_path(startup_model.file);
+		auto name = file.filename().u8string();
+		auto staged = std::make_shared<std::shared_ptr<model::staged_file>>();
 
-	Texture::Cache::clear();
+		auto stage = startup.add(fmt::format("stage {}", name), TaskGraph::Thread::Worker, [staged, file]
+		{
+			*staged = model::stage_gltf_file(file);
+		});
+		previous = startup.add(fmt::format("upload {}", name), TaskGraph::Thread::Main, [this, staged, file, is_static = startup_model.is_static]
+		{
+			if (auto model = add_model_gltf(file, **staged))
+				model->is_static = is_static;
+			staged->reset();
+		}, {previous, stage});
+	}
+	return previous;
 }
 
 
 Model* Scene::load_model_gltf(const std::filesystem::path& path)
 {
 	ZoneScoped;
-	model::data data;
-	auto file = path;
-	if (!file.is_absolute())
-		file = std::filesystem::path{rc::path::asset::model} / file;
+	auto file = model_file_path(path);
+	return add_model_gltf(file, *model::stage_gltf_file(file));
+}
 
-	if(model::load_gltf_file(data, file)) {
+Model* Scene::add_model_gltf(const std::filesystem::path& file, model::staged_file& staged)
+{
+	ZoneScoped;
+	model::data data;
+	if(model::upload_gltf_file(data, staged)) {
 		auto base_material_offset = materials.size();
 
 		for(size_t i = 0; i < data.materials.size(); ++i) {
@@ -860,11 +898,6 @@ static void show_material_ui(rc::Material& material)
 
 	auto material_data = material.data();
 	if (material_data) {
-		if (ImGui::Button("Unmap")) {
-			material.unmap();
-			return;
-		}
-
 		ImGui::TextUnformatted("Diffuse color");
 		bool changed = false;
 		changed |= ImGui::ColorEdit4("##matdiffcolor", zcm::value_ptr(material_data->base_color_factor),
@@ -905,10 +938,6 @@ static void show_material_ui(rc::Material& material)
 
 		if (changed)
 			material.flush();
-	} else {
-		if (ImGui::Button("Map")) {
-			material.map();
-		}
 	}
 }
 
@@ -928,6 +957,18 @@ static void show_mesh_ui(rc::model::Mesh& submesh, rc::Material& material)
 			    submesh.numverts_unique,
 			    rc::math::percent(submesh.numverts_unique, submesh.numverts));
 
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted("Depth stream unique:");
+		ImGui::TableNextColumn();
+		if (submesh.depth_position.valid()) {
+			ImGui::Text("%u pos / %u pos+uv",
+			            submesh.depth_position.numverts_unique,
+			            submesh.depth_position_uv.numverts_unique);
+		} else {
+			ImGui::TextUnformatted("None");
+		}
+
 		ImGui::TableNextRow();
 		ImGui::TableNextColumn();
 		ImGui::TextUnformatted("Index Range:");
@@ -978,6 +1019,13 @@ static void show_mesh_ui(rc::model::Mesh& submesh, rc::Material& material)
 
 void Scene::update()
 {
+	// previous environment stays bound until loader is done with new one
+	if (skybox_loader.update(skybox_load_budget_ms)) {
+		cubemap = std::move(skybox_loader.sky);
+		cubemap_specular_environment = std::move(skybox_loader.specular_environment);
+		++environment_revision;
+	}
+
 	for(auto& pl : point_lights) {
 		if(pl.state & PointLight::FollowCamera) {
 			pl.set_position(main_camera.state.position);
@@ -1243,6 +1291,7 @@ void Scene::update()
 
 
 				edit_transform(model.transform, main_camera.state, &model_transform_mode);
+				ImGui::Checkbox("Static shadow caster", &model.is_static);
 
 				if(ImGui::TreeNodeEx("##submeshes", ImGuiTreeNodeFlags_CollapsingHeader, "Submeshes: %u", model.mesh_count)) {
 					for(unsigned j = 0; j < model.mesh_count; ++j) {
@@ -1271,54 +1320,50 @@ void Scene::update()
 	ImGui::End();
 }
 
-void Scene::load_skybox_equirectangular(std::string_view name)
+void Scene::load_skybox(const std::filesystem::path& path)
 {
-	ZoneScoped;
-	cubemap.load_equirectangular(name);
-	cubemap_diffuse_irradiance = Cubemap::integrate_diffuse_irradiance(cubemap);
-	cubemap_specular_environment = Cubemap::convolve_specular(cubemap);
+	current_cubemap = path.u8string();
+	skybox_loader.start(path);
 }
 
-void Scene::load_skybox_cubemap(std::string_view path)
+void Scene::scan_skyboxes()
 {
 	ZoneScoped;
-	cubemap.load_cube(path);
-	cubemap_diffuse_irradiance = Cubemap::integrate_diffuse_irradiance(cubemap);
-	cubemap_specular_environment = Cubemap::convolve_specular(cubemap);
+	m_skyboxes.clear();
+	std::error_code ec;
+	for (auto&& entry : std::filesystem::directory_iterator{rc::path::asset::cubemap, std::filesystem::directory_options::skip_permission_denied, ec}) {
+		if (entry.is_directory() || (entry.is_regular_file() && entry.path().extension() == ".hdr"))
+			m_skyboxes.push_back(entry.path());
+	}
+	std::sort(m_skyboxes.begin(), m_skyboxes.end());
+	m_skyboxes_scanned = true;
 }
 
 void Scene::skyboxes_list()
 {
-	static std::filesystem::path current = current_cubemap;
-
 	ImGui::PushItemWidth(-1.0f);
 	if (ImGui::BeginCombo("##skyboxeslist", current_cubemap.c_str())) {
-		static std::filesystem::path skyboxes_dir = rc::path::asset::cubemap;
-		for (auto&& entry : std::filesystem::directory_iterator{skyboxes_dir, std::filesystem::directory_options::skip_permission_denied}) {
-			if (entry.is_regular_file() || entry.is_directory())  {
-				auto path = entry.path();
-
-				if (path.extension() == ".hdr" || entry.is_directory()) {
-
-					bool is_selected = (path == current);
-					auto path_str = path.u8string();
-
-					if (ImGui::Selectable(path_str.c_str(), is_selected))
-						current = path;
-					if (is_selected)
-						ImGui::SetItemDefaultFocus();
-				}
-			}
-		}
-		if (current_cubemap != current) {
-			current_cubemap = current.u8string();
-			if (current.has_extension())
-				load_skybox_equirectangular(current_cubemap);
-			else
-				load_skybox_cubemap(current_cubemap);
+		if (!m_skyboxes_scanned)
+			scan_skyboxes();
+
+		std::filesystem::path selected;
+		for (const auto& path : m_skyboxes) {
+			bool is_selected = (path.u8string() == current_cubemap);
+			if (ImGui::Selectable(path.u8string().c_str(), is_selected))
+				selected = path;
+			if (is_selected)
+				ImGui::SetItemDefaultFocus();
 		}
+		ImGui::Separator();
+		if (ImGui::Selectable("rescan directory"))
+			scan_skyboxes();
+
+		if (!selected.empty() && selected.u8string() != current_cubemap)
+			load_skybox(selected);
 		ImGui::EndCombo();
 	}
+	if (skybox_loader.busy())
+		ImGui::TextUnformatted("loading...");
 	ImGui::PopItemWidth();
 }
 
@@ -21,6 +21,8 @@
 
 namespace rc {
 
+class TaskGraph;
+
 struct DirectionalLight
 {
 	/// .rgb - color, .a - intensity
@@ -109,6 +111,10 @@ struct Model
 	uint32_t mesh_count;
 	RigidTransform transform;
 	rc::bbox3 bbox;
+
+	/// Static models are expected to stay in place, so their shadows are
+	/// rendered once into cached layer, moving models are drawn on top of it.
+	bool is_static = true;
 };
 
 
@@ -129,14 +135,18 @@ struct Scene
 
 	bool  window_shown = true;
 
-	void init();
+	// Sets up lights and camera, adds loading of default material and models to
+	// startup graph. Returns task after which scene is fully loaded.
+	uint32_t init(TaskGraph& startup);
 	void update();
 
-	void load_skybox_equirectangular(std::string_view path);
-	void load_skybox_cubemap(std::string_view path);
+	// Starts loading skybox from .hdr file or directory of faces, current one stays in
+	// use until new one and its convolutions are complete.
+	void load_skybox(const std::filesystem::path& path);
 	void skyboxes_list();
 
 	Model* load_model_gltf(const std::filesystem::path& file);
+	Model* add_model_gltf(const std::filesystem::path& file, model::staged_file& staged);
 
 	rc::Camera main_camera;
 
@@ -145,8 +155,15 @@ struct Scene
 
 	std::string current_cubemap;
 	Cubemap cubemap;
-	Cubemap cubemap_diffuse_irradiance;
 	Cubemap cubemap_specular_environment;
+	uint32_t environment_revision = 0; // incremented when loaded skybox replaces cubemap
+	CubemapLoader skybox_loader;
+	float skybox_load_budget_ms = 2.0f; // GPU time per frame spent on loading skybox
+
+private:
+	void scan_skyboxes();
+	std::vector<std::filesystem::path> m_skyboxes; // cached scan of cubemap asset directory
+	bool m_skyboxes_scanned = false;
 };
 
 }
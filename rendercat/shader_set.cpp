@@ -1,17 +1,28 @@
 #include <rendercat/shader_set.hpp>
 #include <rendercat/util/gl_unique_handle.hpp>
 #include <rendercat/util/gl_debug.hpp>
+#include <rendercat/util/gl_meta.hpp>
+#include <rendercat/util/file_io.hpp>
+#include <rendercat/util/file_watcher.hpp>
+#include <rendercat/util/unique_file_handle.hpp>
 #include <fmt/format.h>
 #include <fmt/xchar.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <filesystem>
 #include <vector>
 #include <memory>
+#include <tracy/Tracy.hpp>
 
 #include <glbinding/gl45core/boolean.h>
 #include <glbinding/gl45core/types.h>
 #include <glbinding/gl45core/enum.h>
 #include <glbinding/gl45core/functions.h>
+#include <glbinding/gl45ext/enum.h>
+#include <glbinding/gl45ext/functions.h>
 
 using namespace gl45core;
 using namespace rc;
@@ -61,7 +72,8 @@ std::string load_and_process_shader(
 	const std::filesystem::path& root_dir,
 	const std::filesystem::path& filepath,
 	int depth,
-	const ShaderSet::macros_t& definitions = ShaderSet::macros_t{})
+	const ShaderSet::macros_t& definitions,
+	std::vector<std::filesystem::path>& includes)
 {
 
 	std::ifstream filestream;
@@ -103,7 +115,8 @@ std::string load_and_process_shader(
 		if (line.find("#include") != line.npos) {
 			auto path = get_include(line);
 			auto p = root_dir / path;
-			auto source = load_and_process_shader(root_dir, p, depth+1);
+			includes.push_back(p);
+			auto source = load_and_process_shader(root_dir, p, depth+1, {}, includes);
 			if (source.empty()) {
 				throw std::runtime_error(fmt::format("could not open include file [{}]\n", p.string()));
 			}
@@ -136,13 +149,69 @@ GLenum shader_type_from_filename(const std::string_view filename)
 	throw std::runtime_error("could not determine type of shader file");
 }
 
+// With KHR/ARB_parallel_shader_compile compiles and links run on driver threads,
+// and completion can be queried without stalling. Otherwise status queries block.
+bool parallel_compile_supported()
+{
+	static const bool supported = []{
+		constexpr GLuint max_threads = 0xFFFFFFFFu; // let implementation decide
+		if(rc::glmeta::extension_supported(gl::GLextension::GL_KHR_parallel_shader_compile)) {
+			gl45ext::glMaxShaderCompilerThreadsKHR(max_threads);
+			return true;
+		}
+		if(rc::glmeta::extension_supported(gl::GLextension::GL_ARB_parallel_shader_compile)) {
+			gl45ext::glMaxShaderCompilerThreadsARB(max_threads);
+			return true;
+		}
+		return false;
+	}();
+	return supported;
+}
+
+bool shader_ready(GLuint shader)
+{
+	if(!parallel_compile_supported())
+		return true;
+	GLint done = 0;
+	glGetShaderiv(shader, gl45ext::GL_COMPLETION_STATUS_KHR, &done);
+	return done;
+}
+
+bool program_ready(GLuint program)
+{
+	if(!parallel_compile_supported())
+		return true;
+	GLint done = 0;
+	glGetProgramiv(program, gl45ext::GL_COMPLETION_STATUS_KHR, &done);
+	return done;
+}
+
+bool spirv_supported()
+{
+	static const bool supported = rc::glmeta::extension_supported(gl::GLextension::GL_ARB_gl_spirv);
+	return supported;
+}
+
+struct SpecializationConstants
+{
+	std::vector<GLuint> ids;
+	std::vector<GLuint> values;
+};
+
 struct Shader
 {
 	std::filesystem::path           filepath;
 	std::filesystem::path           root_path;
-	std::filesystem::file_time_type last_write_time;
+	std::vector<std::filesystem::path> includes; // recorded by last preprocessing, including nested ones
+	std::string                     source;  // preprocessed, kept for binary cache key
 	rc::shader_handle               handle;
+	rc::shader_handle               pending; // compile in flight
+	std::vector<char>               spirv;   // offline compiled module for current source, if any
 	const ShaderSet::macros_t*      definitions = nullptr;
+	bool                            source_stale = true;
+	bool                            source_compiled = false;
+	bool                            pending_spirv = false;
+	bool                            handle_spirv = false;
 
 	explicit Shader(std::filesystem::path root_path, std::filesystem::path fpath) :
 	        filepath(std::move(fpath)),
@@ -158,48 +227,121 @@ struct Shader
 		definitions = &macros;
 	}
 
-	bool should_reload()
+	// marks source stale if it or any of its includes is in changed set
+	bool invalidate(const std::vector<std::filesystem::path>& changed)
+	{
+		auto contains = [&changed](const std::filesystem::path& p) {
+			return std::find(changed.begin(), changed.end(), p.lexically_normal()) != changed.end();
+		};
+		if(contains(filepath) || std::any_of(includes.begin(), includes.end(), contains))
+			source_stale = true;
+		return source_stale;
+	}
+
+	// re-reads and preprocesses source if it was invalidated
+	bool update_source() try
 	{
-		auto file_time = std::filesystem::last_write_time(filepath);
-		if(likely(file_time == last_write_time)) {
+		if(!source_stale)
 			return false;
-		}
-		last_write_time = file_time;
+		source_stale = false;
+
+		static const auto empty_defs = ShaderSet::macros_t{};
+		includes.clear();
+		source = load_and_process_shader(root_path / "include", filepath, 0, definitions ? *definitions : empty_defs, includes);
+		source_compiled = false;
 		return true;
+
+	} catch(const std::exception& e) {
+		fmt::print(stderr, "[shader]  reload failed  [{}]: {}\n", filepath.string(), e.what());
+		std::fflush(stderr);
+		return false;
 	}
 
-	bool reload() try
+	// Reads SPIR-V module if it was built after source and all of its includes were last modified.
+	bool load_spirv(const std::filesystem::path& module_path)
 	{
-		if(!should_reload())
+		spirv.clear();
+		std::error_code ec;
+		const auto module_time = std::filesystem::last_write_time(module_path, ec);
+		if(ec)
 			return false;
 
+		auto older_than_module = [&module_time](const std::filesystem::path& p) {
+			std::error_code ec;
+			auto t = std::filesystem::last_write_time(p, ec);
+			return !ec && t <= module_time;
+		};
+		if(!older_than_module(filepath) || !std::all_of(includes.begin(), includes.end(), older_than_module))
+			return false;
+
+		rc::file_handle file(std::fopen(module_path.u8string().data(), "rb"));
+		if(!file)
+			return false;
+		std::fseek(*file, 0, SEEK_END);
+		const long size = std::ftell(*file);
+		std::fseek(*file, 0, SEEK_SET);
+		if(size <= 0 || size % 4 != 0)
+			return false;
+		spirv.resize(size);
+		if(std::fread(spirv.data(), 1, spirv.size(), *file) != spirv.size())
+			spirv.clear();
+		return !spirv.empty();
+	}
+
+	// issues compilation of current source, finish_compile() collects the result
+	void start_compile(const SpecializationConstants& constants) try
+	{
+		const bool use_spirv = !spirv.empty();
+		// program can't mix SPIR-V and GLSL shaders
+		if(source_compiled && (pending ? pending_spirv : handle_spirv) == use_spirv)
+			return;
+		source_compiled = true;
+
 		auto shader_type = shader_type_from_filename(filepath.string());
-		static const auto empty_defs = ShaderSet::macros_t{};
-		const auto shader_source = load_and_process_shader(root_path / "include", filepath, 0, definitions ? *definitions : empty_defs);
-		const auto shader_source_ptr = shader_source.data();
 
-		rc::shader_handle new_handle(glCreateShader(shader_type));
-		glShaderSource(*new_handle, 1, &shader_source_ptr, nullptr);
-		glCompileShader(*new_handle);
+		pending = rc::shader_handle(glCreateShader(shader_type));
+		pending_spirv = use_spirv;
+		if(use_spirv) {
+			glShaderBinary(1, pending.get(), gl45ext::GL_SHADER_BINARY_FORMAT_SPIR_V_ARB, spirv.data(), static_cast<GLsizei>(spirv.size()));
+			gl45ext::glSpecializeShaderARB(*pending, "main",
+			                               static_cast<GLuint>(constants.ids.size()),
+			                               constants.ids.data(),
+			                               constants.values.data());
+		} else {
+			const auto shader_source_ptr = source.data();
+			glShaderSource(*pending, 1, &shader_source_ptr, nullptr);
+			glCompileShader(*pending);
+		}
+
+	} catch(const std::exception& e) {
+		fmt::print(stderr, "[shader]  reload failed  [{}]: {}\n", filepath.string(), e.what());
+		std::fflush(stderr);
+	}
+
+	bool compile_ready() const
+	{
+		return !pending || shader_ready(*pending);
+	}
+
+	bool finish_compile()
+	{
+		if(!pending)
+			return valid();
+
+		rc::shader_handle new_handle = std::move(pending);
 		GLint success = 0;
 		glGetShaderiv(*new_handle, GL_COMPILE_STATUS, &success);
-		if(success && new_handle) {
+		if(success) {
 			handle = std::move(new_handle);
-			fmt::print("[shader]  reload success [{}]\n", filepath.string());
+			handle_spirv = pending_spirv;
+			fmt::print("[shader]  reload success [{}]{}\n", filepath.string(), handle_spirv ? " (SPIR-V)" : "");
 			std::fflush(stdout);
 			return true;
 		}
-		if(new_handle) {
-			char error_log[4096];
-			int size = 0;
-			glGetShaderInfoLog(*new_handle, std::size(error_log), &size, error_log);
-			fmt::print(stderr, "[shader]  compile error [{}]:\n{}\n", filepath.string(), error_log);
-			std::fflush(stderr);
-		}
-		return false;
-
-	} catch(const std::exception& e) {
-		fmt::print(stderr, "[shader]  reload failed  [{}]: {}\n", filepath.string(), e.what());
+		char error_log[4096];
+		int size = 0;
+		glGetShaderInfoLog(*new_handle, std::size(error_log), &size, error_log);
+		fmt::print(stderr, "[shader]  compile error [{}]:\n{}\n", filepath.string(), error_log);
 		std::fflush(stderr);
 		return false;
 	}
@@ -214,24 +356,182 @@ struct Shader
 	}
 };
 
+// On-disk cache of linked program binaries. Entries are keyed by preprocessed
+// sources and driver identification, so driver updates simply miss the cache.
+namespace binary_cache {
+
+constexpr char magic[4] = {'R','C','P','B'};
+
+struct Header
+{
+	char     magic[4];
+	uint32_t format;
+	uint64_t key;
+	uint64_t size;
+};
+
+void hash_append(uint64_t& h, std::string_view str) noexcept
+{
+	// FNV-1a, terminated so that concatenations of different strings don't collide
+	for (auto c : str) {
+		h ^= static_cast<uint8_t>(c);
+		h *= 1099511628211ull;
+	}
+	h ^= 0xffu;
+	h *= 1099511628211ull;
+}
+
+const std::vector<GLint>& supported_formats()
+{
+	static const std::vector<GLint> formats = []{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+		std::vector<GLint> res(std::max(count, 0));
+		if (!res.empty())
+			glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, res.data());
+		return res;
+	}();
+	return formats;
+}
+
+bool enabled()
+{
+	return !supported_formats().empty();
+}
+
+uint64_t driver_hash()
+{
+	static const uint64_t hash = []{
+		uint64_t h = 14695981039346656037ull;
+		hash_append(h, rc::glmeta::vendor());
+		hash_append(h, rc::glmeta::renderer());
+		hash_append(h, rc::glmeta::version());
+		return h;
+	}();
+	return hash;
+}
+
+std::filesystem::path entry_path(uint64_t key)
+{
+	return std::filesystem::path("cache/shaders") / fmt::format("{:016x}.bin", key);
+}
+
+bool load(uint64_t key, rc::program_handle& program)
+{
+	ZoneScoped;
+	rc::file_handle file(std::fopen(entry_path(key).u8string().data(), "rb"));
+	if (!file)
+		return false;
+
+	Header header{};
+	if (std::fread(&header, sizeof(header), 1, *file) != 1
+	    || std::memcmp(header.magic, magic, sizeof(magic)) != 0
+	    || header.key != key
+	    || header.size == 0)
+		return false;
+
+	const auto& formats = supported_formats();
+	if (std::find(formats.begin(), formats.end(), static_cast<GLint>(header.format)) == formats.end())
+		return false;
+
+	std::vector<char> data(header.size);
+	if (std::fread(data.data(), 1, data.size(), *file) != data.size())
+		return false;
+
+	rc::program_handle new_handle(glCreateProgram());
+	glProgramBinary(*new_handle, static_cast<GLenum>(header.format), data.data(), static_cast<GLsizei>(data.size()));
+	GLint success = 0;
+	glGetProgramiv(*new_handle, GL_LINK_STATUS, &success);
+	if (!success)
+		return false; // rejected by driver, caller recompiles from source
+
+	program = std::move(new_handle);
+	return true;
+}
+
+void save(uint64_t key, const rc::program_handle& program)
+{
+	ZoneScoped;
+	GLint length = 0;
+	glGetProgramiv(*program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<char> data(length);
+	GLenum format{};
+	glGetProgramBinary(*program, length, &length, &format, data.data());
+	if (length <= 0)
+		return;
+
+	const auto path = entry_path(key);
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+
+	util::write_file_atomic(path, [&](std::FILE* file)
+	{
+		Header header{};
+		std::memcpy(header.magic, magic, sizeof(magic));
+		header.format = static_cast<uint32_t>(format);
+		header.key = key;
+		header.size = static_cast<uint64_t>(length);
+		return std::fwrite(&header, sizeof(header), 1, file) == 1
+		       && std::fwrite(data.data(), 1, header.size, file) == header.size;
+	});
+}
+
+} // namespace binary_cache
+
 } // anonymous namespace
 
 class ShaderSet::Program
 {
+	enum class State
+	{
+		Idle,
+		Compiling,
+		Linking,
+		Done
+	};
+
 	std::vector<Shader> m_shaders;
 	macros_t m_macros;
+	SpecializationConstants m_constants;
+	std::filesystem::path m_spirv_directory;
+	rc::program_handle m_pending{};
+	State m_state = State::Idle;
+	uint64_t m_key = 0;
+	bool m_spirv_rejected = false;
+	std::chrono::steady_clock::time_point m_started;
 public:
+	enum class Origin
+	{
+		Glsl,
+		Spirv,
+		Binary
+	};
+
 	rc::program_handle handle{};
+	Origin origin = Origin::Glsl;
+	bool counted = false; // initial load is accounted in ShaderSet stats
 
-	explicit Program(macros_t&& macros) : m_macros(std::move(macros)){ }
+	Program(macros_t&& macros, std::filesystem::path spirv_directory) :
+	        m_macros(std::move(macros)),
+	        m_spirv_directory(std::move(spirv_directory))
+	{
+		for(const auto& macro : m_macros) {
+			if(macro.is_specialization_constant()) {
+				m_constants.ids.push_back(macro.constant_id());
+				m_constants.values.push_back(static_cast<GLuint>(std::strtol(macro.value().c_str(), nullptr, 0)));
+			}
+		}
+	}
 	~Program() = default;
 	Program(Program&&) noexcept = default;
 	Program& operator=(Program&&) noexcept = default;
 	RC_DISABLE_COPY(Program)
 
-	static bool link(rc::program_handle& program)
+	static bool link_status(const rc::program_handle& program)
 	{
-		glLinkProgram(*program);
 		GLint success = 0;
 		glGetProgramiv(*program, GL_LINK_STATUS, &success);
 		if(!success) {
@@ -249,26 +549,68 @@ public:
 		m_shaders.push_back(std::move(s));
 	}
 
-	bool reload()
+	bool invalidate(const std::vector<std::filesystem::path>& changed)
 	{
-		unsigned valid_shaders = 0, reloaded_shaders = 0;
+		bool res = false;
 		for(auto& s : m_shaders) {
-			if(s.reload()) {
-				++reloaded_shaders;
-			}
-			if(s.valid()) {
-				++valid_shaders;
+			res |= s.invalidate(changed);
+		}
+		return res;
+	}
+
+	void watch_files(rc::FileWatcher& watcher) const
+	{
+		for(const auto& s : m_shaders) {
+			watcher.watch(s.filepath);
+			for(const auto& include : s.includes) {
+				watcher.watch(include);
 			}
 		}
-		if(reloaded_shaders == 0 || valid_shaders != m_shaders.size())
-			return false;
+	}
 
-		rc::program_handle new_handle(glCreateProgram());
+	// Module name is shader file name followed by defines that are not specialization
+	// constants, e.g. shadow_mapping.frag.POINT_LIGHT.spv, same as built by shaders-spirv target.
+	std::filesystem::path spirv_path(const Shader& shader) const
+	{
+		auto name = shader.filepath.filename().u8string();
+		for(const auto& macro : m_macros) {
+			if(macro.is_specialization_constant())
+				continue;
+			name += "." + macro.name();
+			if(!macro.value().empty())
+				name += "=" + macro.value();
+		}
+		name += ".spv";
+		return m_spirv_directory / name;
+	}
 
+	// Uses SPIR-V only if modules of all shaders are up to date, program can't mix them with GLSL.
+	bool load_spirv()
+	{
+		bool loaded = spirv_supported() && !m_spirv_rejected;
 		for(auto& s : m_shaders) {
-			glAttachShader(*new_handle, *s.handle);
+			loaded = loaded && s.load_spirv(spirv_path(s));
 		}
+		if(!loaded) {
+			for(auto& s : m_shaders) {
+				s.spirv.clear();
+			}
+		}
+		return loaded;
+	}
 
+	uint64_t binary_key() const
+	{
+		uint64_t h = binary_cache::driver_hash();
+		for (const auto& shader : m_shaders) {
+			binary_cache::hash_append(h, shader.filepath.extension().string());
+			binary_cache::hash_append(h, shader.source);
+		}
+		return h;
+	}
+
+	void set_label(const rc::program_handle& program) const
+	{
 		fmt::memory_buffer buf;
 		for (auto& shader : m_shaders) {
 			auto sp = shader.filepath.filename().string();
@@ -283,13 +625,115 @@ public:
 			}
 		}
 		fmt::format_to(fmt::appender(buf), ")");
-		glObjectLabel(GL_PROGRAM, *new_handle, buf.size(), buf.data());
+		glObjectLabel(GL_PROGRAM, *program, buf.size(), buf.data());
+	}
 
-		if(Program::link(new_handle)) {
-			handle = std::move(new_handle);
+	// Re-reads changed sources and starts rebuilding the program. Current handle
+	// stays in use until poll() swaps in the new one.
+	bool reload()
+	{
+		unsigned reloaded_shaders = 0;
+		for(auto& s : m_shaders) {
+			if(s.update_source()) {
+				++reloaded_shaders;
+			}
+		}
+		if(reloaded_shaders == 0)
+			return false;
+
+		m_pending.reset();
+		m_started = std::chrono::steady_clock::now();
+
+		const bool use_cache = binary_cache::enabled();
+		m_key = use_cache ? binary_key() : 0;
+		if(use_cache && binary_cache::load(m_key, handle)) {
+			set_label(handle);
+			origin = Origin::Binary;
+			m_state = State::Done;
 			return true;
 		}
 
+		// shaders are compiled lazily, program loaded from binary may have none yet
+		load_spirv();
+		for(auto& s : m_shaders) {
+			s.start_compile(m_constants);
+		}
+		m_state = State::Compiling;
+		return true;
+	}
+
+	// Advances pending reload. Unless wait is set, returns early if driver is still busy.
+	// Returns true once reload has finished, successfully or not.
+	bool poll(bool wait)
+	{
+		if(m_state == State::Compiling) {
+			if(!wait && !std::all_of(m_shaders.begin(), m_shaders.end(), [](const Shader& s){ return s.compile_ready(); }))
+				return false;
+
+			unsigned valid_shaders = 0;
+			for(auto& s : m_shaders) {
+				if(s.finish_compile()) {
+					++valid_shaders;
+				}
+			}
+			if(valid_shaders != m_shaders.size()) {
+				if(!m_spirv_rejected && std::any_of(m_shaders.begin(), m_shaders.end(), [](const Shader& s){ return !s.spirv.empty(); })) {
+					fmt::print(stderr, "[shader]  SPIR-V module rejected, compiling GLSL instead\n");
+					std::fflush(stderr);
+					m_spirv_rejected = true;
+					for(auto& s : m_shaders) {
+						s.spirv.clear();
+						s.source_compiled = false;
+						s.start_compile(m_constants);
+					}
+					return false;
+				}
+				m_state = State::Idle;
+				return true;
+			}
+
+			m_pending = rc::program_handle(glCreateProgram());
+			for(auto& s : m_shaders) {
+				glAttachShader(*m_pending, *s.handle);
+			}
+			set_label(m_pending);
+			if(binary_cache::enabled())
+				glProgramParameteri(*m_pending, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			glLinkProgram(*m_pending);
+			m_state = State::Linking;
+		}
+
+		if(m_state == State::Linking) {
+			if(!wait && !program_ready(*m_pending))
+				return false;
+
+			m_state = State::Idle;
+			if(Program::link_status(m_pending)) {
+				if(binary_cache::enabled())
+					binary_cache::save(m_key, m_pending);
+				handle = std::move(m_pending);
+				origin = m_shaders.front().handle_spirv ? Origin::Spirv : Origin::Glsl;
+			} else {
+				m_pending.reset();
+				print_failure();
+			}
+			return true;
+		}
+
+		if(m_state == State::Done) {
+			m_state = State::Idle;
+			return true;
+		}
+		return false;
+	}
+
+	double elapsed_ms() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_started).count();
+	}
+
+	void print_failure() const
+	{
 		std::vector<std::string> files;
 		for (const auto& shader : m_shaders)
 			files.push_back(shader.path().string());
@@ -302,12 +746,10 @@ public:
 		}
 		fmt::print(stderr, "[shader]  failed macros:\n"
 		                   "[shader]    {}\n", fmt::join(defines, "\n[shader]    "));
-
+		std::fflush(stderr);
 		// seems like there's no need to detach shaders before program deletion
-		return false;
 	}
 
-
 	bool valid() const
 	{
 		return static_cast<bool>(handle);
@@ -317,7 +759,10 @@ public:
 };
 
 
-ShaderSet::ShaderSet(std::filesystem::path directory) : m_directory(std::move(directory))
+ShaderSet::ShaderSet(std::filesystem::path directory, std::filesystem::path spirv_directory) :
+        m_directory(std::move(directory)),
+        m_spirv_directory(std::move(spirv_directory)),
+        m_watcher(std::make_unique<FileWatcher>())
 {
 	static int instance_count = 0;
 	if (++instance_count > 1)
@@ -328,37 +773,71 @@ ShaderSet::ShaderSet(std::filesystem::path directory) : m_directory(std::move(di
 
 ShaderSet::~ShaderSet()
 {
-	for(unsigned i = 0; i < m_program_count; ++i) {
-		if (m_programs[i]) {
-			std::destroy_at(m_programs[i]);
-			m_programs[i] = nullptr;
-		}
-	}
+	m_programs.clear();
 }
 
 void ShaderSet::check_updates()
 {
-	if (m_dirty) {
-		for(unsigned i = 0; i < m_program_count; ++i) {
-			auto prog = m_programs[i];
-			if (prog)
-				prog->reload();
+	auto changed = m_watcher->changed_files();
+	for(unsigned i = 0; !changed.empty() && i < m_programs.size(); ++i) {
+		auto& prog = m_programs[i];
+		if (prog && prog->invalidate(changed)) {
+			prog->reload();
+			prog->watch_files(*m_watcher); // includes may have changed
 		}
-		m_dirty = false;
 	}
 
-	if (m_program_count > 0) {
-		auto prog = m_programs[m_next_reload_index];
-		if (prog)
-			prog->reload();
+	for(unsigned i = 0; i < m_programs.size(); ++i) {
+		if (m_programs[i])
+			poll(*m_programs[i], false);
+	}
+}
+
+void ShaderSet::poll(Program& program, bool wait)
+{
+	if(program.poll(wait) && !program.counted && program.valid()) {
+		program.counted = true;
+		auto& stats = program.origin == Program::Origin::Binary ? m_stats.cached
+		            : program.origin == Program::Origin::Spirv  ? m_stats.spirv
+		                                                        : m_stats.compiled;
+		++stats.count;
+		stats.milliseconds += program.elapsed_ms();
+	}
+}
 
-		m_next_reload_index = (m_next_reload_index + 1) % m_program_count;
+void ShaderSet::finish()
+{
+	ZoneScoped;
+	for(unsigned i = 0; i < m_programs.size(); ++i) {
+		if (m_programs[i])
+			poll(*m_programs[i], true);
+	}
+}
+
+bool ShaderSet::wait(const uint32_t* handle)
+{
+	ZoneScoped;
+	for(unsigned i = 0; handle && i < m_programs.size(); ++i) {
+		if (m_programs[i] && m_programs[i]->handle.get() == handle) {
+			poll(*m_programs[i], true);
+			return m_programs[i]->valid();
+		}
+	}
+	return false;
+}
+
+uint64_t ShaderSet::source_hash(const uint32_t* handle) const
+{
+	for (const auto& program : m_programs) {
+		if (handle && program && program->handle.get() == handle)
+			return program->binary_key();
 	}
+	return 0;
 }
 
 gl::GLuint * ShaderSet::load_program(std::vector<std::filesystem::path>&& names, macros_t&& defines)
 {
-	auto program = std::make_unique<Program>(std::move(defines));
+	auto program = std::make_unique<Program>(std::move(defines), m_spirv_directory);
 
 	for(auto filepath : names) {
 		if (!filepath.is_absolute()) {
@@ -374,24 +853,36 @@ gl::GLuint * ShaderSet::load_program(std::vector<std::filesystem::path>&& names,
 	}
 
 	program->reload();
+	program->watch_files(*m_watcher);
+	auto handle = program->handle.get();
+
+	// reuse slot of deleted program, if any
+	auto slot = std::find(m_programs.begin(), m_programs.end(), nullptr);
+	if (slot != m_programs.end())
+		*slot = std::move(program);
+	else
+		m_programs.push_back(std::move(program));
+	return handle;
+}
 
-	if(program->valid()) {
-		m_programs[m_program_count] = program.release();
-		m_dirty = true;
-		return m_programs[m_program_count++]->handle.get();
-	}
-
-	return nullptr;
+void ShaderSet::log_load_stats() const
+{
+	fmt::print("[shader]  loaded {} programs: {} from binary cache ({:.1f} ms), "
+	           "{} from SPIR-V ({:.1f} ms), {} compiled from GLSL ({:.1f} ms), summed latency\n",
+	           m_stats.cached.count + m_stats.spirv.count + m_stats.compiled.count,
+	           m_stats.cached.count, m_stats.cached.milliseconds,
+	           m_stats.spirv.count, m_stats.spirv.milliseconds,
+	           m_stats.compiled.count, m_stats.compiled.milliseconds);
+	std::fflush(stdout);
 }
 
 
 bool ShaderSet::deleteProgram(uint32_t** p)
 {
 	if (p) {
-		for (unsigned i = 0; i < m_program_count; ++i) {
-			if (m_programs[i] && (m_programs[i]->handle.get() == *p)) {
-				delete m_programs[i];
-				m_programs[i] = nullptr;
+		for (auto& program : m_programs) {
+			if (program && (program->handle.get() == *p)) {
+				program.reset();
 				*p = nullptr;
 				return true;
 			}
@@ -415,6 +906,22 @@ ShaderMacro::ShaderMacro(std::string_view name, bool value) : ShaderMacro(name,
 
 ShaderMacro::ShaderMacro(std::string_view name, double value) : ShaderMacro(name, std::to_string(value)) { }
 
+ShaderMacro& ShaderMacro::specialization_constant(uint32_t constant_id)
+{
+	m_constant_id = static_cast<int32_t>(constant_id);
+	return *this;
+}
+
+bool ShaderMacro::is_specialization_constant() const noexcept
+{
+	return m_constant_id >= 0;
+}
+
+uint32_t ShaderMacro::constant_id() const noexcept
+{
+	return static_cast<uint32_t>(m_constant_id);
+}
+
 std::string ShaderMacro::get_define_string() const
 {
 	return make_definition(m_name, m_value);
@@ -4,10 +4,13 @@
 #include <string>
 #include <string_view>
 #include <filesystem>
+#include <memory>
 #include <vector>
 
 namespace rc {
 
+class FileWatcher;
+
 class ShaderMacro {
 public:
 	ShaderMacro(std::string_view name, std::string_view value = std::string_view());
@@ -17,12 +20,19 @@ public:
 	ShaderMacro(std::string_view name, bool value);
 	ShaderMacro(std::string_view name, double value);
 
+	// Integer macro that SPIR-V modules take as specialization constant with given id,
+	// so that one module serves all its values. GLSL sources still get it as #define.
+	ShaderMacro& specialization_constant(uint32_t constant_id);
+
 	std::string get_define_string() const;
 	const std::string& name() const;
 	const std::string& value() const;
+	bool is_specialization_constant() const noexcept;
+	uint32_t constant_id() const noexcept;
 private:
 	std::string m_name;
 	std::string m_value;
+	int32_t     m_constant_id = -1;
 };
 
 class ShaderSet
@@ -30,25 +40,54 @@ class ShaderSet
 public:
 
 	// Only single instance is allowed. MUST NOT be static or global instance.
-	explicit ShaderSet(std::filesystem::path directory = path::shader);
+	// SPIR-V modules built by shaders-spirv target are used when driver supports ARB_gl_spirv
+	// and modules are newer than GLSL sources, otherwise GLSL is compiled as before.
+	explicit ShaderSet(std::filesystem::path directory = path::shader,
+	                   std::filesystem::path spirv_directory = path::spirv);
 	~ShaderSet();
 
+	// Reloads programs whose shaders or their includes were modified on disk and
+	// swaps in programs whose compilation has finished. Changes are reported by
+	// background file watcher, so this is cheap to call every frame.
 	void check_updates();
 
+	// Blocks until all pending compiles have finished.
+	void finish();
+	// Blocks until given program is ready, returns false if it failed to build.
+	bool wait(const uint32_t* program);
+	// Hash of preprocessed sources of program and GL driver, stable between runs, so
+	// results computed with program can be cached on disk. Returns 0 for unknown program.
+	uint64_t source_hash(const uint32_t* program) const;
+
 	using macros_t = std::vector<ShaderMacro>;
 
+	// Starts building program and returns pointer to its handle, which stays 0 until
+	// compilation finishes, see wait() and finish(). Later reloads swap the handle in place.
 	uint32_t* load_program(std::vector<std::filesystem::path>&& paths, macros_t&& defines = macros_t());
 	bool deleteProgram(uint32_t**);
 
-	static constexpr size_t max_programs = 16;
+	// Prints time spent in load_program, split by programs restored from binary cache and compiled ones.
+	void log_load_stats() const;
 
 private:
 	class Program;
+	void poll(Program& program, bool wait);
+
 	std::filesystem::path m_directory;
-	Program*    m_programs[max_programs];
-	unsigned    m_program_count = 0;
-	unsigned    m_next_reload_index = 0;
-	bool        m_dirty = true;
+	std::filesystem::path m_spirv_directory;
+	std::vector<std::unique_ptr<Program>> m_programs; // programs stay at fixed address, handle pointers are handed out
+	std::unique_ptr<FileWatcher> m_watcher;
+
+	struct LoadStats
+	{
+		unsigned count = 0;
+		double   milliseconds = 0.0;
+	};
+	struct {
+		LoadStats cached;
+		LoadStats spirv;
+		LoadStats compiled;
+	} m_stats;
 
 };
 
@@ -20,3 +20,11 @@
 #define RC_FRAGMENT_SHADER_TEXTURE_BINDING_ROUGHNESS_METALLIC 3
 #define RC_FRAGMENT_SHADER_TEXTURE_BINDING_OCCLUSION 4
 #define RC_FRAGMENT_SHADER_TEXTURE_BINDING_EMISSION 5
+
+#define RC_SHADER_MATERIAL_INDEX_LOCATION          3
+#define RC_SHADER_STORAGE_BINDING_MATERIALS        0
+#define RC_SHADER_STORAGE_BINDING_IRRADIANCE_SH    1
+
+#define RC_SPEC_CONSTANT_MATERIAL_VARIANT          0
+#define RC_SPEC_CONSTANT_TANGENTS_VARIANT          1
+#define RC_SPEC_CONSTANT_SHADOW_VARIANT            2
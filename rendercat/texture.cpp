@@ -14,6 +14,33 @@ const char* rc::Texture::enum_value_str(ColorSpace s) noexcept
 	unreachable();
 }
 
+uint32_t rc::Texture::compressed_block_size(InternalFormat f) noexcept
+{
+	switch (f) {
+	case InternalFormat::Compressed_RGB_DXT1:
+	case InternalFormat::Compressed_RGBA_DXT1:
+	case InternalFormat::Compressed_SRGB_DXT1:
+	case InternalFormat::Compressed_SRGB_ALPHA_DXT1:
+	case InternalFormat::Compressed_RED_RGTC1:
+	case InternalFormat::Compressed_SIGNED_RED_RGTC1:
+		return 8;
+	case InternalFormat::Compressed_RGBA_DXT3:
+	case InternalFormat::Compressed_RGBA_DXT5:
+	case InternalFormat::Compressed_SRGB_ALPHA_DXT3:
+	case InternalFormat::Compressed_SRGB_ALPHA_DXT5:
+	case InternalFormat::Compressed_RG_RGTC2:
+	case InternalFormat::Compressed_SIGNED_RG_RGTC2:
+	case InternalFormat::Compressed_RGBA_BPTC_UNORM:
+	case InternalFormat::Compressed_SRGB_ALPHA_BPTC_UNORM:
+	case InternalFormat::Compressed_RGB_BPTC_SIGNED_FLOAT:
+	case InternalFormat::Compressed_RGB_BPTC_UNSIGNED_FLOAT:
+		return 16;
+	default:
+		break;
+	}
+	return 0;
+}
+
 const char* rc::Texture::enum_value_str(InternalFormat f) noexcept
 {
 	switch (f) {
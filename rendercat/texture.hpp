@@ -129,6 +129,9 @@ namespace Texture {
 		ChannelValue alpha = ChannelValue::Alpha;
 	};
 
+	// bytes per 4x4 block, 0 for formats that are not block compressed
+	uint32_t compressed_block_size(InternalFormat) noexcept;
+
 	// FIXME: use X-macros or some other reflection tool
 	const char* enum_value_str(AlphaMode) noexcept;
 	const char* enum_value_str(ColorSpace) noexcept;
@@ -1,13 +1,20 @@
 #include <rendercat/texture2d.hpp>
+#include <rendercat/texture_container.hpp>
+#include <rendercat/texture_mips.hpp>
+#include <rendercat/texture_sampler.hpp>
 #include <rendercat/util/gl_debug.hpp>
+#include <rendercat/util/gl_meta.hpp>
 #include <stb_image.h>
 #include <fmt/core.h>
 #include <cassert>
+#include <cmath>
+#include <utility>
 
 #include <glbinding/gl45core/types.h>
 #include <glbinding/gl45core/enum.h>
 #include <glbinding/gl45core/functions.h>
 #include <glbinding/gl45ext/enum.h>
+#include <glbinding/gl45ext/functions.h>
 
 #include <zcm/common.hpp>
 #include <zcm/exponential.hpp>
@@ -141,6 +148,33 @@ static bool is_internal_format_compressed(Texture::InternalFormat format) noexce
 	return false;
 }
 
+// Bits per texel as stored by typical drivers: 3-channel formats are padded to 4.
+static uint16_t fmt_texel_bits(Texture::InternalFormat format) noexcept
+{
+	using namespace Texture;
+	switch (format) {
+	case InternalFormat::Compressed_RGB_DXT1:
+	case InternalFormat::Compressed_RGBA_DXT1:
+	case InternalFormat::Compressed_SRGB_DXT1:
+	case InternalFormat::Compressed_SRGB_ALPHA_DXT1:
+	case InternalFormat::Compressed_RED_RGTC1:
+	case InternalFormat::Compressed_SIGNED_RED_RGTC1:
+		return 4;
+	case InternalFormat::R_8:
+		return 8;
+	case InternalFormat::R_16:
+	case InternalFormat::R_16F:
+	case InternalFormat::RG_8:
+		return 16;
+	case InternalFormat::RGB_16F:
+	case InternalFormat::RGBA_16F:
+		return 64;
+	default:
+		break;
+	}
+	return is_internal_format_compressed(format) ? 8 : 32;
+}
+
 static Texture::InternalFormat reinterpret_format(Texture::InternalFormat newfmt)
 {
 	if(newfmt != Texture::InternalFormat::KeepParentFormat) {
@@ -210,13 +244,9 @@ TextureStorage2D TextureStorage2D::share_view(unsigned minlevel, unsigned numlev
 		return ret;
 
 
-	if(minlevel != 0) {
-		minlevel = 0;
-		fmt::print(stderr, "[texture2d.storage] base level change not yet implemented");
-	}
-
-	if(minlevel + numlevels > m_mip_levels) {
-		fmt::print(stderr, "[texture2d.storage] mip levels OOB: base: {} count: {} parent: {}", minlevel, numlevels, m_mip_levels);
+	if(numlevels == 0 || minlevel + numlevels > m_mip_levels) {
+		fmt::print(stderr, "[texture2d.storage] mip levels OOB: base: {} count: {} parent: {}\n", minlevel, numlevels, m_mip_levels);
+		std::fflush(stderr);
 		return ret;
 	}
 
@@ -227,8 +257,9 @@ TextureStorage2D TextureStorage2D::share_view(unsigned minlevel, unsigned numlev
 
 	ret.m_internal_format = view_format;
 	ret.m_mip_levels = numlevels;
-	ret.m_width = m_width;
-	ret.m_height = m_height;
+	// base level of the view becomes its level 0
+	ret.m_width = std::max(1, m_width >> minlevel);
+	ret.m_height = std::max(1, m_height >> minlevel);
 
 	auto increment_clamp = [](uint8_t val)
 	{
@@ -371,6 +402,27 @@ Texture::ColorSpace TextureStorage2D::color_space() const noexcept
 	return fmt_color_space(m_internal_format);
 }
 
+size_t TextureStorage2D::memory_size() const noexcept
+{
+	if(!valid())
+		return 0;
+
+	const bool compressed = is_internal_format_compressed(m_internal_format);
+	const size_t bits = fmt_texel_bits(m_internal_format);
+	size_t total = 0;
+	for(unsigned level = 0; level < m_mip_levels; ++level) {
+		size_t w = std::max(1, m_width >> level);
+		size_t h = std::max(1, m_height >> level);
+		if(compressed) {
+			// blocks are 4x4 texels, partial blocks still occupy whole block
+			w = (w + 3) & ~size_t(3);
+			h = (h + 3) & ~size_t(3);
+		}
+		total += w * h * bits / 8;
+	}
+	return total;
+}
+
 
 //------------------------------------------------------------------------------
 
@@ -382,47 +434,65 @@ ImageTexture2D ImageTexture2D::fromFile(const std::filesystem::path& path,
 	ZoneScoped;
 	using namespace Texture;
 
+	if (is_container_file(path)) {
+		CookedImage image;
+		if (!load_container(path, color_space, image))
+			return ImageTexture2D();
+
+		TextureStorage2D storage(image.width, image.height, image.format, image.levels.size());
+		for (size_t i = 0; i < image.levels.size(); ++i) {
+			const auto& level = image.levels[i];
+			storage.compressed_sub_image(i, level.width, level.height, level.size, image.data.data() + level.offset);
+		}
+
+		ImageTexture2D ret;
+		ret.m_storage = std::move(storage);
+		if (ret.m_storage.valid()) {
+			ret.set_default_params();
+			ret.m_storage.set_label(fmt::format("{} ({}x{} {})",
+			                                    path.u8string(),
+			                                    ret.m_storage.width(),
+			                                    ret.m_storage.height(),
+			                                    enum_value_str(ret.m_storage.format())));
+		}
+		return ret;
+	}
 
 	int width, height, nrChannels;
-	auto data = stbi_load(path.u8string().data(), &width, &height, &nrChannels, 0);
+	auto data = stbi_load(path.u8string().data(), &width, &height, &nrChannels, 4);
 	if(!data) {
 		fmt::print(stderr, "[texture2d.fromFile] could not load image data from [{}]\n", path.u8string());
 		return ImageTexture2D();
 	}
 
-	TextureStorage2D storage;
-
+	InternalFormat format = InternalFormat::InvalidFormat;
 	switch (nrChannels) {
 	case 1:
-	{
-		storage = TextureStorage2D(width, height, InternalFormat::R_8);
-		storage.sub_image(0, width, height, TexelDataType::UnsignedByte, data);
+		format = InternalFormat::R_8;
 		break;
-	}
-	case 3:
-	{
-		auto format = color_space == ColorSpace::Linear ? InternalFormat::RGB_8 : InternalFormat::SRGB_8;
-		storage = TextureStorage2D(width, height, format);
-		storage.sub_image(0, width, height, TexelDataType::UnsignedByte, data);
-		break;
-	}
+	case 2:
 	case 4:
-	{
-		auto format = color_space == ColorSpace::Linear ? InternalFormat::RGBA_8 : InternalFormat::SRGB_8_ALPHA_8;
-		storage = TextureStorage2D(width, height, format);
-		storage.sub_image(0, width, height, TexelDataType::UnsignedByte, data);
+		format = color_space == ColorSpace::Linear ? InternalFormat::RGBA_8 : InternalFormat::SRGB_8_ALPHA_8;
+		break;
+	case 3:
+		format = color_space == ColorSpace::Linear ? InternalFormat::RGB_8 : InternalFormat::SRGB_8;
 		break;
-	}
 	default:
 		unreachable();
 	}
 
-	ImageTexture2D ret;
-	ret.m_storage = std::move(storage);
-
+	// image is always expanded to RGBA for CPU mip generation, GL drops unused channels
+	const auto mips = generate_mips(data, width, height, MipOptions{color_space});
 	stbi_image_free(data);
+
+	ImageTexture2D ret;
+	ret.m_storage = TextureStorage2D(width, height, format, mips.levels.size());
 	if(ret.m_storage.valid()) {
-		glGenerateTextureMipmap(ret.m_storage.texture_handle());
+		for (size_t i = 0; i < mips.levels.size(); ++i) {
+			const auto& level = mips.levels[i];
+			glTextureSubImage2D(ret.m_storage.texture_handle(), i, 0, 0, level.width, level.height,
+			                    GL_RGBA, GL_UNSIGNED_BYTE, mips.data.data() + level.offset);
+		}
 		ret.set_default_params();
 		ret.m_storage.set_label(fmt::format("{} ({}x{} {})",
 		                                    path.u8string(),
@@ -434,17 +504,26 @@ ImageTexture2D ImageTexture2D::fromFile(const std::filesystem::path& path,
 }
 
 
+ImageTexture2D ImageTexture2D::fromStorage(TextureStorage2D&& storage, std::shared_ptr<Texture::StreamState> stream)
+{
+	ImageTexture2D ret;
+	ret.m_storage = std::move(storage);
+	ret.m_stream = std::move(stream);
+	ret.set_default_params();
+	return ret;
+}
+
+
 ImageTexture2D ImageTexture2D::share()
 {
 	ImageTexture2D copy;
-	copy.m_anisotropic_samples = m_anisotropic_samples;
-	copy.m_border_color = m_border_color;
-	copy.m_min_filter = m_min_filter;
-	copy.m_mag_filter = m_mag_filter;
+	copy.m_sampler_params = m_sampler_params;
+	copy.m_sampler = m_sampler;
+	copy.m_sampler_generation = m_sampler_generation;
 	copy.m_swizzle_mask = m_swizzle_mask;
-	copy.m_wrapping_s = m_wrapping_s;
-	copy.m_wrapping_t = m_wrapping_t;
 	copy.m_storage = m_storage.share();
+	copy.m_stream = m_stream;
+	copy.m_stream_generation = m_stream_generation;
 	copy.set_default_params();
 	return copy;
 }
@@ -459,9 +538,38 @@ bool ImageTexture2D::valid() const noexcept
 	return m_storage.valid();
 }
 
+bool ImageTexture2D::resident() const noexcept
+{
+	return !m_stream || m_stream->ready;
+}
+
 void ImageTexture2D::reset() noexcept
 {
 	m_storage.reset();
+	m_stream.reset();
+	m_stream_generation = 0;
+	m_bindless_handle = 0;
+}
+
+void ImageTexture2D::update_stream_view() const
+{
+	if(likely(!m_stream || !m_stream->mip_streamed || m_stream_generation == m_stream->generation))
+		return;
+
+	m_stream_generation = m_stream->generation;
+	if(!m_stream->storage.valid())
+		return;
+
+	auto view = m_stream->storage.share_view(0, m_stream->storage.levels());
+	std::swap(view, m_storage);
+	if(m_bindless_handle)
+		Texture::Samplers::retire_handle(std::exchange(m_bindless_handle, 0), std::move(view), m_sampler_generation);
+	apply_params();
+}
+
+const std::shared_ptr<Texture::StreamState>& ImageTexture2D::stream_state() const noexcept
+{
+	return m_stream;
 }
 
 uint32_t ImageTexture2D::texture_handle() const noexcept
@@ -471,16 +579,22 @@ uint32_t ImageTexture2D::texture_handle() const noexcept
 
 uint16_t ImageTexture2D::width() const noexcept
 {
+	if(m_stream && m_stream->mip_streamed)
+		return m_stream->width;
 	return m_storage.width();
 }
 
 uint16_t ImageTexture2D::height() const noexcept
 {
+	if(m_stream && m_stream->mip_streamed)
+		return m_stream->height;
 	return m_storage.height();
 }
 
 uint16_t ImageTexture2D::levels() const noexcept
 {
+	if(m_stream && m_stream->mip_streamed)
+		return m_stream->levels;
 	return m_storage.levels();
 }
 
@@ -501,97 +615,69 @@ Texture::SwizzleMask ImageTexture2D::swizzle_mask() const noexcept
 
 Texture::MinFilter ImageTexture2D::min_filter() const noexcept
 {
-	return m_min_filter;
+	return m_sampler_params.min_filter;
 }
 
 Texture::MagFilter ImageTexture2D::mag_filter() const noexcept
 {
-	return m_mag_filter;
+	return m_sampler_params.mag_filter;
 }
 
 Texture::Wrapping ImageTexture2D::wrapping_t() const noexcept
 {
-	return m_wrapping_t;
+	return m_sampler_params.wrapping_t;
 }
 
 Texture::Wrapping ImageTexture2D::wrapping_s() const noexcept
 {
-	return m_wrapping_s;
+	return m_sampler_params.wrapping_s;
 }
 
 uint16_t ImageTexture2D::anisotropy() const noexcept
 {
-	return m_anisotropic_samples;
+	return m_sampler_params.anisotropic_samples;
 }
 
 
 zcm::vec4 ImageTexture2D::border_color() const noexcept
 {
-	return m_border_color;
+	return m_sampler_params.border_color;
 }
 
 float ImageTexture2D::mip_bias() const noexcept
 {
-	return m_bias;
+	return m_sampler_params.mip_bias;
 }
 
 
 void ImageTexture2D::set_filtering(Texture::MinFilter min, Texture::MagFilter mag) noexcept
 {
-	m_min_filter = min;
-	m_mag_filter = mag;
-	if(unlikely(!m_storage.valid())) return;
-
-	glTextureParameteri(m_storage.texture_handle(), GL_TEXTURE_MIN_FILTER, static_cast<GLenum>(m_min_filter));
-	glTextureParameteri(m_storage.texture_handle(), GL_TEXTURE_MAG_FILTER, static_cast<GLenum>(m_mag_filter));
-	assert(glGetError() == GL_NO_ERROR);
+	m_sampler_params.min_filter = min;
+	m_sampler_params.mag_filter = mag;
+	invalidate_sampler();
 }
 
 
 void ImageTexture2D::set_wrapping(Texture::Wrapping s, Texture::Wrapping t) noexcept
 {
-	m_wrapping_s = s;
-	m_wrapping_t = t;
-	if(unlikely(!m_storage.valid())) return;
-	GLenum wrapping_s{static_cast<unsigned>(s)}, wrapping_t{static_cast<unsigned>(t)};
-
-	glTextureParameteri(m_storage.texture_handle(), GL_TEXTURE_WRAP_S, wrapping_s);
-	glTextureParameteri(m_storage.texture_handle(), GL_TEXTURE_WRAP_T, wrapping_t);
-	assert(glGetError() == GL_NO_ERROR);
+	m_sampler_params.wrapping_s = s;
+	m_sampler_params.wrapping_t = t;
+	invalidate_sampler();
 }
 
 
+// Effective sample count is also limited by global setting and driver maximum.
 void ImageTexture2D::set_anisotropy(unsigned samples) noexcept
 {
-	static unsigned max_aniso;
-	if(unlikely(!max_aniso)) {
-		float max_aniso_samples = 0.0f;
-		constexpr auto GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT = gl45ext::GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT;
-		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_aniso_samples);
-
-		max_aniso = zcm::floor(max_aniso_samples);
-		if(max_aniso < 2 || max_aniso > 16) {
-			fmt::print(stderr, "[texture2d] driver reports invalid maximum anisotropy sample count: {}\n", max_aniso_samples);
-			max_aniso = 1;
-		} else {
-			//fmt::print(stderr, "[texture2d.filtering] max anisotropic samples: {}\n", max_aniso);
-		}
-	}
-	m_anisotropic_samples = std::min(std::max(samples, 1u), max_aniso);
-	if(unlikely(!m_storage.valid())) return;
-
-	constexpr auto GL_TEXTURE_MAX_ANISOTROPY_EXT = gl45ext::GL_TEXTURE_MAX_ANISOTROPY_EXT;
-	float aniso = m_anisotropic_samples;
-	glTextureParameterf(m_storage.texture_handle(), GL_TEXTURE_MAX_ANISOTROPY_EXT, aniso);
+	m_sampler_params.anisotropic_samples = std::min(std::max(samples, 1u), 16u);
+	invalidate_sampler();
 }
 
 
 void ImageTexture2D::set_border_color(const zcm::vec4& c) noexcept
 {
-	m_border_color = c;
-	if(unlikely(!m_storage.valid())) return;
-
-	glTextureParameterfv(m_storage.texture_handle(), GL_TEXTURE_BORDER_COLOR, zcm::value_ptr(m_border_color));
+	m_sampler_params.border_color = c;
+	invalidate_sampler();
 }
 
 static const GLenum swizzle_values[] =
@@ -608,6 +694,7 @@ void ImageTexture2D::set_swizzle_mask(const Texture::SwizzleMask& m) noexcept
 {
 	m_swizzle_mask = m;
 	if(unlikely(!m_storage.valid())) return;
+	retire_bindless();
 
 	auto repr = [](Texture::ChannelValue v)
 	{
@@ -618,10 +705,11 @@ void ImageTexture2D::set_swizzle_mask(const Texture::SwizzleMask& m) noexcept
 	glTextureParameteriv(m_storage.texture_handle(), GL_TEXTURE_SWIZZLE_RGBA, swizzleMask);
 }
 
+// Added to global mip bias. Rounded, so that editor sliders don't create a sampler per value.
 void ImageTexture2D::set_mip_bias(float bias) noexcept
 {
-	m_bias = bias;
-	glTextureParameterfv(m_storage.texture_handle(), GL_TEXTURE_LOD_BIAS, &m_bias);
+	m_sampler_params.mip_bias = std::round(bias * 16.0f) / 16.0f;
+	invalidate_sampler();
 }
 
 
@@ -629,20 +717,98 @@ void ImageTexture2D::set_default_params()
 {
 	if(unlikely(!valid())) return;
 
-	set_filtering(m_min_filter, m_mag_filter);
-	set_wrapping(m_wrapping_s, m_wrapping_t);
-	set_anisotropy(m_anisotropic_samples);
-	set_border_color(m_border_color);
 	set_swizzle_mask(m_swizzle_mask);
-	set_mip_bias(0.0f);
 }
 
+// Sampler is looked up again on next use. Bindless handle pairs texture with
+// sampler, so it is recreated too.
+void ImageTexture2D::invalidate_sampler() noexcept
+{
+	m_sampler = 0;
+	retire_bindless();
+}
+
+uint32_t ImageTexture2D::sampler() const noexcept
+{
+	const auto generation = Texture::Samplers::generation();
+	if(unlikely(!m_sampler || m_sampler_generation != generation)) {
+		retire_bindless();
+		m_sampler = Texture::Samplers::get(m_sampler_params);
+		m_sampler_generation = generation;
+	}
+	return m_sampler;
+}
+
+
+// Stamps streamed texture for residency and cache eviction decisions.
+static void mark_used(const ImageTexture2D& texture) noexcept
+{
+	static uint64_t bind_tick;
+	if(const auto& state = texture.stream_state())
+		state->last_bound = ++bind_tick;
+}
+
+
+// Same as set_default_params, but for views re-created from const context.
+// Everything else is sampler state.
+void ImageTexture2D::apply_params() const
+{
+	const auto handle = m_storage.texture_handle();
+	if(unlikely(!handle)) return;
+
+	auto repr = [](Texture::ChannelValue v)
+	{
+		return swizzle_values[static_cast<uint8_t>(v)];
+	};
+	const GLenum swizzleMask[] = {repr(m_swizzle_mask.red), repr(m_swizzle_mask.green),
+	                              repr(m_swizzle_mask.blue), repr(m_swizzle_mask.alpha)};
+	glTextureParameteriv(handle, GL_TEXTURE_SWIZZLE_RGBA, swizzleMask);
+}
+
+
+// Handle freezes texture and sampler state, any change needs a new one on a fresh view.
+// Old view and its handle stay resident while frames in flight may still use them.
+void ImageTexture2D::retire_bindless() const noexcept
+{
+	if(likely(!m_bindless_handle)) return;
+
+	auto view = m_storage.share_view(0, m_storage.levels());
+	std::swap(view, m_storage);
+	Texture::Samplers::retire_handle(std::exchange(m_bindless_handle, 0), std::move(view), m_sampler_generation);
+	apply_params();
+}
+
+uint64_t ImageTexture2D::bindless_handle() const noexcept
+{
+	if(!Texture::bindless_supported() || !valid() || !resident())
+		return 0;
+	update_stream_view();
+	mark_used(*this);
+	const auto sampler_object = sampler();
+
+	if(unlikely(!m_bindless_handle)) {
+		m_bindless_handle = gl45ext::glGetTextureSamplerHandleARB(m_storage.texture_handle(), sampler_object);
+		if(likely(m_bindless_handle))
+			gl45ext::glMakeTextureHandleResidentARB(m_bindless_handle);
+	}
+	return m_bindless_handle;
+}
 
 
 bool Texture::bind_to_unit(const ImageTexture2D& texture, uint32_t unit) noexcept
 {
-	if(!texture.valid())
+	if(!texture.valid() || !texture.resident())
 		return false;
+	texture.update_stream_view();
+	mark_used(texture);
+
 	glBindTextureUnit(unit, texture.texture_handle());
+	glBindSampler(unit, texture.sampler());
 	return true;
 }
+
+bool Texture::bindless_supported() noexcept
+{
+	static const bool supported = glmeta::extension_supported(gl::GLextension::GL_ARB_bindless_texture);
+	return supported;
+}
@@ -1,9 +1,11 @@
 #pragma once
 #include <rendercat/common.hpp>
 #include <rendercat/texture.hpp>
+#include <rendercat/texture_sampler.hpp>
 #include <rendercat/util/gl_unique_handle.hpp>
 #include <string_view>
 #include <filesystem>
+#include <memory>
 #include <zcm/vec4.hpp>
 
 namespace rc {
@@ -53,6 +55,9 @@ struct TextureStorage2D
 	Texture::InternalFormat format() const noexcept;
 	uint32_t texture_handle() const noexcept;
 
+	// Approximate video memory used by all levels, shared by views of this storage.
+	size_t memory_size() const noexcept;
+
 private:
 	mutable rc::texture_handle m_handle;
 	Texture::InternalFormat    m_internal_format = Texture::InternalFormat::InvalidFormat;
@@ -64,19 +69,54 @@ private:
 
 //------------------------------------------------------------------------------
 
+namespace Texture {
+	// Residency of a streamed texture, shared by all views of the same texture.
+	// Its use count doubles as count of live views.
+	struct StreamState
+	{
+		// Mip-streamed textures keep only levels [resident_base, levels) in this
+		// storage. It is reallocated when residency changes, and views follow
+		// by comparing generation.
+		TextureStorage2D storage;
+		uint32_t         generation = 0;
+		uint64_t         last_wanted_frame = 0;
+		uint64_t         last_bound = 0; // increases with every bind of any texture
+		uint64_t         content_hash = 0; // of source file, known once first upload is done
+		uint16_t         width = 0;  // full resolution size
+		uint16_t         height = 0;
+		uint8_t          levels = 0; // full mip chain length
+		uint8_t          resident_base = 0;
+		uint8_t          wanted_base = 0;
+		bool             mip_streamed = false;
+		bool             ready = false;
+	};
+}
+
 struct ImageTexture2D
 {
 	ImageTexture2D() = default;
 
 	[[nodiscard]] static ImageTexture2D fromFile(const std::filesystem::path& file, Texture::ColorSpace colorspace);
+	[[nodiscard]] static ImageTexture2D fromStorage(TextureStorage2D&& storage,
+	                                                std::shared_ptr<Texture::StreamState> stream = nullptr);
 
 	[[nodiscard]] ImageTexture2D share();
 
 	[[nodiscard]] bool shared() const noexcept;
 	[[nodiscard]] bool valid() const noexcept;
+	[[nodiscard]] bool resident() const noexcept;
 	void reset() noexcept;
 
+	// Re-creates view if storage of mip-streamed texture was reallocated.
+	void update_stream_view() const;
+	const std::shared_ptr<Texture::StreamState>& stream_state() const noexcept;
+
 	uint32_t texture_handle() const noexcept;
+	// Resident ARB_bindless_texture handle, created on first use.
+	// Zero if texture is not resident yet or bindless textures are unsupported.
+	uint64_t bindless_handle() const noexcept;
+	// Shared sampler object matching texture's sampling parameters.
+	uint32_t sampler() const noexcept;
 
 	uint16_t width() const noexcept;
 	uint16_t height() const noexcept;
@@ -104,20 +144,23 @@ struct ImageTexture2D
 
 private:
 	void set_default_params();
-
-	TextureStorage2D      m_storage;
-	zcm::vec4             m_border_color{};
-	float                 m_bias = 0.0f;
+	void apply_params() const;
+	void retire_bindless() const noexcept;
+	void invalidate_sampler() noexcept;
+
+	mutable TextureStorage2D m_storage;
+	std::shared_ptr<Texture::StreamState> m_stream; // null if texture is not streamed
+	mutable uint32_t      m_stream_generation = 0;
+	mutable uint64_t      m_bindless_handle = 0; // owned by m_storage view
+	Texture::SamplerParams m_sampler_params;
+	mutable uint32_t      m_sampler = 0;
+	mutable uint32_t      m_sampler_generation = 0;
 	Texture::SwizzleMask  m_swizzle_mask{};
-	Texture::MagFilter    m_mag_filter = Texture::MagFilter::Linear;
-	Texture::MinFilter    m_min_filter = Texture::MinFilter::LinearMipMapLinear;
-	Texture::Wrapping     m_wrapping_s = Texture::Wrapping::Repeat;
-	Texture::Wrapping     m_wrapping_t = Texture::Wrapping::Repeat;
-	uint8_t               m_anisotropic_samples = 16; // min value required by spec
 };
 
 namespace Texture {
 	bool bind_to_unit(const ImageTexture2D& texture, uint32_t unit) noexcept;
+	bool bindless_supported() noexcept;
 }
 
 } // namespace rc
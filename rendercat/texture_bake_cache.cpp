@@ -0,0 +1,225 @@
+#include <rendercat/texture_bake_cache.hpp>
+#include <rendercat/util/file_io.hpp>
+#include <rendercat/util/unique_file_handle.hpp>
+#include <fmt/core.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include <glbinding/gl45core/bitfield.h>
+#include <glbinding/gl45core/enum.h>
+#include <glbinding/gl45core/functions.h>
+
+#include <tracy/Tracy.hpp>
+
+using namespace gl45core;
+using namespace rc;
+using namespace rc::Texture;
+
+namespace {
+
+constexpr char     magic[4] = {'R','C','B','K'};
+constexpr uint32_t version = 1;
+
+struct Header
+{
+	char     magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t target;
+	uint32_t internal_format;
+	uint32_t encoding;
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth; // layers of array textures, 6 per cube
+	uint32_t levels;
+	uint32_t reserved;
+};
+
+struct PixelFormat
+{
+	GLenum format;
+	GLenum type;
+};
+
+PixelFormat pixel_format(BakeCache::Encoding encoding)
+{
+	switch (encoding) {
+	case BakeCache::Encoding::RGB9E5:
+		return {GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV};
+	case BakeCache::Encoding::RG16F:
+		return {GL_RG, GL_HALF_FLOAT};
+	}
+	return {GL_NONE, GL_NONE};
+}
+
+// both encodings happen to be 4 bytes per texel
+constexpr size_t texel_size = 4;
+
+template<typename T>
+size_t level_size(const T& layout, uint32_t level)
+{
+	const size_t width = std::max(layout.width >> level, 1u);
+	const size_t height = std::max(layout.height >> level, 1u);
+	return width * height * layout.depth * texel_size;
+}
+
+bool supported_target(GLenum target)
+{
+	return target == GL_TEXTURE_2D || target == GL_TEXTURE_2D_ARRAY || target == GL_TEXTURE_CUBE_MAP_ARRAY;
+}
+
+std::filesystem::path entry_path(uint64_t key)
+{
+	return std::filesystem::path("cache/baked") / fmt::format("{:016x}.bin", key);
+}
+
+}
+
+uint64_t BakeCache::key(std::initializer_list<uint64_t> parts) noexcept
+{
+	// FNV-1a over little-endian words, version first so format changes invalidate entries
+	uint64_t h = 14695981039346656037ull;
+	auto append = [&h](uint64_t word)
+	{
+		for (int i = 0; i < 8; ++i) {
+			h ^= (word >> (i * 8)) & 0xffu;
+			h *= 1099511628211ull;
+		}
+	};
+	append(version);
+	for (auto part : parts)
+		append(part);
+	return h;
+}
+
+bool BakeCache::save(uint64_t key, const texture_handle& texture, Encoding encoding)
+{
+	ZoneScoped;
+	if (!texture)
+		return false;
+
+	Header header{};
+	std::memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.key = key;
+	header.encoding = static_cast<uint32_t>(encoding);
+
+	GLint target = 0, levels = 0, internal_format = 0, width = 0, height = 0, depth = 0;
+	glGetTextureParameteriv(*texture, GL_TEXTURE_TARGET, &target);
+	glGetTextureParameteriv(*texture, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+	glGetTextureLevelParameteriv(*texture, 0, GL_TEXTURE_INTERNAL_FORMAT, &internal_format);
+	glGetTextureLevelParameteriv(*texture, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTextureLevelParameteriv(*texture, 0, GL_TEXTURE_HEIGHT, &height);
+	glGetTextureLevelParameteriv(*texture, 0, GL_TEXTURE_DEPTH, &depth);
+	if (!supported_target(static_cast<GLenum>(target)) || levels <= 0 || width <= 0 || height <= 0 || depth <= 0) {
+		fmt::print(stderr, "[bake cache] unsupported texture for entry {:016x}\n", key);
+		std::fflush(stderr);
+		return false;
+	}
+	header.target = static_cast<uint32_t>(target);
+	header.internal_format = static_cast<uint32_t>(internal_format);
+	header.width = static_cast<uint32_t>(width);
+	header.height = static_cast<uint32_t>(height);
+	header.depth = static_cast<uint32_t>(depth);
+	header.levels = static_cast<uint32_t>(levels);
+
+	// results of image stores have to be visible to read back
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	const auto pixel = pixel_format(encoding);
+	std::vector<uint8_t> data;
+	for (uint32_t level = 0; level < header.levels; ++level) {
+		const auto offset = data.size();
+		const auto size = level_size(header, level);
+		data.resize(offset + size);
+		glGetTextureImage(*texture, level, pixel.format, pixel.type, static_cast<GLsizei>(size), data.data() + offset);
+	}
+
+	const auto path = entry_path(key);
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+
+	return util::write_file_atomic(path, [&](std::FILE* file)
+	{
+		return std::fwrite(&header, sizeof(header), 1, file) == 1
+		       && std::fwrite(data.data(), 1, data.size(), file) == data.size();
+	});
+}
+
+bool BakeCache::read(uint64_t key, Entry& entry)
+{
+	ZoneScoped;
+	rc::file_handle file(std::fopen(entry_path(key).u8string().data(), "rb"));
+	if (!file)
+		return false;
+
+	Header header{};
+	if (std::fread(&header, sizeof(header), 1, *file) != 1
+	    || std::memcmp(header.magic, magic, sizeof(magic)) != 0
+	    || header.version != version
+	    || header.key != key
+	    || header.encoding > static_cast<uint32_t>(Encoding::RG16F)
+	    || !supported_target(static_cast<GLenum>(header.target))
+	    || header.levels == 0 || header.width == 0 || header.height == 0 || header.depth == 0)
+		return false;
+
+	size_t total = 0;
+	for (uint32_t level = 0; level < header.levels; ++level)
+		total += level_size(header, level);
+
+	entry.data.resize(total);
+	if (std::fread(entry.data.data(), 1, entry.data.size(), *file) != entry.data.size())
+		return false;
+
+	entry.target = header.target;
+	entry.internal_format = header.internal_format;
+	entry.encoding = static_cast<Encoding>(header.encoding);
+	entry.width = header.width;
+	entry.height = header.height;
+	entry.depth = header.depth;
+	entry.levels = header.levels;
+	return true;
+}
+
+bool BakeCache::create(const Entry& entry, texture_handle& texture)
+{
+	ZoneScoped;
+	const auto target = static_cast<GLenum>(entry.target);
+	const auto internal_format = static_cast<GLenum>(entry.internal_format);
+	const auto pixel = pixel_format(entry.encoding);
+
+	size_t total = 0;
+	for (uint32_t level = 0; level < entry.levels; ++level)
+		total += level_size(entry, level);
+	if (!supported_target(target) || entry.levels == 0 || entry.data.size() != total)
+		return false;
+
+	rc::texture_handle tex;
+	glCreateTextures(target, 1, tex.get());
+	if (target == GL_TEXTURE_2D)
+		glTextureStorage2D(*tex, entry.levels, internal_format, entry.width, entry.height);
+	else
+		glTextureStorage3D(*tex, entry.levels, internal_format, entry.width, entry.height, entry.depth);
+
+	size_t offset = 0;
+	for (uint32_t level = 0; level < entry.levels; ++level) {
+		const auto width = std::max(entry.width >> level, 1u);
+		const auto height = std::max(entry.height >> level, 1u);
+		if (target == GL_TEXTURE_2D)
+			glTextureSubImage2D(*tex, level, 0, 0, width, height, pixel.format, pixel.type, entry.data.data() + offset);
+		else
+			glTextureSubImage3D(*tex, level, 0, 0, 0, width, height, entry.depth, pixel.format, pixel.type, entry.data.data() + offset);
+		offset += level_size(entry, level);
+	}
+
+	texture = std::move(tex);
+	return true;
+}
+
+bool BakeCache::load(uint64_t key, texture_handle& texture)
+{
+	Entry entry;
+	return read(key, entry) && create(entry, texture);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <rendercat/util/gl_unique_handle.hpp>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+namespace rc::Texture::BakeCache {
+
+// Texel encoding of cache entries, conversion is done by driver on read back and upload.
+enum class Encoding : uint32_t
+{
+	RGB9E5, // shared exponent HDR color, alpha is dropped
+	RG16F
+};
+
+// Combines hashes of everything result depends on: sources, shaders, sizes.
+uint64_t key(std::initializer_list<uint64_t> parts) noexcept;
+
+// Reads back every level and layer of texture produced on GPU and stores it in
+// cache/baked. Stalls until texture is ready, so only meant for cache misses.
+bool save(uint64_t key, const texture_handle& texture, Encoding encoding);
+
+// Layout and texels of cache entry.
+struct Entry
+{
+	uint32_t target = 0;
+	uint32_t internal_format = 0;
+	Encoding encoding = Encoding::RGB9E5;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t depth = 0; // layers of array textures, 6 per cube
+	uint32_t levels = 0;
+	std::vector<uint8_t> data;
+};
+
+// Reads entry without touching GL, so it may run on worker thread.
+bool read(uint64_t key, Entry& entry);
+
+// Recreates texture with target, internal format and levels of saved one.
+// Texture parameters and label are left to caller.
+bool create(const Entry& entry, texture_handle& texture);
+
+bool load(uint64_t key, texture_handle& texture);
+
+}
@@ -1,7 +1,17 @@
 #include <rendercat/texture_cache.hpp>
+#include <rendercat/texture_cooker.hpp>
+#include <fmt/core.h>
+#include <algorithm>
+#include <cstring>
 #include <unordered_map>
 #include <filesystem>
+#include <vector>
 
+#include <tracy/Tracy.hpp>
+
+using namespace rc;
+
+namespace {
 
 class TextureCache
 {
@@ -19,37 +29,233 @@ public:
 	void clear()
 	{
 		m_cache.clear();
+		m_path_keys.clear();
+		m_bytes = 0;
 	}
 
-	void add(const std::filesystem::path& path, rc::ImageTexture2D&& tex)
+	// Entry is keyed by file identity until streamer reports content hash of the file.
+	void add(const std::filesystem::path& path, uint64_t variant, ImageTexture2D&& tex)
 	{
-		m_cache.emplace(std::make_pair(path, std::move(tex)));
+		uint64_t id = 0;
+		if (!identity_key(path, variant, id))
+			return;
+
+		auto [pos, inserted] = m_cache.try_emplace(id);
+		if (inserted) {
+			pos->second.texture = std::move(tex);
+			pos->second.name = path.u8string();
+			pos->second.variant = variant;
+			pos->second.pending = true;
+			m_path_keys[id] = id;
+		}
 	}
 
-	rc::ImageTexture2D* get(const std::filesystem::path& path)
+	ImageTexture2D get(const std::filesystem::path& path, uint64_t variant)
 	{
-		auto pos = m_cache.find(path);
-		if(pos != m_cache.end())
-			return &pos->second;
-		return nullptr;
+		ZoneScoped;
+		uint64_t id = 0;
+		if (identity_key(path, variant, id)) {
+			auto key = m_path_keys.find(id);
+			auto pos = key != m_path_keys.end() ? m_cache.find(key->second) : m_cache.end();
+			if (pos != m_cache.end()) {
+				++m_hits;
+				return pos->second.texture.share();
+			}
+		}
+		++m_misses;
+		return ImageTexture2D();
 	}
 
+	void update()
+	{
+		ZoneScoped;
+		resolve_pending();
+
+		struct Candidate
+		{
+			uint64_t key;
+			uint64_t last_bound;
+			size_t   bytes;
+		};
+		std::vector<Candidate> candidates;
+
+		size_t total = 0;
+		uint32_t pinned = 0;
+		for (const auto& [key, entry] : m_cache) {
+			const auto bytes = entry.memory_size();
+			total += bytes;
+
+			// the only reference to stream state is our own view, so nobody samples this texture
+			const auto& state = entry.texture.stream_state();
+			if (state && state.use_count() == 1) {
+				candidates.push_back(Candidate{key, state->last_bound, bytes});
+			} else {
+				++pinned;
+			}
+		}
+
+		if (total > m_budget) {
+			std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b)
+			{
+				return a.last_bound < b.last_bound;
+			});
+
+			bool evicted = false;
+			for (const auto& c : candidates) {
+				if (total <= m_budget)
+					break;
+				m_cache.erase(c.key);
+				total -= c.bytes;
+				++m_evictions;
+				evicted = true;
+			}
+
+			// paths of evicted entries are looked up and hashed again on next load
+			if (evicted) {
+				for (auto it = m_path_keys.begin(); it != m_path_keys.end();) {
+					if (m_cache.count(it->second))
+						++it;
+					else
+						it = m_path_keys.erase(it);
+				}
+			}
+		}
+
+		m_bytes = total;
+		m_pinned = pinned;
+	}
+
+	Texture::Cache::Stats stats() const noexcept
+	{
+		Texture::Cache::Stats s;
+		s.entries = m_cache.size();
+		s.pinned = m_pinned;
+		s.bytes = m_bytes;
+		s.hits = m_hits;
+		s.misses = m_misses;
+		s.dedupes = m_dedupes;
+		s.evictions = m_evictions;
+		return s;
+	}
+
+	// Distinguishes loads of the same file that produce different textures.
+	static uint64_t variant(Texture::ColorSpace colorspace, Texture::Kind kind, float alpha_cutoff)
+	{
+		uint32_t cutoff_bits;
+		std::memcpy(&cutoff_bits, &alpha_cutoff, sizeof(cutoff_bits));
+		const uint64_t extra = (uint64_t(cutoff_bits) << 32) | (uint64_t(colorspace) << 16) | uint64_t(kind);
+		return extra * 0x9E3779B97F4A7C15ull;
+	}
+
+
+	size_t m_budget = 1024 * 1024 * 1024;
+
 private:
-	std::unordered_map<std::filesystem::path::string_type, rc::ImageTexture2D> m_cache;
+	struct Entry
+	{
+		ImageTexture2D texture;
+		std::string    name;
+		uint64_t       variant = 0;
+		bool           pending = false; // content hash not known yet
+
+		size_t memory_size() const noexcept
+		{
+			// mip-streamed textures own storage holding only resident levels
+			const auto& state = texture.stream_state();
+			if (state && state->mip_streamed)
+				return state->storage.memory_size();
+			return texture.storage().memory_size();
+		}
+	};
+
+	// Path, size and modification time stand in for contents until these are hashed,
+	// so lookups don't read files.
+	static bool identity_key(const std::filesystem::path& path, uint64_t variant, uint64_t& key)
+	{
+		std::error_code ec;
+		const auto size = std::filesystem::file_size(path, ec);
+		if (ec)
+			return false;
+		const auto mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+		if (ec)
+			return false;
+
+		const auto& str = path.native();
+		const uint64_t stat[] = {static_cast<uint64_t>(size), static_cast<uint64_t>(mtime)};
+		key = Texture::content_hash(str.data(), str.size() * sizeof(str[0]))
+		      ^ Texture::content_hash(stat, sizeof(stat)) ^ variant;
+		return true;
+	}
+
+	// Re-keys entries by contents once streamer has hashed their files. Entry whose
+	// contents are already cached under another path is dropped, later loads of its
+	// path share the existing texture instead.
+	void resolve_pending()
+	{
+		std::vector<std::pair<uint64_t, uint64_t>> resolved; // identity key -> content key
+		for (const auto& [key, entry] : m_cache) {
+			const auto& state = entry.texture.stream_state();
+			if (entry.pending && state && state->content_hash)
+				resolved.emplace_back(key, state->content_hash ^ entry.variant);
+		}
+
+		for (const auto& [id, key] : resolved) {
+			auto node = m_cache.extract(id);
+			if (m_cache.count(key)) {
+				++m_dedupes;
+			} else {
+				node.key() = key;
+				node.mapped().pending = false;
+				m_cache.insert(std::move(node));
+			}
+			m_path_keys[id] = key;
+		}
+	}
+
+	std::unordered_map<uint64_t, Entry>    m_cache;
+	std::unordered_map<uint64_t, uint64_t> m_path_keys; // identity key -> cache key
+	uint64_t m_bytes = 0;
+	uint64_t m_hits = 0;
+	uint64_t m_misses = 0;
+	uint64_t m_dedupes = 0;
+	uint64_t m_evictions = 0;
+	uint32_t m_pinned = 0;
 };
 
+} // namespace
+
 
 void rc::Texture::Cache::clear()
 {
 	TextureCache::instance().clear();
 }
 
-void rc::Texture::Cache::add(const std::filesystem::path& path, rc::ImageTexture2D && tex)
+void rc::Texture::Cache::add(const std::filesystem::path& path, ColorSpace colorspace, Kind kind, float alpha_cutoff, rc::ImageTexture2D&& tex)
+{
+	TextureCache::instance().add(path, TextureCache::variant(colorspace, kind, alpha_cutoff), std::move(tex));
+}
+
+rc::ImageTexture2D rc::Texture::Cache::get(const std::filesystem::path& path, ColorSpace colorspace, Kind kind, float alpha_cutoff)
+{
+	return TextureCache::instance().get(path, TextureCache::variant(colorspace, kind, alpha_cutoff));
+}
+
+void rc::Texture::Cache::update()
+{
+	TextureCache::instance().update();
+}
+
+void rc::Texture::Cache::set_budget(size_t bytes) noexcept
+{
+	TextureCache::instance().m_budget = bytes;
+}
+
+size_t rc::Texture::Cache::budget() noexcept
 {
-	TextureCache::instance().add(path, std::move(tex));
+	return TextureCache::instance().m_budget;
 }
 
-rc::ImageTexture2D* rc::Texture::Cache::get(const std::filesystem::path& path)
+rc::Texture::Cache::Stats rc::Texture::Cache::stats() noexcept
 {
-	return TextureCache::instance().get(path);
+	return TextureCache::instance().stats();
 }
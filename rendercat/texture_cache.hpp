@@ -4,10 +4,41 @@
 
 namespace rc::Texture::Cache {
 
+struct Stats
+{
+	uint32_t entries = 0;
+	uint32_t pinned = 0;    // entries with views still in use
+	uint64_t bytes = 0;     // approximate video memory of all entries
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t dedupes = 0;   // loaded paths whose contents turned out to be cached under another path
+	uint64_t evictions = 0;
+};
+
+// Releases all entries. Must be called on render thread before GL context is destroyed.
 void clear();
 
-void add(const std::filesystem::path&, rc::ImageTexture2D&& tex);
+// Textures are keyed by file contents, so identical images under different paths
+// share one storage. Contents are hashed by streamer while decoding, until then
+// entry is keyed by path, size and modification time. Identical images loaded
+// before either was hashed, e.g. by the same model, get separate storage. Later
+// loads share one of them, the other is freed once its views are released.
+// Same file loaded with different kind, colorspace or alpha cutoff is a separate
+// entry, since its mips differ.
+void add(const std::filesystem::path& path, ColorSpace colorspace, Kind kind, float alpha_cutoff, rc::ImageTexture2D&& tex);
+
+// Returns new view of cached texture, or invalid texture if there is none.
+ImageTexture2D get(const std::filesystem::path& path, ColorSpace colorspace, Kind kind, float alpha_cutoff);
+
+// Evicts least recently bound textures nobody holds views of while over budget.
+// Textures not loaded through streamer have no stream state to tell if they are in
+// use, so they are never evicted nor deduplicated.
+// Must be called once per frame on render thread.
+void update();
+
+void   set_budget(size_t bytes) noexcept;
+size_t budget() noexcept;
 
-ImageTexture2D* get(const std::filesystem::path& path);
+Stats stats() noexcept;
 
 }
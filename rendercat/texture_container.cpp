@@ -0,0 +1,323 @@
+#include <rendercat/texture_container.hpp>
+#include <rendercat/common.hpp>
+#include <rendercat/util/unique_file_handle.hpp>
+#include <fmt/core.h>
+#include <algorithm>
+#include <cstring>
+
+#include <tracy/Tracy.hpp>
+
+using namespace rc;
+using namespace rc::Texture;
+
+namespace {
+
+constexpr uint32_t make_fourcc(char a, char b, char c, char d) noexcept
+{
+	return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+}
+
+struct DDSPixelFormat
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourcc;
+	uint32_t rgb_bit_count;
+	uint32_t r_mask, g_mask, b_mask, a_mask;
+};
+
+struct DDSHeader
+{
+	uint32_t       size;
+	uint32_t       flags;
+	uint32_t       height;
+	uint32_t       width;
+	uint32_t       pitch_or_linear_size;
+	uint32_t       depth;
+	uint32_t       mip_map_count;
+	uint32_t       reserved1[11];
+	DDSPixelFormat pixel_format;
+	uint32_t       caps, caps2, caps3, caps4;
+	uint32_t       reserved2;
+};
+static_assert(sizeof(DDSHeader) == 124);
+
+struct DDSHeaderDX10
+{
+	uint32_t dxgi_format;
+	uint32_t resource_dimension;
+	uint32_t misc_flag;
+	uint32_t array_size;
+	uint32_t misc_flags2;
+};
+static_assert(sizeof(DDSHeaderDX10) == 20);
+
+constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+constexpr uint32_t DDPF_FOURCC = 0x4;
+constexpr uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+constexpr uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+struct KTX2Header
+{
+	uint8_t  identifier[12];
+	uint32_t vk_format;
+	uint32_t type_size;
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	uint32_t layer_count;
+	uint32_t face_count;
+	uint32_t level_count;
+	uint32_t supercompression_scheme;
+	uint32_t dfd_offset, dfd_length;
+	uint32_t kvd_offset, kvd_length;
+	uint64_t sgd_offset, sgd_length;
+};
+static_assert(sizeof(KTX2Header) == 80);
+
+struct KTX2Level
+{
+	uint64_t offset;
+	uint64_t length;
+	uint64_t uncompressed_length;
+};
+
+constexpr uint8_t ktx2_identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+
+InternalFormat from_dxgi_format(uint32_t dxgi) noexcept
+{
+	switch (dxgi) {
+	case 71: return InternalFormat::Compressed_RGBA_DXT1;              // BC1_UNORM
+	case 72: return InternalFormat::Compressed_SRGB_ALPHA_DXT1;        // BC1_UNORM_SRGB
+	case 74: return InternalFormat::Compressed_RGBA_DXT3;              // BC2_UNORM
+	case 75: return InternalFormat::Compressed_SRGB_ALPHA_DXT3;        // BC2_UNORM_SRGB
+	case 77: return InternalFormat::Compressed_RGBA_DXT5;              // BC3_UNORM
+	case 78: return InternalFormat::Compressed_SRGB_ALPHA_DXT5;        // BC3_UNORM_SRGB
+	case 80: return InternalFormat::Compressed_RED_RGTC1;              // BC4_UNORM
+	case 81: return InternalFormat::Compressed_SIGNED_RED_RGTC1;       // BC4_SNORM
+	case 83: return InternalFormat::Compressed_RG_RGTC2;               // BC5_UNORM
+	case 84: return InternalFormat::Compressed_SIGNED_RG_RGTC2;        // BC5_SNORM
+	case 95: return InternalFormat::Compressed_RGB_BPTC_UNSIGNED_FLOAT; // BC6H_UF16
+	case 96: return InternalFormat::Compressed_RGB_BPTC_SIGNED_FLOAT;  // BC6H_SF16
+	case 98: return InternalFormat::Compressed_RGBA_BPTC_UNORM;        // BC7_UNORM
+	case 99: return InternalFormat::Compressed_SRGB_ALPHA_BPTC_UNORM;  // BC7_UNORM_SRGB
+	default: break;
+	}
+	return InternalFormat::InvalidFormat;
+}
+
+InternalFormat from_fourcc(uint32_t fourcc) noexcept
+{
+	switch (fourcc) {
+	case make_fourcc('D', 'X', 'T', '1'): return InternalFormat::Compressed_RGBA_DXT1;
+	case make_fourcc('D', 'X', 'T', '3'): return InternalFormat::Compressed_RGBA_DXT3;
+	case make_fourcc('D', 'X', 'T', '5'): return InternalFormat::Compressed_RGBA_DXT5;
+	case make_fourcc('A', 'T', 'I', '1'):
+	case make_fourcc('B', 'C', '4', 'U'): return InternalFormat::Compressed_RED_RGTC1;
+	case make_fourcc('B', 'C', '4', 'S'): return InternalFormat::Compressed_SIGNED_RED_RGTC1;
+	case make_fourcc('A', 'T', 'I', '2'):
+	case make_fourcc('B', 'C', '5', 'U'): return InternalFormat::Compressed_RG_RGTC2;
+	case make_fourcc('B', 'C', '5', 'S'): return InternalFormat::Compressed_SIGNED_RG_RGTC2;
+	default: break;
+	}
+	return InternalFormat::InvalidFormat;
+}
+
+InternalFormat from_vk_format(uint32_t vk) noexcept
+{
+	switch (vk) {
+	case 131: return InternalFormat::Compressed_RGB_DXT1;               // BC1_RGB_UNORM_BLOCK
+	case 132: return InternalFormat::Compressed_SRGB_DXT1;              // BC1_RGB_SRGB_BLOCK
+	case 133: return InternalFormat::Compressed_RGBA_DXT1;              // BC1_RGBA_UNORM_BLOCK
+	case 134: return InternalFormat::Compressed_SRGB_ALPHA_DXT1;        // BC1_RGBA_SRGB_BLOCK
+	case 135: return InternalFormat::Compressed_RGBA_DXT3;              // BC2_UNORM_BLOCK
+	case 136: return InternalFormat::Compressed_SRGB_ALPHA_DXT3;        // BC2_SRGB_BLOCK
+	case 137: return InternalFormat::Compressed_RGBA_DXT5;              // BC3_UNORM_BLOCK
+	case 138: return InternalFormat::Compressed_SRGB_ALPHA_DXT5;        // BC3_SRGB_BLOCK
+	case 139: return InternalFormat::Compressed_RED_RGTC1;              // BC4_UNORM_BLOCK
+	case 140: return InternalFormat::Compressed_SIGNED_RED_RGTC1;       // BC4_SNORM_BLOCK
+	case 141: return InternalFormat::Compressed_RG_RGTC2;               // BC5_UNORM_BLOCK
+	case 142: return InternalFormat::Compressed_SIGNED_RG_RGTC2;        // BC5_SNORM_BLOCK
+	case 143: return InternalFormat::Compressed_RGB_BPTC_UNSIGNED_FLOAT; // BC6H_UFLOAT_BLOCK
+	case 144: return InternalFormat::Compressed_RGB_BPTC_SIGNED_FLOAT;  // BC6H_SFLOAT_BLOCK
+	case 145: return InternalFormat::Compressed_RGBA_BPTC_UNORM;        // BC7_UNORM_BLOCK
+	case 146: return InternalFormat::Compressed_SRGB_ALPHA_BPTC_UNORM;  // BC7_SRGB_BLOCK
+	default: break;
+	}
+	return InternalFormat::InvalidFormat;
+}
+
+// Asset pipelines often store color textures as UNORM and leave colorspace to the engine.
+InternalFormat to_srgb(InternalFormat format) noexcept
+{
+	switch (format) {
+	case InternalFormat::Compressed_RGB_DXT1:        return InternalFormat::Compressed_SRGB_DXT1;
+	case InternalFormat::Compressed_RGBA_DXT1:       return InternalFormat::Compressed_SRGB_ALPHA_DXT1;
+	case InternalFormat::Compressed_RGBA_DXT3:       return InternalFormat::Compressed_SRGB_ALPHA_DXT3;
+	case InternalFormat::Compressed_RGBA_DXT5:       return InternalFormat::Compressed_SRGB_ALPHA_DXT5;
+	case InternalFormat::Compressed_RGBA_BPTC_UNORM: return InternalFormat::Compressed_SRGB_ALPHA_BPTC_UNORM;
+	default: break;
+	}
+	return format;
+}
+
+bool init_levels(CookedImage& image, InternalFormat format, uint32_t width, uint32_t height, uint32_t num_levels)
+{
+	const uint32_t stride = compressed_block_size(format);
+	if (stride == 0
+	    || width == 0 || height == 0
+	    || width > UINT16_MAX || height > UINT16_MAX
+	    || num_levels == 0 || num_levels > rc::math::num_mipmap_levels(width, height))
+		return false;
+
+	image.format = format;
+	image.width = width;
+	image.height = height;
+	image.levels.clear();
+
+	uint32_t offset = 0;
+	for (uint32_t level = 0; level < num_levels; ++level) {
+		const uint16_t w = std::max(1u, width >> level);
+		const uint16_t h = std::max(1u, height >> level);
+		const uint32_t size = ((w + 3) / 4) * ((h + 3) / 4) * stride;
+		image.levels.push_back(CookedImage::Level{w, h, offset, size});
+		offset += size;
+	}
+	return true;
+}
+
+size_t total_size(const CookedImage& image) noexcept
+{
+	return image.levels.empty() ? 0 : image.levels.back().offset + image.levels.back().size;
+}
+
+
+bool load_dds(std::FILE* file, ColorSpace colorspace, CookedImage& image, bool header_only)
+{
+	uint32_t magic = 0;
+	DDSHeader header;
+	if (std::fread(&magic, sizeof(magic), 1, file) != 1
+	    || magic != make_fourcc('D', 'D', 'S', ' ')
+	    || std::fread(&header, sizeof(header), 1, file) != 1
+	    || header.size != sizeof(DDSHeader)
+	    || !(header.pixel_format.flags & DDPF_FOURCC))
+		return false;
+
+	InternalFormat format = InternalFormat::InvalidFormat;
+	if (header.pixel_format.fourcc == make_fourcc('D', 'X', '1', '0')) {
+		DDSHeaderDX10 dx10;
+		if (std::fread(&dx10, sizeof(dx10), 1, file) != 1
+		    || dx10.resource_dimension != DDS_DIMENSION_TEXTURE2D
+		    || dx10.array_size > 1
+		    || (dx10.misc_flag & DDS_RESOURCE_MISC_TEXTURECUBE))
+			return false;
+		format = from_dxgi_format(dx10.dxgi_format);
+	} else {
+		format = from_fourcc(header.pixel_format.fourcc);
+	}
+
+	if (colorspace == ColorSpace::sRGB)
+		format = to_srgb(format);
+
+	const uint32_t num_levels = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(header.mip_map_count, 1u) : 1u;
+	if (!init_levels(image, format, header.width, header.height, num_levels))
+		return false;
+
+	// mip levels follow header back to back, largest first
+	const long data_start = std::ftell(file);
+	image.file_offsets.clear();
+	for (const auto& level : image.levels)
+		image.file_offsets.push_back(data_start + level.offset);
+
+	if (header_only)
+		return true;
+
+	image.data.resize(total_size(image));
+	return std::fread(image.data.data(), 1, image.data.size(), file) == image.data.size();
+}
+
+
+bool load_ktx2(std::FILE* file, ColorSpace colorspace, CookedImage& image, bool header_only)
+{
+	KTX2Header header;
+	if (std::fread(&header, sizeof(header), 1, file) != 1
+	    || std::memcmp(header.identifier, ktx2_identifier, sizeof(ktx2_identifier)) != 0
+	    || header.depth > 1
+	    || header.layer_count > 1
+	    || header.face_count != 1
+	    || header.supercompression_scheme != 0)
+		return false;
+
+	auto format = from_vk_format(header.vk_format);
+	if (colorspace == ColorSpace::sRGB)
+		format = to_srgb(format);
+
+	const uint32_t num_levels = std::max(header.level_count, 1u);
+	if (!init_levels(image, format, header.width, header.height, num_levels))
+		return false;
+
+	std::vector<KTX2Level> level_index(num_levels);
+	if (std::fread(level_index.data(), sizeof(KTX2Level), num_levels, file) != num_levels)
+		return false;
+
+	image.file_offsets.clear();
+	for (uint32_t i = 0; i < num_levels; ++i) {
+		if (level_index[i].length != image.levels[i].size)
+			return false;
+		image.file_offsets.push_back(level_index[i].offset);
+	}
+
+	if (header_only)
+		return true;
+
+	// level index is ordered largest first, but data is usually stored smallest first
+	image.data.resize(total_size(image));
+	for (uint32_t i = 0; i < num_levels; ++i) {
+		const auto& level = image.levels[i];
+		if (std::fseek(file, static_cast<long>(level_index[i].offset), SEEK_SET) != 0
+		    || std::fread(image.data.data() + level.offset, 1, level.size, file) != level.size)
+			return false;
+	}
+	return true;
+}
+
+std::string lowercase_extension(const std::filesystem::path& path)
+{
+	auto ext = path.extension().u8string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](auto ch){ return std::tolower(ch); });
+	return ext;
+}
+
+} // namespace
+
+
+bool rc::Texture::is_container_file(const std::filesystem::path& path)
+{
+	const auto ext = lowercase_extension(path);
+	return ext == ".dds" || ext == ".ktx2";
+}
+
+
+bool rc::Texture::load_container(const std::filesystem::path& path,
+                                 ColorSpace colorspace,
+                                 CookedImage& image,
+                                 bool header_only)
+{
+	ZoneScoped;
+	rc::file_handle file(std::fopen(path.u8string().data(), "rb"));
+	if (!file) {
+		fmt::print(stderr, "[texture.container] could not open [{}]\n", path.u8string());
+		std::fflush(stderr);
+		return false;
+	}
+
+	const bool ok = lowercase_extension(path) == ".dds"
+	                ? load_dds(*file, colorspace, image, header_only)
+	                : load_ktx2(*file, colorspace, image, header_only);
+	if (!ok) {
+		fmt::print(stderr, "[texture.container] unsupported or corrupt texture container [{}]\n", path.u8string());
+		std::fflush(stderr);
+	}
+	return ok;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <rendercat/texture_cooker.hpp>
+#include <filesystem>
+
+namespace rc::Texture {
+
+// True for files with .dds or .ktx2 extension.
+bool is_container_file(const std::filesystem::path& path);
+
+// Reads block-compressed 2D texture with its mip chain from DDS or KTX2 container.
+// Levels are returned tightly packed in CookedImage layout. With header_only set,
+// only format, dimensions and level sizes are filled in.
+// UNORM color formats are promoted to their sRGB variants if colorspace is sRGB.
+bool load_container(const std::filesystem::path& path,
+                    ColorSpace colorspace,
+                    CookedImage& image,
+                    bool header_only = false);
+
+}
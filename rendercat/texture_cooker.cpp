@@ -0,0 +1,446 @@
+#include <rendercat/texture_cooker.hpp>
+#include <rendercat/common.hpp>
+#include <rendercat/util/file_io.hpp>
+#include <rendercat/util/unique_file_handle.hpp>
+#include <fmt/core.h>
+#include <algorithm>
+#include <cstring>
+
+#include <tracy/Tracy.hpp>
+
+using namespace rc;
+using namespace rc::Texture;
+
+namespace {
+
+constexpr char     cooked_magic[4] = {'R', 'C', 'T', 'X'};
+constexpr uint32_t cooked_version = 2;
+
+struct CookedHeader
+{
+	char     magic[4];
+	uint32_t version;
+	uint32_t format;
+	uint16_t width;
+	uint16_t height;
+	uint32_t num_levels;
+};
+
+// 4x4 texels, RGBA8
+struct Block
+{
+	uint8_t px[16][4];
+};
+
+void fetch_block(const uint8_t* rgba, int width, int height, int bx, int by, Block& block) noexcept
+{
+	// edge blocks repeat last row/column, so padding texels don't skew endpoints
+	for (int y = 0; y < 4; ++y) {
+		const int sy = std::min(by * 4 + y, height - 1);
+		for (int x = 0; x < 4; ++x) {
+			const int sx = std::min(bx * 4 + x, width - 1);
+			std::memcpy(block.px[y * 4 + x], rgba + (size_t(sy) * width + sx) * 4, 4);
+		}
+	}
+}
+
+void write_le(uint8_t* out, uint64_t value, int bytes) noexcept
+{
+	for (int i = 0; i < bytes; ++i)
+		out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+uint16_t pack_565(const float c[3]) noexcept
+{
+	auto quantize = [](float v, int max) {
+		return static_cast<uint16_t>(std::clamp(static_cast<int>(v * max / 255.0f + 0.5f), 0, max));
+	};
+	return (quantize(c[0], 31) << 11) | (quantize(c[1], 63) << 5) | quantize(c[2], 31);
+}
+
+void unpack_565(uint16_t v, int out[3]) noexcept
+{
+	const int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	out[0] = (r << 3) | (r >> 2);
+	out[1] = (g << 2) | (g >> 4);
+	out[2] = (b << 3) | (b >> 2);
+}
+
+// Endpoints are fit along principal axis of block colors. Loops over the 16 texels
+// have fixed trip counts so the compiler can unroll and vectorize them.
+void encode_bc1(const Block& block, uint8_t* out) noexcept
+{
+	float mean[3] = {};
+	for (int i = 0; i < 16; ++i) {
+		for (int c = 0; c < 3; ++c)
+			mean[c] += block.px[i][c];
+	}
+	for (auto& m : mean)
+		m *= 1.0f / 16.0f;
+
+	float cov[6] = {};
+	for (int i = 0; i < 16; ++i) {
+		const float r = block.px[i][0] - mean[0];
+		const float g = block.px[i][1] - mean[1];
+		const float b = block.px[i][2] - mean[2];
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+
+	float axis[3] = {1.0f, 1.0f, 1.0f};
+	for (int iter = 0; iter < 8; ++iter) {
+		const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		const float m = std::max({std::abs(x), std::abs(y), std::abs(z)});
+		if (m < 1e-6f)
+			break;
+		axis[0] = x / m; axis[1] = y / m; axis[2] = z / m;
+	}
+
+	float min_proj = 0.0f, max_proj = 0.0f;
+	for (int i = 0; i < 16; ++i) {
+		const float p = (block.px[i][0] - mean[0]) * axis[0]
+		              + (block.px[i][1] - mean[1]) * axis[1]
+		              + (block.px[i][2] - mean[2]) * axis[2];
+		min_proj = std::min(min_proj, p);
+		max_proj = std::max(max_proj, p);
+	}
+
+	const float len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	float c0[3], c1[3];
+	for (int c = 0; c < 3; ++c) {
+		c0[c] = std::clamp(mean[c] + axis[c] * max_proj / len2, 0.0f, 255.0f);
+		c1[c] = std::clamp(mean[c] + axis[c] * min_proj / len2, 0.0f, 255.0f);
+	}
+
+	uint16_t e0 = pack_565(c0);
+	uint16_t e1 = pack_565(c1);
+	if (e0 < e1)
+		std::swap(e0, e1); // e0 > e1 selects 4-color mode
+
+	uint32_t indices = 0;
+	if (e0 != e1) {
+		int palette[4][3];
+		unpack_565(e0, palette[0]);
+		unpack_565(e1, palette[1]);
+		for (int c = 0; c < 3; ++c) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; ++i) {
+			int best = 0, best_dist = INT32_MAX;
+			for (int p = 0; p < 4; ++p) {
+				const int dr = block.px[i][0] - palette[p][0];
+				const int dg = block.px[i][1] - palette[p][1];
+				const int db = block.px[i][2] - palette[p][2];
+				const int dist = dr * dr + dg * dg + db * db;
+				if (dist < best_dist) {
+					best_dist = dist;
+					best = p;
+				}
+			}
+			indices |= uint32_t(best) << (2 * i);
+		}
+	}
+
+	write_le(out, e0, 2);
+	write_le(out + 2, e1, 2);
+	write_le(out + 4, indices, 4);
+}
+
+void encode_bc4(const Block& block, int channel, uint8_t* out) noexcept
+{
+	int lo = 255, hi = 0;
+	for (int i = 0; i < 16; ++i) {
+		lo = std::min<int>(lo, block.px[i][channel]);
+		hi = std::max<int>(hi, block.px[i][channel]);
+	}
+
+	uint64_t indices = 0;
+	if (hi != lo) {
+		// hi > lo selects 8-value interpolation mode
+		int palette[8] = {hi, lo};
+		for (int p = 2; p < 8; ++p)
+			palette[p] = ((8 - p) * hi + (p - 1) * lo + 3) / 7;
+
+		for (int i = 0; i < 16; ++i) {
+			int best = 0, best_dist = INT32_MAX;
+			for (int p = 0; p < 8; ++p) {
+				const int dist = std::abs(block.px[i][channel] - palette[p]);
+				if (dist < best_dist) {
+					best_dist = dist;
+					best = p;
+				}
+			}
+			indices |= uint64_t(best) << (3 * i);
+		}
+	}
+
+	out[0] = static_cast<uint8_t>(hi);
+	out[1] = static_cast<uint8_t>(lo);
+	write_le(out + 2, indices, 6);
+}
+
+// formats the block encoders above can produce
+bool is_encodable(InternalFormat format) noexcept
+{
+	switch (format) {
+	case InternalFormat::Compressed_RGB_DXT1:
+	case InternalFormat::Compressed_SRGB_DXT1:
+	case InternalFormat::Compressed_RED_RGTC1:
+	case InternalFormat::Compressed_RGBA_DXT5:
+	case InternalFormat::Compressed_SRGB_ALPHA_DXT5:
+	case InternalFormat::Compressed_RG_RGTC2:
+		return true;
+	default:
+		break;
+	}
+	return false;
+}
+
+void compress_level(const uint8_t* rgba, int width, int height, InternalFormat format, uint8_t* out) noexcept
+{
+	const int blocks_x = (width + 3) / 4;
+	const int blocks_y = (height + 3) / 4;
+	const size_t stride = compressed_block_size(format);
+
+	Block block;
+	for (int by = 0; by < blocks_y; ++by) {
+		for (int bx = 0; bx < blocks_x; ++bx) {
+			fetch_block(rgba, width, height, bx, by, block);
+			switch (format) {
+			case InternalFormat::Compressed_RGB_DXT1:
+			case InternalFormat::Compressed_SRGB_DXT1:
+				encode_bc1(block, out);
+				break;
+			case InternalFormat::Compressed_RED_RGTC1:
+				encode_bc4(block, 0, out);
+				break;
+			case InternalFormat::Compressed_RGBA_DXT5:
+			case InternalFormat::Compressed_SRGB_ALPHA_DXT5:
+				encode_bc4(block, 3, out);
+				encode_bc1(block, out + 8);
+				break;
+			case InternalFormat::Compressed_RG_RGTC2:
+				encode_bc4(block, 0, out);
+				encode_bc4(block, 1, out + 8);
+				break;
+			default:
+				assert(false);
+				unreachable();
+			}
+			out += stride;
+		}
+	}
+}
+
+} // namespace
+
+
+InternalFormat rc::Texture::cooked_format(Kind kind, int channels, ColorSpace colorspace) noexcept
+{
+	const bool srgb = colorspace == ColorSpace::sRGB;
+	switch (kind) {
+	case Kind::BaseColor:
+		if (channels == 4)
+			return srgb ? InternalFormat::Compressed_SRGB_ALPHA_DXT5 : InternalFormat::Compressed_RGBA_DXT5;
+		if (channels == 3)
+			return srgb ? InternalFormat::Compressed_SRGB_DXT1 : InternalFormat::Compressed_RGB_DXT1;
+		break;
+	case Kind::Normal:
+		if (channels >= 2)
+			return InternalFormat::Compressed_RG_RGTC2;
+		break;
+	case Kind::Emission:
+		if (channels >= 3)
+			return srgb ? InternalFormat::Compressed_SRGB_DXT1 : InternalFormat::Compressed_RGB_DXT1;
+		break;
+	case Kind::RoughnessMetallic:
+	case Kind::Occlusion:
+	case Kind::OcclusionRoughnessMetallic:
+	case Kind::OcclusionSeparate:
+		// channels are independent, BC1 would force them onto shared endpoints per block.
+		// Packed maps stay uncompressed until there is a BC7 encoder.
+		if (channels == 1)
+			return InternalFormat::Compressed_RED_RGTC1;
+		break;
+	case Kind::None:
+		break;
+	}
+	return InternalFormat::InvalidFormat;
+}
+
+
+CookedImage rc::Texture::cook_image(const uint8_t* rgba, uint16_t width, uint16_t height, InternalFormat format, const MipOptions& options)
+{
+	ZoneScoped;
+	CookedImage image;
+	if (!is_encodable(format) || width == 0 || height == 0)
+		return image;
+	const size_t stride = compressed_block_size(format);
+
+	image.format = format;
+	image.width = width;
+	image.height = height;
+
+	const auto mips = generate_mips(rgba, width, height, options);
+	size_t total_size = 0;
+	for (const auto& mip : mips.levels) {
+		const uint32_t size = ((mip.width + 3) / 4) * ((mip.height + 3) / 4) * stride;
+		image.levels.push_back(CookedImage::Level{mip.width, mip.height, static_cast<uint32_t>(total_size), size});
+		total_size += size;
+	}
+	image.data.resize(total_size);
+
+	for (size_t i = 0; i < image.levels.size(); ++i) {
+		ZoneScopedN("compress level");
+		const auto& level = image.levels[i];
+		compress_level(mips.data.data() + mips.levels[i].offset, level.width, level.height, format, image.data.data() + level.offset);
+	}
+	return image;
+}
+
+
+uint64_t rc::Texture::content_hash(const void* data, size_t size) noexcept
+{
+	// FNV-1a
+	auto bytes = static_cast<const uint8_t*>(data);
+	uint64_t h = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i) {
+		h ^= bytes[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+
+std::filesystem::path rc::Texture::cooked_cache_path(uint64_t hash, InternalFormat format)
+{
+	return std::filesystem::path("cache/textures") / fmt::format("{:016x}-{:04x}.rctex", hash, static_cast<uint32_t>(format));
+}
+
+
+bool rc::Texture::load_cooked(const std::filesystem::path& path, CookedImage& image, bool header_only)
+{
+	ZoneScoped;
+	rc::file_handle file(std::fopen(path.u8string().data(), "rb"));
+	if (!file)
+		return false;
+
+	CookedHeader header;
+	if (std::fread(&header, sizeof(header), 1, *file) != 1
+	    || std::memcmp(header.magic, cooked_magic, sizeof(cooked_magic)) != 0
+	    || header.version != cooked_version
+	    || header.num_levels == 0
+	    || header.num_levels > 16) {
+		fmt::print(stderr, "[texture.cooker] ignoring invalid cache file [{}]\n", path.u8string());
+		std::fflush(stderr);
+		return false;
+	}
+
+	image.format = static_cast<InternalFormat>(header.format);
+	image.width = header.width;
+	image.height = header.height;
+	image.levels.resize(header.num_levels);
+	if (std::fread(image.levels.data(), sizeof(CookedImage::Level), header.num_levels, *file) != header.num_levels)
+		return false;
+
+	size_t total_size = 0;
+	for (const auto& level : image.levels) {
+		if (level.offset != total_size)
+			return false;
+		total_size += level.size;
+	}
+
+	const uint64_t data_start = sizeof(header) + sizeof(CookedImage::Level) * header.num_levels;
+	image.file_offsets.clear();
+	for (const auto& level : image.levels)
+		image.file_offsets.push_back(data_start + level.offset);
+
+	if (header_only)
+		return true;
+
+	image.data.resize(total_size);
+	return std::fread(image.data.data(), 1, total_size, *file) == total_size;
+}
+
+
+bool rc::Texture::save_cooked(const std::filesystem::path& path, const CookedImage& image)
+{
+	ZoneScoped;
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+
+	// decoder threads may cook identical images at once, each writes its own temporary
+	const bool saved = rc::util::write_file_atomic(path, [&image](std::FILE* file)
+	{
+		CookedHeader header{};
+		std::memcpy(header.magic, cooked_magic, sizeof(cooked_magic));
+		header.version = cooked_version;
+		header.format = static_cast<uint32_t>(image.format);
+		header.width = image.width;
+		header.height = image.height;
+		header.num_levels = image.levels.size();
+
+		return std::fwrite(&header, sizeof(header), 1, file) == 1
+		       && std::fwrite(image.levels.data(), sizeof(CookedImage::Level), image.levels.size(), file) == image.levels.size()
+		       && std::fwrite(image.data.data(), 1, image.data.size(), file) == image.data.size();
+	});
+	if (!saved) {
+		fmt::print(stderr, "[texture.cooker] could not write cache file [{}]\n", path.u8string());
+		std::fflush(stderr);
+	}
+	return saved;
+}
+
+// -----------------------------------------------------------------------------
+#include <doctest/doctest.h>
+#ifndef DOCTEST_CONFIG_DISABLE
+
+TEST_CASE("Texture cooker BC1 solid and gradient blocks") {
+	uint8_t solid[4 * 4 * 4];
+	for (size_t i = 0; i < std::size(solid); i += 4) {
+		solid[i + 0] = 255; solid[i + 1] = 0; solid[i + 2] = 0; solid[i + 3] = 255;
+	}
+	auto image = cook_image(solid, 4, 4, InternalFormat::Compressed_RGB_DXT1);
+	REQUIRE(image.valid());
+	REQUIRE(image.levels.size() == 3);
+	REQUIRE(image.levels[0].size == 8);
+	// pure red encodes exactly, with all indices pointing to first endpoint
+	REQUIRE(image.data[0] == 0x00);
+	REQUIRE(image.data[1] == 0xF8);
+	REQUIRE(image.data[4] == 0);
+
+	uint8_t ramp[4 * 4 * 4];
+	for (int i = 0; i < 16; ++i) {
+		ramp[i * 4 + 0] = ramp[i * 4 + 1] = ramp[i * 4 + 2] = static_cast<uint8_t>(i * 17);
+		ramp[i * 4 + 3] = 255;
+	}
+	image = cook_image(ramp, 4, 4, InternalFormat::Compressed_RGB_DXT1);
+	uint16_t e0 = image.data[0] | (image.data[1] << 8);
+	uint16_t e1 = image.data[2] | (image.data[3] << 8);
+	REQUIRE(e0 > e1);
+	REQUIRE(e0 == 0xFFFF);
+	REQUIRE(e1 == 0x0000);
+}
+
+TEST_CASE("Texture cooker BC4 endpoints and level layout") {
+	std::vector<uint8_t> rgba(10 * 6 * 4, 0);
+	for (size_t i = 0; i < rgba.size(); i += 4)
+		rgba[i] = static_cast<uint8_t>(i % 256);
+
+	auto image = cook_image(rgba.data(), 10, 6, InternalFormat::Compressed_RED_RGTC1);
+	REQUIRE(image.levels.size() == 4);
+	REQUIRE(image.levels[0].size == 3 * 2 * 8);
+	REQUIRE(image.levels[1].width == 5);
+	REQUIRE(image.levels[1].height == 3);
+	REQUIRE(image.levels[3].width == 1);
+	REQUIRE(image.levels[3].height == 1);
+	REQUIRE(image.data.size() == image.levels[3].offset + image.levels[3].size);
+	// BC4 stores max endpoint first
+	REQUIRE(image.data[0] >= image.data[1]);
+}
+
+#endif
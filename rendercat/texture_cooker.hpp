@@ -0,0 +1,46 @@
+#pragma once
+
+#include <rendercat/texture_mips.hpp>
+#include <filesystem>
+#include <vector>
+
+namespace rc::Texture {
+
+// Block-compressed image with full mip chain, as stored in the on-disk cache.
+struct CookedImage
+{
+	struct Level
+	{
+		uint16_t width = 0;
+		uint16_t height = 0;
+		uint32_t offset = 0;
+		uint32_t size = 0;
+	};
+
+	InternalFormat       format = InternalFormat::InvalidFormat;
+	uint16_t             width = 0;
+	uint16_t             height = 0;
+	std::vector<Level>   levels;
+	std::vector<uint8_t> data;
+	std::vector<uint64_t> file_offsets; // per-level position in source file, if loaded from disk
+
+	bool valid() const noexcept { return !levels.empty() && !data.empty(); }
+};
+
+// Picks block-compressed format for texture of given kind and channel count,
+// or InvalidFormat if texture should be uploaded uncompressed.
+InternalFormat cooked_format(Kind kind, int channels, ColorSpace colorspace) noexcept;
+
+// Compresses tightly packed RGBA8 image, generating full mip chain.
+CookedImage cook_image(const uint8_t* rgba, uint16_t width, uint16_t height, InternalFormat format,
+                       const MipOptions& options = {});
+
+uint64_t content_hash(const void* data, size_t size) noexcept;
+
+std::filesystem::path cooked_cache_path(uint64_t hash, InternalFormat format);
+
+// With header_only set, level data is not read, see CookedImage::file_offsets.
+bool load_cooked(const std::filesystem::path& path, CookedImage& image, bool header_only = false);
+bool save_cooked(const std::filesystem::path& path, const CookedImage& image);
+
+}
@@ -0,0 +1,284 @@
+#include <rendercat/texture_mips.hpp>
+#include <rendercat/common.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RC_MIPS_SSE2 1
+#endif
+
+#include <tracy/Tracy.hpp>
+
+using namespace rc;
+using namespace rc::Texture;
+
+namespace {
+
+constexpr int encode_lut_size = 16384;
+
+struct SrgbTables
+{
+	float   to_linear[256];
+	uint8_t from_linear[encode_lut_size];
+};
+
+const SrgbTables& srgb_tables()
+{
+	static const SrgbTables tables = []
+	{
+		SrgbTables t;
+		for (int i = 0; i < 256; ++i) {
+			const float c = i / 255.0f;
+			t.to_linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < encode_lut_size; ++i) {
+			const float l = i / float(encode_lut_size - 1);
+			const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+			t.from_linear[i] = static_cast<uint8_t>(std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f));
+		}
+		return t;
+	}();
+	return tables;
+}
+
+void decode_row(const uint8_t* src, int width, bool srgb, float* out) noexcept
+{
+	const auto& t = srgb_tables();
+	for (int i = 0; i < width * 4; i += 4) {
+		for (int c = 0; c < 3; ++c)
+			out[i + c] = srgb ? t.to_linear[src[i + c]] : src[i + c] * (1.0f / 255.0f);
+		out[i + 3] = src[i + 3] * (1.0f / 255.0f);
+	}
+}
+
+// Averages 2x2 texel quads of two source rows. Each RGBA texel fits one SSE register.
+void average_rows(const float* r0, const float* r1, int width, int out_width, float* out) noexcept
+{
+#if RC_MIPS_SSE2
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	for (int x = 0; x < out_width; ++x) {
+		const int x0 = std::min(2 * x, width - 1) * 4, x1 = std::min(2 * x + 1, width - 1) * 4;
+		const __m128 top = _mm_add_ps(_mm_loadu_ps(r0 + x0), _mm_loadu_ps(r0 + x1));
+		const __m128 bottom = _mm_add_ps(_mm_loadu_ps(r1 + x0), _mm_loadu_ps(r1 + x1));
+		_mm_storeu_ps(out + x * 4, _mm_mul_ps(_mm_add_ps(top, bottom), quarter));
+	}
+#else
+	for (int x = 0; x < out_width; ++x) {
+		const int x0 = std::min(2 * x, width - 1) * 4, x1 = std::min(2 * x + 1, width - 1) * 4;
+		for (int c = 0; c < 4; ++c)
+			out[x * 4 + c] = (r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c]) * 0.25f;
+	}
+#endif
+}
+
+// Averaged normals get shorter; restore unit length so mips don't look flatter.
+void renormalize(float* px, int count) noexcept
+{
+#if RC_MIPS_SSE2
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 xyz_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	for (int i = 0; i < count; ++i) {
+		const __m128 p = _mm_loadu_ps(px + i * 4);
+		const __m128 v = _mm_and_ps(_mm_sub_ps(_mm_mul_ps(p, two), one), xyz_mask);
+		const __m128 sq = _mm_mul_ps(v, v);
+		__m128 len = _mm_add_ss(_mm_add_ss(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 1, 1, 1))),
+		                        _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 2, 2, 2)));
+		len = _mm_sqrt_ss(len);
+		if (_mm_cvtss_f32(len) < 1e-6f)
+			continue;
+		len = _mm_shuffle_ps(len, len, _MM_SHUFFLE(0, 0, 0, 0));
+		const __m128 n = _mm_add_ps(_mm_mul_ps(_mm_div_ps(v, len), half), half);
+		// keep alpha lane as is
+		_mm_storeu_ps(px + i * 4, _mm_or_ps(_mm_and_ps(xyz_mask, n), _mm_andnot_ps(xyz_mask, p)));
+	}
+#else
+	for (int i = 0; i < count; ++i) {
+		float* p = px + i * 4;
+		const float x = p[0] * 2.0f - 1.0f, y = p[1] * 2.0f - 1.0f, z = p[2] * 2.0f - 1.0f;
+		const float len = std::sqrt(x * x + y * y + z * z);
+		if (len < 1e-6f)
+			continue;
+		p[0] = x / len * 0.5f + 0.5f;
+		p[1] = y / len * 0.5f + 0.5f;
+		p[2] = z / len * 0.5f + 0.5f;
+	}
+#endif
+}
+
+void encode_rgb(const float* px, int width, bool srgb, uint8_t* out) noexcept
+{
+	const auto& t = srgb_tables();
+	for (int i = 0; i < width * 4; i += 4) {
+		for (int c = 0; c < 3; ++c) {
+			const float v = std::clamp(px[i + c], 0.0f, 1.0f);
+			out[i + c] = srgb ? t.from_linear[static_cast<int>(v * (encode_lut_size - 1) + 0.5f)]
+			                  : static_cast<uint8_t>(v * 255.0f + 0.5f);
+		}
+	}
+}
+
+uint8_t encode_alpha(float a) noexcept
+{
+	return static_cast<uint8_t>(std::clamp(a, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+float coverage(const std::vector<float>& alpha, float cutoff, float scale) noexcept
+{
+	size_t covered = 0;
+	for (float a : alpha)
+		covered += a * scale > cutoff;
+	return alpha.empty() ? 0.0f : float(covered) / alpha.size();
+}
+
+// Finds alpha scale for which share of texels passing alpha test matches target.
+float coverage_scale(const std::vector<float>& alpha, float cutoff, float target) noexcept
+{
+	float lo = 0.0f, hi = 4.0f;
+	for (int i = 0; i < 16; ++i) {
+		const float mid = (lo + hi) * 0.5f;
+		if (coverage(alpha, cutoff, mid) < target)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return hi;
+}
+
+} // namespace
+
+
+MipOptions rc::Texture::mip_options(Kind kind, ColorSpace colorspace, float alpha_cutoff) noexcept
+{
+	MipOptions options;
+	options.colorspace = colorspace;
+	options.normal_map = kind == Kind::Normal;
+	if (kind == Kind::BaseColor)
+		options.alpha_cutoff = alpha_cutoff;
+	return options;
+}
+
+
+MipChain rc::Texture::generate_mips(const uint8_t* rgba, uint16_t width, uint16_t height, const MipOptions& options)
+{
+	ZoneScoped;
+	MipChain chain;
+	if (width == 0 || height == 0)
+		return chain;
+
+	const auto num_levels = rc::math::num_mipmap_levels(width, height);
+	size_t total_size = 0;
+	for (uint16_t level = 0; level < num_levels; ++level) {
+		const uint16_t w = std::max(1, width >> level);
+		const uint16_t h = std::max(1, height >> level);
+		const uint32_t size = uint32_t(w) * h * 4;
+		chain.levels.push_back(MipChain::Level{w, h, static_cast<uint32_t>(total_size), size});
+		total_size += size;
+	}
+	chain.data.resize(total_size);
+	std::memcpy(chain.data.data(), rgba, chain.levels[0].size);
+
+	const bool srgb = options.colorspace == ColorSpace::sRGB;
+	const bool keep_coverage = options.alpha_cutoff > 0.0f && options.alpha_cutoff < 1.0f;
+	float target_coverage = 0.0f;
+	if (keep_coverage) {
+		const uint8_t cutoff = static_cast<uint8_t>(std::clamp(options.alpha_cutoff * 255.0f, 0.0f, 255.0f));
+		size_t covered = 0;
+		for (size_t i = 3; i < chain.levels[0].size; i += 4)
+			covered += rgba[i] > cutoff;
+		target_coverage = float(covered) / (size_t(width) * height);
+	}
+
+	std::vector<float> row0(size_t(width) * 4), row1(size_t(width) * 4), out_row(size_t(width) * 4);
+	std::vector<float> alpha;
+
+	// each level is filtered from previous 8-bit level, which keeps memory use at one row
+	for (size_t level = 1; level < chain.levels.size(); ++level) {
+		const auto& src = chain.levels[level - 1];
+		const auto& dst = chain.levels[level];
+		const uint8_t* src_data = chain.data.data() + src.offset;
+		uint8_t* dst_data = chain.data.data() + dst.offset;
+		if (keep_coverage)
+			alpha.resize(size_t(dst.width) * dst.height);
+
+		for (int y = 0; y < dst.height; ++y) {
+			const int y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+			decode_row(src_data + size_t(y0) * src.width * 4, src.width, srgb, row0.data());
+			decode_row(src_data + size_t(y1) * src.width * 4, src.width, srgb, row1.data());
+			average_rows(row0.data(), row1.data(), src.width, dst.width, out_row.data());
+			if (options.normal_map)
+				renormalize(out_row.data(), dst.width);
+
+			uint8_t* out = dst_data + size_t(y) * dst.width * 4;
+			encode_rgb(out_row.data(), dst.width, srgb, out);
+			for (int x = 0; x < dst.width; ++x) {
+				if (keep_coverage)
+					alpha[size_t(y) * dst.width + x] = out_row[x * 4 + 3];
+				else
+					out[x * 4 + 3] = encode_alpha(out_row[x * 4 + 3]);
+			}
+		}
+
+		if (keep_coverage) {
+			const float scale = coverage_scale(alpha, options.alpha_cutoff, target_coverage);
+			for (size_t i = 0; i < alpha.size(); ++i)
+				dst_data[i * 4 + 3] = encode_alpha(alpha[i] * scale);
+		}
+	}
+	return chain;
+}
+
+// -----------------------------------------------------------------------------
+#include <doctest/doctest.h>
+#ifndef DOCTEST_CONFIG_DISABLE
+
+TEST_CASE("Texture mips filter sRGB in linear space") {
+	// black and white checkerboard averages to linear 0.5, not sRGB 0.5
+	uint8_t checker[2 * 2 * 4];
+	for (int i = 0; i < 4; ++i) {
+		const uint8_t v = (i == 0 || i == 3) ? 255 : 0;
+		checker[i * 4 + 0] = checker[i * 4 + 1] = checker[i * 4 + 2] = v;
+		checker[i * 4 + 3] = 255;
+	}
+	auto chain = generate_mips(checker, 2, 2, MipOptions{ColorSpace::sRGB});
+	REQUIRE(chain.levels.size() == 2);
+	const uint8_t* mip = chain.data.data() + chain.levels[1].offset;
+	REQUIRE(mip[0] == 188);
+	REQUIRE(mip[3] == 255);
+
+	chain = generate_mips(checker, 2, 2, MipOptions{ColorSpace::Linear});
+	REQUIRE(chain.data[chain.levels[1].offset] == 128);
+}
+
+TEST_CASE("Texture mips renormalize normals and keep alpha coverage") {
+	// average of two diverging unit normals is shorter than one
+	uint8_t tilted[2 * 1 * 4] = {
+	        218, 128, 218, 255,
+	        38,  128, 218, 255,
+	};
+	MipOptions options;
+	options.normal_map = true;
+	auto chain = generate_mips(tilted, 2, 1, options);
+	const uint8_t* n = chain.data.data() + chain.levels[1].offset;
+	const float x = n[0] / 127.5f - 1.0f, y = n[1] / 127.5f - 1.0f, z = n[2] / 127.5f - 1.0f;
+	REQUIRE(std::abs(std::sqrt(x * x + y * y + z * z) - 1.0f) < 0.02f);
+
+	// half of texels pass alpha test at level 0; plain average would drop to zero coverage
+	uint8_t masked[4 * 4 * 4];
+	for (int i = 0; i < 16; ++i) {
+		masked[i * 4 + 0] = masked[i * 4 + 1] = masked[i * 4 + 2] = 255;
+		masked[i * 4 + 3] = (i % 2) ? 230 : 0;
+	}
+	options = mip_options(Kind::BaseColor, ColorSpace::sRGB, 0.5f);
+	chain = generate_mips(masked, 4, 4, options);
+	const uint8_t* m = chain.data.data() + chain.levels[1].offset;
+	int covered = 0;
+	for (int i = 0; i < 4; ++i)
+		covered += m[i * 4 + 3] > 127;
+	REQUIRE(covered == 4);
+}
+
+#endif
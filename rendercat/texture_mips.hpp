@@ -0,0 +1,35 @@
+#pragma once
+
+#include <rendercat/texture.hpp>
+#include <vector>
+
+namespace rc::Texture {
+
+struct MipOptions
+{
+	ColorSpace colorspace = ColorSpace::Linear; // sRGB color channels are filtered in linear space
+	bool       normal_map = false;              // renormalize XYZ stored in [0, 1] range
+	float      alpha_cutoff = -1.0f;            // if in (0, 1), alpha is rescaled to keep alpha-tested coverage
+};
+
+// Full mip chain of RGBA8 image. Levels are stored back to back, level 0 is a copy of source.
+struct MipChain
+{
+	struct Level
+	{
+		uint16_t width = 0;
+		uint16_t height = 0;
+		uint32_t offset = 0;
+		uint32_t size = 0;
+	};
+
+	std::vector<Level>   levels;
+	std::vector<uint8_t> data;
+};
+
+MipOptions mip_options(Kind kind, ColorSpace colorspace, float alpha_cutoff = -1.0f) noexcept;
+
+// Builds mip chain with 2x2 box filter; odd dimensions repeat last row/column.
+MipChain generate_mips(const uint8_t* rgba, uint16_t width, uint16_t height, const MipOptions& options);
+
+}
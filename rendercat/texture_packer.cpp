@@ -0,0 +1,152 @@
+#include <rendercat/texture_packer.hpp>
+#include <rendercat/texture_cooker.hpp>
+#include <rendercat/util/file_io.hpp>
+#include <stb_image.h>
+#include <stb_image_write.h>
+#include <fmt/core.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include <tracy/Tracy.hpp>
+
+using namespace rc;
+
+namespace {
+
+struct DecodedImage
+{
+	const uint8_t* pixels = nullptr;
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+};
+
+}
+
+// Smaller images are point-sampled up to size of the largest one.
+static std::vector<uint8_t> pack_pixels(const std::vector<DecodedImage>& images,
+                                        const std::vector<Texture::OrmSource>& sources,
+                                        int width,
+                                        int height)
+{
+	std::vector<uint8_t> rgb(size_t(width) * height * 3, 255);
+	for (size_t i = 0; i < images.size(); ++i) {
+		const auto& image = images[i];
+		for (int y = 0; y < height; ++y) {
+			const int sy = int(int64_t(y) * image.height / height);
+			for (int x = 0; x < width; ++x) {
+				const int sx = int(int64_t(x) * image.width / width);
+				const uint8_t* src = image.pixels + (size_t(sy) * image.width + sx) * image.channels;
+				uint8_t* dst = rgb.data() + (size_t(y) * width + x) * 3;
+				for (int c = 0; c < 3; ++c) {
+					if (sources[i].channels[c] >= 0)
+						dst[c] = src[sources[i].channels[c]];
+				}
+			}
+		}
+	}
+	return rgb;
+}
+
+std::filesystem::path rc::Texture::pack_orm(const std::vector<OrmSource>& sources)
+{
+	ZoneScoped;
+	std::vector<std::vector<uint8_t>> files(sources.size());
+	uint64_t key = 0x6f726d; // "orm"
+	for (size_t i = 0; i < sources.size(); ++i) {
+		if (!util::read_file(sources[i].path, files[i])) {
+			fmt::print(stderr, "[texture.packer] could not read [{}]\n", sources[i].path.u8string());
+			std::fflush(stderr);
+			return {};
+		}
+		key = key * 31 + content_hash(files[i].data(), files[i].size());
+		key = key * 31 + content_hash(sources[i].channels, sizeof(sources[i].channels));
+	}
+
+	auto packed_path = std::filesystem::path("cache/textures") / fmt::format("{:016x}-orm.png", key);
+	std::error_code ec;
+	if (std::filesystem::is_regular_file(packed_path, ec))
+		return packed_path;
+
+	using image_ptr = std::unique_ptr<uint8_t, decltype(&stbi_image_free)>;
+	std::vector<image_ptr> decoded;
+	std::vector<DecodedImage> images;
+	int width = 0, height = 0;
+	for (size_t i = 0; i < sources.size(); ++i) {
+		DecodedImage image;
+		image.pixels = stbi_load_from_memory(files[i].data(), int(files[i].size()),
+		                                     &image.width, &image.height, &image.channels, 0);
+		if (!image.pixels) {
+			fmt::print(stderr, "[texture.packer] could not decode [{}]: {}\n", sources[i].path.u8string(), stbi_failure_reason());
+			std::fflush(stderr);
+			return {};
+		}
+		decoded.emplace_back(const_cast<uint8_t*>(image.pixels), &stbi_image_free);
+
+		for (int8_t channel : sources[i].channels) {
+			if (channel >= image.channels) {
+				fmt::print(stderr, "[texture.packer] [{}] has no channel {}\n", sources[i].path.u8string(), channel);
+				std::fflush(stderr);
+				return {};
+			}
+		}
+		width = std::max(width, image.width);
+		height = std::max(height, image.height);
+		images.push_back(image);
+	}
+
+	const auto rgb = pack_pixels(images, sources, width, height);
+
+	// both startup models may be staged at once, so same entry can be written concurrently
+	std::filesystem::create_directories(packed_path.parent_path(), ec);
+	const bool saved = util::write_file_atomic(packed_path, [&](std::FILE* file)
+	{
+		auto write = [](void* context, void* data, int size)
+		{
+			std::fwrite(data, 1, size_t(size), static_cast<std::FILE*>(context));
+		};
+		return stbi_write_png_to_func(write, file, width, height, 3, rgb.data(), width * 3) != 0;
+	});
+	if (!saved) {
+		fmt::print(stderr, "[texture.packer] could not write [{}]\n", packed_path.u8string());
+		std::fflush(stderr);
+		return {};
+	}
+	return packed_path;
+}
+
+// -----------------------------------------------------------------------------
+#include <doctest/doctest.h>
+#ifndef DOCTEST_CONFIG_DISABLE
+
+TEST_CASE("ORM packing routes channels and fills missing ones with white") {
+	// 2x2 RGB metallic-roughness image and 1x1 single-channel occlusion
+	const uint8_t mr[] = {0, 10, 20,  0, 11, 21,
+	                      0, 12, 22,  0, 13, 23};
+	const uint8_t ao[] = {77};
+
+	std::vector<Texture::OrmSource> sources(2);
+	sources[0].channels[1] = 1;
+	sources[0].channels[2] = 2;
+	sources[1].channels[0] = 0;
+	std::vector<DecodedImage> images{{mr, 2, 2, 3}, {ao, 1, 1, 1}};
+
+	auto rgb = pack_pixels(images, sources, 2, 2);
+	REQUIRE(rgb.size() == 12);
+	for (int i = 0; i < 4; ++i) {
+		CHECK(rgb[i * 3 + 0] == 77);
+		CHECK(rgb[i * 3 + 1] == 10 + i);
+		CHECK(rgb[i * 3 + 2] == 20 + i);
+	}
+
+	sources.resize(1);
+	images.resize(1);
+	sources[0].channels[1] = -1;
+	rgb = pack_pixels(images, sources, 2, 2);
+	CHECK(rgb[0] == 255);
+	CHECK(rgb[1] == 255);
+	CHECK(rgb[2] == 20);
+}
+
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+#include <cstdint>
+
+namespace rc::Texture {
+
+// Image contributing channels to packed occlusion/roughness/metallic texture.
+struct OrmSource
+{
+	std::filesystem::path path;
+	// Source channel for packed R (occlusion), G (roughness) and B (metallic), -1 if not provided.
+	int8_t channels[3] = {-1, -1, -1};
+};
+
+// Packs channels of separately authored images into one RGB image in glTF layout,
+// so that material samples single texture. Channels nobody provides are white.
+// Result is stored in cache/textures, keyed by contents of sources and channel
+// mapping, so packing only happens on first import. Returns path of packed image,
+// or empty path on failure.
+std::filesystem::path pack_orm(const std::vector<OrmSource>& sources);
+
+}
@@ -0,0 +1,290 @@
+#include <rendercat/texture_sampler.hpp>
+#include <rendercat/texture2d.hpp>
+#include <rendercat/util/gl_unique_handle.hpp>
+#include <fmt/core.h>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glbinding/gl45core/types.h>
+#include <glbinding/gl45core/enum.h>
+#include <glbinding/gl45core/functions.h>
+#include <glbinding/gl45ext/enum.h>
+#include <glbinding/gl45ext/functions.h>
+
+#include <zcm/common.hpp>
+#include <zcm/type_ptr.hpp>
+#include <tracy/Tracy.hpp>
+
+using namespace gl45core;
+using namespace rc;
+using namespace rc::Texture;
+
+bool SamplerParams::operator==(const SamplerParams& o) const noexcept
+{
+	return border_color.x == o.border_color.x
+	    && border_color.y == o.border_color.y
+	    && border_color.z == o.border_color.z
+	    && border_color.w == o.border_color.w
+	    && mip_bias == o.mip_bias
+	    && min_filter == o.min_filter
+	    && mag_filter == o.mag_filter
+	    && wrapping_s == o.wrapping_s
+	    && wrapping_t == o.wrapping_t
+	    && anisotropic_samples == o.anisotropic_samples;
+}
+
+namespace {
+
+struct ParamsHash
+{
+	size_t operator()(const SamplerParams& p) const noexcept
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		auto mix = [&hash](const void* data, size_t size)
+		{
+			auto bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; ++i) {
+				hash ^= bytes[i];
+				hash *= 0x100000001b3ull;
+			}
+		};
+		// adding zero turns -0.0 into +0.0, they compare equal and must hash equal
+		const float values[] = {p.border_color.x + 0.0f, p.border_color.y + 0.0f,
+		                        p.border_color.z + 0.0f, p.border_color.w + 0.0f,
+		                        p.mip_bias + 0.0f};
+		mix(values, sizeof(values));
+		const uint16_t modes[] = {static_cast<uint16_t>(p.min_filter), static_cast<uint16_t>(p.mag_filter),
+		                          static_cast<uint16_t>(p.wrapping_s), static_cast<uint16_t>(p.wrapping_t),
+		                          p.anisotropic_samples};
+		mix(modes, sizeof(modes));
+		return static_cast<size_t>(hash);
+	}
+};
+
+class SamplerCache
+{
+	SamplerCache() = default;
+	RC_DISABLE_COPY(SamplerCache)
+	RC_DISABLE_MOVE(SamplerCache)
+public:
+
+	static SamplerCache& instance()
+	{
+		static SamplerCache cache;
+		return cache;
+	}
+
+	uint32_t get(const SamplerParams& params)
+	{
+		auto [pos, inserted] = m_samplers.try_emplace(params);
+		if (inserted) {
+			glCreateSamplers(1, pos->second.get());
+			apply(*pos->second, params);
+		}
+		return *pos->second;
+	}
+
+	void set_anisotropy(unsigned samples)
+	{
+		samples = std::clamp(samples, 1u, max_anisotropy());
+		if (samples == m_anisotropy)
+			return;
+		m_anisotropy = samples;
+		update_all();
+	}
+
+	void set_mip_bias(float bias)
+	{
+		if (bias == m_mip_bias)
+			return;
+		m_mip_bias = bias;
+		update_all();
+	}
+
+	unsigned max_anisotropy()
+	{
+		if (unlikely(!m_max_anisotropy)) {
+			float max_aniso_samples = 0.0f;
+			constexpr auto GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT = gl45ext::GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT;
+			glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_aniso_samples);
+
+			m_max_anisotropy = zcm::floor(max_aniso_samples);
+			if (m_max_anisotropy < 2 || m_max_anisotropy > 16) {
+				fmt::print(stderr, "[sampler] driver reports invalid maximum anisotropy sample count: {}\n", max_aniso_samples);
+				std::fflush(stderr);
+				m_max_anisotropy = 1;
+			}
+		}
+		return m_max_anisotropy;
+	}
+
+	void retire_handle(uint64_t handle, TextureStorage2D&& view, uint32_t sampler_generation)
+	{
+		m_retired_handles.push_back(RetiredHandle{handle, std::move(view), m_frame, sampler_generation});
+	}
+
+	void update()
+	{
+		++m_frame;
+		// handles go first, they may reference samplers released below
+		auto handles_done = std::find_if(m_retired_handles.begin(), m_retired_handles.end(), [this](const RetiredHandle& r)
+		{
+			return r.frame + frames_in_flight >= m_frame;
+		});
+		for (auto it = m_retired_handles.begin(); it != handles_done; ++it) {
+			// handle was deleted along with its sampler otherwise
+			if (it->sampler_generation > m_released_generation)
+				gl45ext::glMakeTextureHandleNonResidentARB(it->handle);
+		}
+		m_retired_handles.erase(m_retired_handles.begin(), handles_done);
+
+		auto done = std::find_if(m_retired.begin(), m_retired.end(), [this](const Retired& r)
+		{
+			return r.frame + frames_in_flight >= m_frame;
+		});
+		for (auto it = m_retired.begin(); it != done; ++it)
+			m_released_generation = std::max(m_released_generation, it->generation);
+		m_retired.erase(m_retired.begin(), done);
+	}
+
+	void clear()
+	{
+		m_retired_handles.clear();
+		m_samplers.clear();
+		m_retired.clear();
+		m_released_generation = m_generation;
+		++m_generation;
+	}
+
+	uint32_t generation() const noexcept { return m_generation; }
+	unsigned anisotropy() const noexcept { return m_anisotropy; }
+	float mip_bias() const noexcept { return m_mip_bias; }
+	uint32_t count() const noexcept { return static_cast<uint32_t>(m_samplers.size()); }
+
+private:
+	void apply(uint32_t sampler, const SamplerParams& p)
+	{
+		constexpr auto GL_TEXTURE_MAX_ANISOTROPY_EXT = gl45ext::GL_TEXTURE_MAX_ANISOTROPY_EXT;
+		const float aniso = std::min({unsigned(p.anisotropic_samples), m_anisotropy, max_anisotropy()});
+		const float bias = p.mip_bias + m_mip_bias;
+
+		glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, static_cast<GLenum>(p.min_filter));
+		glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, static_cast<GLenum>(p.mag_filter));
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, static_cast<GLenum>(p.wrapping_s));
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, static_cast<GLenum>(p.wrapping_t));
+		glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, aniso);
+		glSamplerParameterfv(sampler, GL_TEXTURE_BORDER_COLOR, zcm::value_ptr(p.border_color));
+		glSamplerParameterf(sampler, GL_TEXTURE_LOD_BIAS, bias);
+	}
+
+	void update_all()
+	{
+		ZoneScoped;
+		if (!bindless_supported()) {
+			for (auto& [params, sampler] : m_samplers)
+				apply(*sampler, params);
+			return;
+		}
+
+		// samplers referenced by bindless handles can't be modified, textures pick up
+		// replacements on generation change. Old ones may still be used by frames in flight.
+		for (auto& [params, sampler] : m_samplers) {
+			m_retired.push_back(Retired{std::move(sampler), m_frame, m_generation});
+			glCreateSamplers(1, sampler.get());
+			apply(*sampler, params);
+		}
+		++m_generation;
+	}
+
+	// same as number of per-frame uniform buffers in renderer
+	static constexpr uint64_t frames_in_flight = 3;
+
+	struct Retired
+	{
+		rc::sampler_handle sampler;
+		uint64_t           frame;
+		uint32_t           generation;
+	};
+
+	struct RetiredHandle
+	{
+		uint64_t         handle;
+		TextureStorage2D view;
+		uint64_t         frame;
+		uint32_t         sampler_generation;
+	};
+
+	std::unordered_map<SamplerParams, rc::sampler_handle, ParamsHash> m_samplers;
+	std::vector<Retired> m_retired; // in order of retirement
+	std::vector<RetiredHandle> m_retired_handles; // in order of retirement
+	uint64_t m_frame = 0;
+	uint32_t m_generation = 1;
+	uint32_t m_released_generation = 0; // samplers of this and older generations are deleted
+	unsigned m_anisotropy = 16;
+	unsigned m_max_anisotropy = 0;
+	float    m_mip_bias = 0.0f;
+};
+
+}
+
+uint32_t Samplers::get(const SamplerParams& params)
+{
+	return SamplerCache::instance().get(params);
+}
+
+uint32_t Samplers::generation() noexcept
+{
+	return SamplerCache::instance().generation();
+}
+
+void Samplers::set_anisotropy(unsigned samples)
+{
+	SamplerCache::instance().set_anisotropy(samples);
+}
+
+unsigned Samplers::anisotropy() noexcept
+{
+	return SamplerCache::instance().anisotropy();
+}
+
+unsigned Samplers::max_anisotropy() noexcept
+{
+	return SamplerCache::instance().max_anisotropy();
+}
+
+void Samplers::set_mip_bias(float bias)
+{
+	SamplerCache::instance().set_mip_bias(bias);
+}
+
+float Samplers::mip_bias() noexcept
+{
+	return SamplerCache::instance().mip_bias();
+}
+
+void Samplers::unbind(uint32_t first_unit, uint32_t count) noexcept
+{
+	glBindSamplers(first_unit, count, nullptr);
+}
+
+void Samplers::retire_handle(uint64_t handle, TextureStorage2D&& view, uint32_t sampler_generation)
+{
+	SamplerCache::instance().retire_handle(handle, std::move(view), sampler_generation);
+}
+
+void Samplers::update()
+{
+	SamplerCache::instance().update();
+}
+
+void Samplers::clear()
+{
+	SamplerCache::instance().clear();
+}
+
+uint32_t Samplers::count() noexcept
+{
+	return SamplerCache::instance().count();
+}
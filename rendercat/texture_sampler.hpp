@@ -0,0 +1,61 @@
+#pragma once
+
+#include <rendercat/texture.hpp>
+#include <zcm/vec4.hpp>
+#include <cstdint>
+
+namespace rc {
+struct TextureStorage2D;
+}
+
+namespace rc::Texture {
+
+// Sampling state of a texture. Global quality settings are applied on top of it.
+struct SamplerParams
+{
+	zcm::vec4 border_color{};
+	float     mip_bias = 0.0f;
+	MinFilter min_filter = MinFilter::LinearMipMapLinear;
+	MagFilter mag_filter = MagFilter::Linear;
+	Wrapping  wrapping_s = Wrapping::Repeat;
+	Wrapping  wrapping_t = Wrapping::Repeat;
+	uint8_t   anisotropic_samples = 16; // upper limit, also capped by global setting
+
+	bool operator==(const SamplerParams& o) const noexcept;
+};
+
+namespace Samplers {
+
+// Returns sampler object shared by all textures with equal params, created on first use.
+uint32_t get(const SamplerParams& params);
+
+// Incremented when sampler objects are re-created instead of updated in place.
+// Happens on global setting changes with bindless textures, since samplers
+// referenced by bindless handles are immutable.
+uint32_t generation() noexcept;
+
+// Global quality settings, applied to all samplers.
+void     set_anisotropy(unsigned samples);
+unsigned anisotropy() noexcept;
+unsigned max_anisotropy() noexcept; // driver limit
+void     set_mip_bias(float bias);
+float    mip_bias() noexcept;
+
+// Restores texture's own sampling state for given units.
+void unbind(uint32_t first_unit, uint32_t count) noexcept;
+
+// Makes bindless handle non-resident once frames using it are done. Texture view the
+// handle was created for is kept alive until then. Generation is the one of handle's sampler.
+void retire_handle(uint64_t handle, TextureStorage2D&& view, uint32_t sampler_generation);
+
+// Releases samplers replaced by global setting changes once frames using them are done.
+// Must be called once per frame on render thread.
+void update();
+
+// Releases all sampler objects. Must be called on render thread before GL context is destroyed.
+void clear();
+
+uint32_t count() noexcept;
+
+}
+}
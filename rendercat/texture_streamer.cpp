@@ -0,0 +1,1058 @@
+#include <rendercat/texture_streamer.hpp>
+#include <rendercat/texture_container.hpp>
+#include <rendercat/texture_cooker.hpp>
+#include <rendercat/util/file_io.hpp>
+#include <rendercat/util/unique_file_handle.hpp>
+#include <rendercat/util/gl_debug.hpp>
+#include <stb_image.h>
+#include <fmt/core.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <glbinding/gl45core/bitfield.h>
+#include <glbinding/gl45core/boolean.h>
+#include <glbinding/gl45core/types.h>
+#include <glbinding/gl45core/enum.h>
+#include <glbinding/gl45core/functions.h>
+
+#include <tracy/Tracy.hpp>
+
+using namespace gl45core;
+#include <tracy/TracyOpenGL.hpp>
+using namespace rc;
+
+namespace {
+
+constexpr size_t staging_ring_size = 64 * 1024 * 1024;
+constexpr size_t staging_alignment = 16;
+
+// Sub-allocates a fixed size range as a ring. Allocations are freed in allocation
+// order, even if they are retired out of order. Thread safe.
+class RingAllocator
+{
+public:
+	void init(size_t capacity)
+	{
+		std::lock_guard lock(m_mutex);
+		m_capacity = capacity;
+		m_head = m_used = 0;
+		m_allocations.clear();
+		m_stopping = false;
+	}
+
+	// Blocks until enough space is free. Returns false if size never fits or ring is stopping.
+	bool allocate(size_t size, size_t& offset, uint64_t& seq)
+	{
+		size = (size + staging_alignment - 1) & ~(staging_alignment - 1);
+		std::unique_lock lock(m_mutex);
+		if (size > m_capacity)
+			return false;
+
+		for (;;) {
+			if (m_stopping)
+				return false;
+
+			if (m_used == 0)
+				m_head = 0;
+
+			// allocation never straddles the end of buffer: skip remaining tail instead
+			size_t start = m_head;
+			size_t pad = 0;
+			if (start + size > m_capacity) {
+				pad = m_capacity - start;
+				start = 0;
+			}
+			if (m_used + pad + size <= m_capacity) {
+				m_used += pad + size;
+				m_head = start + size;
+				offset = start;
+				seq = m_next_seq++;
+				m_allocations.push_back(Allocation{seq, pad + size, false});
+				return true;
+			}
+			m_space_freed.wait(lock);
+		}
+	}
+
+	void retire(uint64_t seq)
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			if (m_allocations.empty())
+				return;
+			const auto index = seq - m_allocations.front().seq;
+			assert(index < m_allocations.size());
+			m_allocations[index].retired = true;
+
+			// regions are freed in allocation order, uploads may retire out of order
+			while (!m_allocations.empty() && m_allocations.front().retired) {
+				m_used -= m_allocations.front().consumed;
+				m_allocations.pop_front();
+			}
+			// empty ring starts over, otherwise allocation larger than space
+			// before head would wait for retirements that never come
+			if (m_used == 0)
+				m_head = 0;
+		}
+		m_space_freed.notify_all();
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_stopping = true;
+		}
+		m_space_freed.notify_all();
+	}
+
+	size_t capacity() const noexcept { return m_capacity; }
+
+	size_t used()
+	{
+		std::lock_guard lock(m_mutex);
+		return m_used;
+	}
+
+private:
+	struct Allocation
+	{
+		uint64_t seq;
+		size_t   consumed;
+		bool     retired;
+	};
+
+	std::mutex              m_mutex;
+	std::condition_variable m_space_freed;
+	std::deque<Allocation>  m_allocations;
+	size_t                  m_capacity = 0;
+	size_t                  m_head = 0;
+	size_t                  m_used = 0;
+	uint64_t                m_next_seq = 1;
+	bool                    m_stopping = false;
+};
+
+// Persistently mapped upload buffer, sub-allocated as a ring. Decoder threads
+// allocate and fill regions, render thread retires them once GPU is done reading.
+class StagingRing
+{
+public:
+	void init(size_t capacity)
+	{
+		constexpr auto flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glCreateBuffers(1, m_buffer.get());
+		rcObjectLabel(m_buffer, "texture staging ring");
+		glNamedBufferStorage(*m_buffer, capacity, nullptr, flags);
+		m_data = static_cast<uint8_t*>(glMapNamedBufferRange(*m_buffer, 0, capacity, flags));
+		m_allocator.init(m_data ? capacity : 0);
+	}
+
+	void reset()
+	{
+		if (m_buffer && m_data)
+			glUnmapNamedBuffer(*m_buffer);
+		m_data = nullptr;
+		m_buffer.reset();
+		m_allocator.init(0);
+	}
+
+	bool allocate(size_t size, size_t& offset, uint64_t& seq) { return m_allocator.allocate(size, offset, seq); }
+	void retire(uint64_t seq) { m_allocator.retire(seq); }
+	void stop() { m_allocator.stop(); }
+
+	uint8_t* data() const noexcept { return m_data; }
+	uint32_t buffer() const noexcept { return *m_buffer; }
+	size_t capacity() const noexcept { return m_allocator.capacity(); }
+	size_t used() { return m_allocator.used(); }
+
+private:
+	rc::buffer_handle m_buffer;
+	uint8_t*          m_data = nullptr;
+	RingAllocator     m_allocator;
+};
+
+constexpr uint16_t tail_size = 128;     // levels up to this size stay resident for texture lifetime
+constexpr uint64_t unused_frames = 60;  // frames without detail requests before texture falls back to tail
+constexpr unsigned max_promotions = 8;  // level loads queued at once, keeps decoders responsive
+
+// Residency bookkeeping of block-compressed texture, owned by render thread.
+struct StreamedTexture
+{
+	std::weak_ptr<Texture::StreamState> state;
+	std::string                         name;
+	Texture::CookedImage                layout;  // header only: format, levels and file offsets
+	std::filesystem::path               source;  // cook cache entry or container to read levels from
+	std::shared_ptr<const std::vector<uint8_t>> memory; // whole mip chain, if it could not be cached on disk
+	uint8_t                             tail_base = 0;
+	bool                                backed = false;    // tail is uploaded and layout is known
+	bool                                promoting = false; // level load is queued or in progress
+
+	uint64_t level_bytes(uint8_t base) const noexcept
+	{
+		uint64_t bytes = 0;
+		for (size_t i = base; i < layout.levels.size(); ++i)
+			bytes += layout.levels[i].size;
+		return bytes;
+	}
+};
+
+struct DecodeJob
+{
+	enum class Source : uint8_t
+	{
+		Image,     // decoded with stb_image, mips generated on GPU
+		Cooked,    // compressed from image or loaded from cook cache
+		Container, // read from DDS/KTX2 as-is
+		Levels,    // finer levels of already resident compressed texture
+	};
+
+	std::filesystem::path path;
+	ImageTexture2D        texture; // view of the storage to upload into, for Image source
+	std::shared_ptr<Texture::StreamState> state;
+	std::shared_ptr<StreamedTexture> streamed;
+	std::shared_ptr<const std::vector<uint8_t>> memory;
+	Texture::CookedImage  layout;
+	Texture::MipOptions   mip_options;
+	uint8_t               first_level = 0; // levels [first_level, last_level) are loaded
+	uint8_t               last_level = 0;
+	Source                source = Source::Image;
+};
+
+struct UploadJob
+{
+	ImageTexture2D        texture;
+	std::shared_ptr<Texture::StreamState> state;
+	std::shared_ptr<StreamedTexture> streamed;
+	std::vector<uint8_t>  pixels; // used only if image does not fit staging ring
+	std::vector<Texture::CookedImage::Level> levels; // staged levels, offsets relative to staged data
+	Texture::CookedImage  layout; // filled for tail uploads
+	std::filesystem::path source;
+	std::shared_ptr<const std::vector<uint8_t>> memory;
+	uint64_t              content_hash = 0; // of source file, zero for promotions
+	uint64_t              staging_seq = 0;
+	size_t                staging_offset = 0;
+	size_t                size = 0;
+	uint8_t               first_level = 0;
+	uint8_t               expected_base = 0; // resident base the promotion was issued against
+	bool                  promotion = false;
+	bool                  failed = false;
+};
+
+
+// Empty if file could not be read.
+std::vector<uint8_t> read_file(const std::filesystem::path& path)
+{
+	std::vector<uint8_t> data;
+	if (!util::read_file(path, data))
+		data.clear();
+	return data;
+}
+
+uint64_t hash_file(const std::filesystem::path& path)
+{
+	const auto data = read_file(path);
+	return data.empty() ? 0 : Texture::content_hash(data.data(), data.size());
+}
+
+struct InFlightUpload
+{
+	rc::sync_handle       fence;
+	std::vector<uint64_t> staging_seqs;
+};
+
+
+class TextureStreamer
+{
+	TextureStreamer() = default;
+	RC_DISABLE_COPY(TextureStreamer)
+	RC_DISABLE_MOVE(TextureStreamer)
+public:
+
+	static TextureStreamer& instance()
+	{
+		static TextureStreamer streamer;
+		return streamer;
+	}
+
+	bool running() const noexcept
+	{
+		return !m_workers.empty();
+	}
+
+	void init()
+	{
+		ZoneScoped;
+		if (running())
+			return;
+
+		m_ring.init(staging_ring_size);
+		m_stopping = false;
+
+		auto hw_threads = std::thread::hardware_concurrency();
+		unsigned num_threads = std::clamp(hw_threads > 1 ? hw_threads - 1 : 1u, 1u, 4u);
+		for (unsigned i = 0; i < num_threads; ++i) {
+			m_workers.emplace_back([this]{ worker_loop(); });
+		}
+	}
+
+	void shutdown()
+	{
+		ZoneScoped;
+		{
+			std::lock_guard lock(m_mutex);
+			m_stopping = true;
+		}
+		m_decode_cv.notify_all();
+		m_ring.stop();
+		for (auto& t : m_workers)
+			t.join();
+		m_workers.clear();
+
+		m_decode_queue.clear();
+		m_upload_queue.clear();
+		m_in_flight.clear();
+		m_streamed.clear();
+		m_ring.reset();
+	}
+
+	ImageTexture2D request(const std::filesystem::path& path, Texture::ColorSpace color_space, Texture::Kind kind, float alpha_cutoff)
+	{
+		ZoneScoped;
+		using namespace Texture;
+
+		if (!running())
+			return ImageTexture2D::fromFile(path, color_space);
+
+		if (is_container_file(path))
+			return request_container(path, color_space);
+
+		// only header is parsed here, decoding happens on worker threads
+		int width, height, num_channels;
+		if (!stbi_info(path.u8string().data(), &width, &height, &num_channels)) {
+			fmt::print(stderr, "[texture.streamer] could not load image info from [{}]\n", path.u8string());
+			std::fflush(stderr);
+			return ImageTexture2D();
+		}
+
+		int channels = num_channels == 2 ? 4 : num_channels;
+
+		// block-compressed textures are cooked with full mip chain on worker thread
+		const auto cooked_format = Texture::cooked_format(kind, channels, color_space);
+		if (cooked_format != InternalFormat::InvalidFormat) {
+			CookedImage layout;
+			layout.format = cooked_format;
+			layout.width = width;
+			layout.height = height;
+			uint8_t num_levels = 1;
+			while ((std::max(width, height) >> num_levels) > 0)
+				++num_levels;
+			return request_streamed(path, std::move(layout), num_levels, DecodeJob::Source::Cooked,
+			                        mip_options(kind, color_space, alpha_cutoff));
+		}
+
+		InternalFormat format = InternalFormat::InvalidFormat;
+		switch (channels) {
+		case 1:
+			format = InternalFormat::R_8;
+			break;
+		case 3:
+			format = color_space == ColorSpace::Linear ? InternalFormat::RGB_8 : InternalFormat::SRGB_8;
+			break;
+		case 4:
+			format = color_space == ColorSpace::Linear ? InternalFormat::RGBA_8 : InternalFormat::SRGB_8_ALPHA_8;
+			break;
+		default:
+			unreachable();
+		}
+
+		TextureStorage2D storage(width, height, format);
+		if (!storage.valid())
+			return ImageTexture2D();
+
+		storage.set_label(fmt::format("{} ({}x{} {})",
+		                              path.u8string(),
+		                              storage.width(),
+		                              storage.height(),
+		                              enum_value_str(storage.format())));
+
+		auto state = std::make_shared<StreamState>();
+		auto texture = ImageTexture2D::fromStorage(std::move(storage), state);
+
+		{
+			std::lock_guard lock(m_mutex);
+			DecodeJob job;
+			job.path = path;
+			job.texture = texture.share();
+			job.state = state;
+			job.mip_options = mip_options(kind, color_space, alpha_cutoff);
+			m_decode_queue.push_back(std::move(job));
+		}
+		m_decode_cv.notify_one();
+		return texture;
+	}
+
+	ImageTexture2D request_container(const std::filesystem::path& path, Texture::ColorSpace color_space)
+	{
+		using namespace Texture;
+		CookedImage layout;
+		if (!load_container(path, color_space, layout, true))
+			return ImageTexture2D();
+
+		const auto num_levels = static_cast<uint8_t>(layout.levels.size());
+		return request_streamed(path, std::move(layout), num_levels, DecodeJob::Source::Container);
+	}
+
+	// Allocates only the tail of mip chain, finer levels are loaded on demand.
+	ImageTexture2D request_streamed(const std::filesystem::path& path,
+	                                Texture::CookedImage&& layout,
+	                                uint8_t num_levels,
+	                                DecodeJob::Source source,
+	                                const Texture::MipOptions& mip_options = {})
+	{
+		auto state = std::make_shared<Texture::StreamState>();
+		state->width = layout.width;
+		state->height = layout.height;
+		state->levels = num_levels;
+		state->mip_streamed = true;
+
+		// tail is chosen by larger side, but storage also rejects sides of 2 texels or less,
+		// so textures with extreme aspect ratios keep a larger tail
+		uint8_t base = 0;
+		while (base + 1 < num_levels
+		       && std::max(layout.width >> base, layout.height >> base) > tail_size
+		       && std::min(layout.width >> (base + 1), layout.height >> (base + 1)) > 2)
+			++base;
+		state->resident_base = state->wanted_base = base;
+
+		auto streamed = std::make_shared<StreamedTexture>();
+		streamed->state = state;
+		streamed->name = path.u8string();
+		streamed->layout.format = layout.format;
+		streamed->tail_base = base;
+
+		state->storage = allocate_levels(*streamed, *state, base);
+		if (!state->storage.valid())
+			return ImageTexture2D();
+
+		auto texture = ImageTexture2D::fromStorage(state->storage.share(), state);
+		m_streamed.push_back(streamed);
+		{
+			std::lock_guard lock(m_mutex);
+			DecodeJob job;
+			job.path = path;
+			job.state = std::move(state);
+			job.streamed = std::move(streamed);
+			job.layout = std::move(layout);
+			job.first_level = base;
+			job.last_level = num_levels;
+			job.source = source;
+			job.mip_options = mip_options;
+			m_decode_queue.push_back(std::move(job));
+		}
+		m_decode_cv.notify_one();
+		return texture;
+	}
+
+	void request_detail(const ImageTexture2D& texture, float uv_per_pixel) noexcept
+	{
+		const auto& state = texture.stream_state();
+		if (!state || !state->mip_streamed)
+			return;
+
+		// finest level where one texel still covers at least one pixel
+		const float texels_per_pixel = uv_per_pixel * std::max(state->width, state->height);
+		int level = texels_per_pixel > 1.0f ? static_cast<int>(std::log2(texels_per_pixel)) : 0;
+		level = std::clamp(level, 0, state->levels - 1);
+
+		if (state->last_wanted_frame != m_frame) {
+			state->last_wanted_frame = m_frame;
+			state->wanted_base = level;
+		} else {
+			state->wanted_base = std::min<uint8_t>(state->wanted_base, level);
+		}
+	}
+
+	void update()
+	{
+		ZoneScoped;
+		if (!running())
+			return;
+
+		retire_uploads();
+		update_residency();
+
+		TracyGpuZone("texture streaming upload");
+		RC_DEBUG_GROUP("texture streaming upload");
+
+		size_t uploaded = 0;
+		InFlightUpload batch;
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_ring.buffer());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		// always upload at least one image, even if it exceeds the budget
+		while (uploaded < m_upload_budget) {
+			UploadJob job;
+			{
+				std::lock_guard lock(m_mutex);
+				if (m_upload_queue.empty())
+					break;
+				job = std::move(m_upload_queue.front());
+				m_upload_queue.pop_front();
+			}
+
+			if (job.streamed)
+				job.streamed->promoting = false;
+
+			// GPU never reads staging of dropped jobs, so it is free right away
+			if (job.failed || (job.promotion && job.state->resident_base != job.expected_base)) {
+				if (job.staging_seq != 0)
+					m_ring.retire(job.staging_seq);
+				continue;
+			}
+
+			const uint8_t* pixels = reinterpret_cast<const uint8_t*>(job.staging_offset);
+			if (job.staging_seq == 0) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				pixels = job.pixels.data();
+			}
+
+			if (job.streamed) {
+				upload_levels(job, pixels);
+			} else {
+				// mip chain is generated on CPU as RGBA, GL drops unused channels
+				const auto handle = job.texture.texture_handle();
+				for (size_t level = 0; level < job.levels.size(); ++level) {
+					const auto& l = job.levels[level];
+					glTextureSubImage2D(handle, level, 0, 0, l.width, l.height,
+					                    GL_RGBA, GL_UNSIGNED_BYTE, pixels + l.offset);
+				}
+			}
+
+			if (job.staging_seq == 0) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_ring.buffer());
+			} else {
+				batch.staging_seqs.push_back(job.staging_seq);
+			}
+
+			// GL orders these commands before any draw that samples the texture
+			job.state->ready = true;
+			if (job.content_hash)
+				job.state->content_hash = job.content_hash;
+			uploaded += job.size;
+		}
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		if (!batch.staging_seqs.empty()) {
+			batch.fence = rc::sync_handle{glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)};
+			m_in_flight.push_back(std::move(batch));
+		}
+
+		m_uploaded_bytes += uploaded;
+		update_rate(uploaded);
+	}
+
+	Texture::Streamer::Stats stats()
+	{
+		Texture::Streamer::Stats s;
+		{
+			std::lock_guard lock(m_mutex);
+			s.pending_decode = m_decode_queue.size() + m_decoding;
+			s.pending_upload = m_upload_queue.size();
+		}
+		s.in_flight = m_in_flight.size();
+		s.uploaded_bytes = m_uploaded_bytes;
+		s.upload_rate = m_upload_rate;
+		s.staging_used = m_ring.used();
+		s.staging_size = m_ring.capacity();
+		s.streamed_textures = m_streamed.size();
+		s.resident_bytes = m_resident_bytes;
+		s.requested_bytes = m_requested_bytes;
+		return s;
+	}
+
+	size_t m_upload_budget = 16 * 1024 * 1024;
+	size_t m_vram_budget = 512 * 1024 * 1024;
+
+private:
+
+	TextureStorage2D allocate_levels(const StreamedTexture& streamed, const Texture::StreamState& state, uint8_t base)
+	{
+		const uint16_t width = std::max(1, state.width >> base);
+		const uint16_t height = std::max(1, state.height >> base);
+		TextureStorage2D storage(width, height, streamed.layout.format, state.levels - base);
+		if (storage.valid()) {
+			storage.set_label(fmt::format("{} ({}x{} {}, mip {}+)",
+			                              streamed.name,
+			                              state.width,
+			                              state.height,
+			                              enum_value_str(storage.format()),
+			                              base));
+		}
+		return storage;
+	}
+
+	// Moves texture to new storage holding levels [base, levels), keeping resident levels.
+	void reallocate(StreamedTexture& streamed, Texture::StreamState& state, uint8_t base)
+	{
+		auto storage = allocate_levels(streamed, state, base);
+		if (!storage.valid())
+			return;
+
+		for (uint8_t level = std::max(base, state.resident_base); level < state.levels; ++level) {
+			const auto& l = streamed.layout.levels[level];
+			glCopyImageSubData(state.storage.texture_handle(), GL_TEXTURE_2D, level - state.resident_base, 0, 0, 0,
+			                   storage.texture_handle(), GL_TEXTURE_2D, level - base, 0, 0, 0,
+			                   l.width, l.height, 1);
+		}
+		state.storage = std::move(storage);
+		state.resident_base = base;
+		++state.generation;
+	}
+
+	void upload_levels(UploadJob& job, const uint8_t* pixels)
+	{
+		auto& streamed = *job.streamed;
+		auto& state = *job.state;
+		if (job.promotion) {
+			reallocate(streamed, state, job.first_level);
+			if (state.resident_base != job.first_level)
+				return;
+		} else {
+			streamed.layout = std::move(job.layout);
+			streamed.source = std::move(job.source);
+			streamed.memory = std::move(job.memory);
+			streamed.backed = true;
+		}
+
+		const auto handle = state.storage.texture_handle();
+		const auto format = static_cast<GLenum>(state.storage.format());
+		for (size_t i = 0; i < job.levels.size(); ++i) {
+			const auto& l = job.levels[i];
+			glCompressedTextureSubImage2D(handle, job.first_level + i - state.resident_base, 0, 0, l.width, l.height,
+			                              format, l.size, pixels + l.offset);
+		}
+	}
+
+	// Picks resident level range of each compressed texture from its detail requests.
+	// Unused textures and, when over budget, over-resolved ones shrink right away,
+	// finer levels are loaded asynchronously, neediest textures first.
+	void update_residency()
+	{
+		ZoneScoped;
+		++m_frame;
+
+		struct Promotion
+		{
+			std::shared_ptr<StreamedTexture>      streamed;
+			std::shared_ptr<Texture::StreamState> state;
+			uint8_t                               target;
+		};
+		std::vector<Promotion> promotions;
+
+		m_streamed.erase(std::remove_if(m_streamed.begin(), m_streamed.end(),
+		                                [](const auto& s){ return s->state.expired(); }),
+		                 m_streamed.end());
+
+		uint64_t resident = 0;
+		uint64_t requested = 0;
+		unsigned promoting = 0;
+		for (const auto& streamed : m_streamed) {
+			auto state = streamed->state.lock();
+			if (!streamed->backed)
+				continue;
+			if (streamed->promoting)
+				++promoting;
+
+			const bool used = m_frame - state->last_wanted_frame <= unused_frames;
+			const uint8_t target = used ? std::min(state->wanted_base, streamed->tail_base) : streamed->tail_base;
+			requested += streamed->level_bytes(target);
+
+			if (target > state->resident_base && !streamed->promoting && (!used || m_resident_bytes > m_vram_budget))
+				reallocate(*streamed, *state, target);
+			else if (target < state->resident_base && !streamed->promoting)
+				promotions.push_back(Promotion{streamed, state, target});
+
+			resident += streamed->level_bytes(state->resident_base);
+		}
+
+		std::sort(promotions.begin(), promotions.end(), [](const auto& a, const auto& b)
+		{
+			return a.state->resident_base - a.target > b.state->resident_base - b.target;
+		});
+
+		for (const auto& p : promotions) {
+			if (promoting >= max_promotions)
+				break;
+			const auto extra = p.streamed->level_bytes(p.target) - p.streamed->level_bytes(p.state->resident_base);
+			if (resident + extra > m_vram_budget)
+				continue;
+
+			resident += extra;
+			++promoting;
+			p.streamed->promoting = true;
+
+			DecodeJob job;
+			job.path = p.streamed->source;
+			job.state = p.state;
+			job.streamed = p.streamed;
+			job.memory = p.streamed->memory;
+			job.layout.format = p.streamed->layout.format;
+			job.layout.levels = p.streamed->layout.levels;
+			job.layout.file_offsets = p.streamed->layout.file_offsets;
+			job.first_level = p.target;
+			job.last_level = p.state->resident_base;
+			job.source = DecodeJob::Source::Levels;
+			{
+				std::lock_guard lock(m_mutex);
+				m_decode_queue.push_back(std::move(job));
+			}
+			m_decode_cv.notify_one();
+		}
+
+		m_resident_bytes = resident;
+		m_requested_bytes = requested;
+	}
+
+	void worker_loop()
+	{
+		tracy::SetThreadName("texture decoder");
+		for (;;) {
+			DecodeJob job;
+			{
+				std::unique_lock lock(m_mutex);
+				m_decode_cv.wait(lock, [this]{ return m_stopping || !m_decode_queue.empty(); });
+				if (m_stopping)
+					return;
+				job = std::move(m_decode_queue.front());
+				m_decode_queue.pop_front();
+				++m_decoding;
+			}
+
+			UploadJob upload = decode(job);
+			{
+				// texture views are always handed back, GL objects must die on render thread
+				std::lock_guard lock(m_mutex);
+				--m_decoding;
+				m_upload_queue.push_back(std::move(upload));
+			}
+		}
+	}
+
+	UploadJob decode(DecodeJob& job)
+	{
+		ZoneScopedN("decode texture");
+		UploadJob upload;
+		upload.texture = std::move(job.texture);
+		upload.state = std::move(job.state);
+		upload.streamed = std::move(job.streamed);
+		upload.first_level = job.first_level;
+
+		switch (job.source) {
+		case DecodeJob::Source::Cooked:
+			cook(job, upload);
+			return upload;
+		case DecodeJob::Source::Container:
+			// whole file is read only for the hash texture cache dedupes by
+			upload.content_hash = hash_file(job.path);
+			stage_levels(upload, job.layout, nullptr, job.path, job.first_level, job.last_level);
+			upload.source = job.path;
+			upload.layout = std::move(job.layout);
+			return upload;
+		case DecodeJob::Source::Levels:
+			stage_levels(upload, job.layout, job.memory ? job.memory->data() : nullptr,
+			             job.path, job.first_level, job.last_level);
+			upload.promotion = true;
+			upload.expected_base = job.last_level;
+			return upload;
+		case DecodeJob::Source::Image:
+			break;
+		}
+
+		const auto file_data = read_file(job.path);
+		upload.content_hash = Texture::content_hash(file_data.data(), file_data.size());
+
+		int width, height, num_channels;
+		auto data = stbi_load_from_memory(file_data.data(), file_data.size(), &width, &height, &num_channels, 4);
+		if (!data || width != upload.texture.width() || height != upload.texture.height()) {
+			fmt::print(stderr, "[texture.streamer] could not load image data from [{}]\n", job.path.u8string());
+			std::fflush(stderr);
+			stbi_image_free(data);
+			upload.failed = true;
+			return upload;
+		}
+
+		const auto mips = Texture::generate_mips(data, width, height, job.mip_options);
+		stbi_image_free(data);
+		for (const auto& mip : mips.levels)
+			upload.levels.push_back(Texture::CookedImage::Level{mip.width, mip.height, mip.offset, mip.size});
+		stage(upload, mips.data.data(), mips.data.size());
+		return upload;
+	}
+
+	// Loads compressed mip chain from disk cache, compressing and storing it on cache miss.
+	// Only the tail is staged, finer levels are later read back from cache file.
+	void cook(DecodeJob& job, UploadJob& upload)
+	{
+		ZoneScoped;
+		const auto format = job.layout.format;
+		const auto file_data = read_file(job.path);
+		if (file_data.empty()) {
+			fmt::print(stderr, "[texture.streamer] could not read image file [{}]\n", job.path.u8string());
+			std::fflush(stderr);
+			upload.failed = true;
+			return;
+		}
+
+		// mip options change cooked result, so they are part of cache key
+		upload.content_hash = Texture::content_hash(file_data.data(), file_data.size());
+		auto hash = upload.content_hash;
+		uint8_t options_key[2 + sizeof(float)] = {
+		        static_cast<uint8_t>(job.mip_options.colorspace),
+		        static_cast<uint8_t>(job.mip_options.normal_map)};
+		std::memcpy(options_key + 2, &job.mip_options.alpha_cutoff, sizeof(float));
+		hash ^= Texture::content_hash(options_key, sizeof(options_key));
+		const auto cache_path = Texture::cooked_cache_path(hash, format);
+		Texture::CookedImage cooked;
+		const bool cache_hit = Texture::load_cooked(cache_path, cooked)
+		                       && cooked.format == format
+		                       && cooked.width == job.layout.width
+		                       && cooked.height == job.layout.height
+		                       && cooked.levels.size() == job.last_level;
+		if (!cache_hit) {
+			int width, height, num_channels;
+			auto data = stbi_load_from_memory(file_data.data(), file_data.size(), &width, &height, &num_channels, 4);
+			if (!data || width != job.layout.width || height != job.layout.height) {
+				fmt::print(stderr, "[texture.streamer] could not load image data from [{}]\n", job.path.u8string());
+				std::fflush(stderr);
+				stbi_image_free(data);
+				upload.failed = true;
+				return;
+			}
+			cooked = Texture::cook_image(data, width, height, format, job.mip_options);
+			stbi_image_free(data);
+
+			Texture::CookedImage header;
+			if (Texture::save_cooked(cache_path, cooked) && Texture::load_cooked(cache_path, header, true))
+				cooked.file_offsets = std::move(header.file_offsets);
+		}
+
+		stage_levels(upload, cooked, cooked.data.data(), {}, job.first_level, job.last_level);
+		if (cooked.file_offsets.empty()) {
+			upload.memory = std::make_shared<const std::vector<uint8_t>>(std::move(cooked.data));
+		} else {
+			upload.source = cache_path;
+		}
+		cooked.data.clear();
+		upload.layout = std::move(cooked);
+	}
+
+	void stage(UploadJob& upload, const uint8_t* data, size_t size)
+	{
+		upload.size = size;
+		if (m_ring.allocate(size, upload.staging_offset, upload.staging_seq)) {
+			ZoneScopedN("copy to staging");
+			std::memcpy(m_ring.data() + upload.staging_offset, data, size);
+		} else {
+			upload.pixels.assign(data, data + size);
+		}
+	}
+
+	// Stages levels [first, last) of compressed image, either from memory or
+	// straight from file into staging ring.
+	void stage_levels(UploadJob& upload,
+	                  const Texture::CookedImage& layout,
+	                  const uint8_t* memory,
+	                  const std::filesystem::path& path,
+	                  uint8_t first,
+	                  uint8_t last)
+	{
+		ZoneScoped;
+		if (first >= last || last > layout.levels.size()
+		    || (!memory && layout.file_offsets.size() != layout.levels.size())) {
+			upload.failed = true;
+			return;
+		}
+
+		size_t size = 0;
+		for (uint8_t i = first; i < last; ++i) {
+			auto level = layout.levels[i];
+			level.offset = size;
+			upload.levels.push_back(level);
+			size += level.size;
+		}
+
+		upload.size = size;
+		uint8_t* dst = nullptr;
+		if (m_ring.allocate(size, upload.staging_offset, upload.staging_seq)) {
+			dst = m_ring.data() + upload.staging_offset;
+		} else {
+			upload.pixels.resize(size);
+			dst = upload.pixels.data();
+		}
+
+		if (memory) {
+			for (uint8_t i = first; i < last; ++i)
+				std::memcpy(dst + upload.levels[i - first].offset, memory + layout.levels[i].offset, layout.levels[i].size);
+			return;
+		}
+
+		rc::file_handle file(std::fopen(path.u8string().data(), "rb"));
+		for (uint8_t i = first; i < last && !upload.failed; ++i) {
+			const auto& level = layout.levels[i];
+			if (!file
+			    || std::fseek(*file, static_cast<long>(layout.file_offsets[i]), SEEK_SET) != 0
+			    || std::fread(dst + upload.levels[i - first].offset, 1, level.size, *file) != level.size) {
+				fmt::print(stderr, "[texture.streamer] could not read mip level {} from [{}]\n", i, path.u8string());
+				std::fflush(stderr);
+				upload.failed = true;
+			}
+		}
+	}
+
+	void retire_uploads()
+	{
+		ZoneScoped;
+		while (!m_in_flight.empty()) {
+			auto result = glClientWaitSync(*m_in_flight.front().fence, gl::GL_NONE_BIT, 0);
+			if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+				break;
+			for (auto seq : m_in_flight.front().staging_seqs)
+				m_ring.retire(seq);
+			m_in_flight.pop_front();
+		}
+	}
+
+	void update_rate(size_t bytes)
+	{
+		using clock = std::chrono::steady_clock;
+		const auto now = clock::now();
+		m_rate_window.emplace_back(now, bytes);
+		while (now - m_rate_window.front().first > std::chrono::seconds(1))
+			m_rate_window.pop_front();
+
+		size_t total = 0;
+		for (const auto& sample : m_rate_window)
+			total += sample.second;
+		m_upload_rate = static_cast<float>(total);
+	}
+
+	StagingRing                m_ring;
+	std::vector<std::thread>   m_workers;
+	std::mutex                 m_mutex;
+	std::condition_variable    m_decode_cv;
+	std::deque<DecodeJob>      m_decode_queue;
+	std::deque<UploadJob>      m_upload_queue;
+	std::deque<InFlightUpload> m_in_flight;
+	std::deque<std::pair<std::chrono::steady_clock::time_point, size_t>> m_rate_window;
+	std::vector<std::shared_ptr<StreamedTexture>> m_streamed;
+	uint64_t                   m_uploaded_bytes = 0;
+	uint64_t                   m_resident_bytes = 0;
+	uint64_t                   m_requested_bytes = 0;
+	uint64_t                   m_frame = 0;
+	float                      m_upload_rate = 0.0f;
+	uint32_t                   m_decoding = 0;
+	bool                       m_stopping = false;
+};
+
+} // namespace
+
+
+void rc::Texture::Streamer::init()
+{
+	TextureStreamer::instance().init();
+}
+
+void rc::Texture::Streamer::shutdown()
+{
+	TextureStreamer::instance().shutdown();
+}
+
+void rc::Texture::Streamer::update()
+{
+	TextureStreamer::instance().update();
+}
+
+ImageTexture2D rc::Texture::Streamer::request(const std::filesystem::path& path, ColorSpace colorspace, Kind kind, float alpha_cutoff)
+{
+	return TextureStreamer::instance().request(path, colorspace, kind, alpha_cutoff);
+}
+
+void rc::Texture::Streamer::request_detail(const ImageTexture2D& texture, float uv_per_pixel) noexcept
+{
+	TextureStreamer::instance().request_detail(texture, uv_per_pixel);
+}
+
+void rc::Texture::Streamer::set_upload_budget(size_t bytes_per_frame) noexcept
+{
+	TextureStreamer::instance().m_upload_budget = bytes_per_frame;
+}
+
+size_t rc::Texture::Streamer::upload_budget() noexcept
+{
+	return TextureStreamer::instance().m_upload_budget;
+}
+
+void rc::Texture::Streamer::set_vram_budget(size_t bytes) noexcept
+{
+	TextureStreamer::instance().m_vram_budget = bytes;
+}
+
+size_t rc::Texture::Streamer::vram_budget() noexcept
+{
+	return TextureStreamer::instance().m_vram_budget;
+}
+
+rc::Texture::Streamer::Stats rc::Texture::Streamer::stats() noexcept
+{
+	return TextureStreamer::instance().stats();
+}
+
+// -----------------------------------------------------------------------------
+#include <doctest/doctest.h>
+#ifndef DOCTEST_CONFIG_DISABLE
+
+TEST_CASE("Staging ring starts over at the beginning once empty") {
+	RingAllocator ring;
+	ring.init(64);
+
+	size_t offset;
+	uint64_t seq;
+	REQUIRE(ring.allocate(48, offset, seq));
+	CHECK(offset == 0);
+	ring.retire(seq);
+	CHECK(ring.used() == 0);
+
+	// does not fit after head, but whole ring is free
+	REQUIRE(ring.allocate(64, offset, seq));
+	CHECK(offset == 0);
+	CHECK(ring.used() == 64);
+	ring.retire(seq);
+}
+
+TEST_CASE("Staging ring frees regions in allocation order") {
+	RingAllocator ring;
+	ring.init(64);
+
+	size_t offset;
+	uint64_t first, second;
+	REQUIRE(ring.allocate(16, offset, first));
+	REQUIRE(ring.allocate(20, offset, second)); // rounded up to alignment
+	CHECK(offset == 16);
+	CHECK(ring.used() == 48);
+
+	ring.retire(second);
+	CHECK(ring.used() == 48);
+	ring.retire(first);
+	CHECK(ring.used() == 0);
+}
+
+#endif
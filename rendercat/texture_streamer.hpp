@@ -0,0 +1,54 @@
+#pragma once
+
+#include <rendercat/texture2d.hpp>
+
+namespace rc::Texture::Streamer {
+
+struct Stats
+{
+	uint32_t pending_decode = 0; // requests waiting for or being decoded
+	uint32_t pending_upload = 0; // decoded images waiting for upload
+	uint32_t in_flight = 0;      // uploads not yet retired by GPU
+	uint64_t uploaded_bytes = 0; // total since init
+	float    upload_rate = 0.0f; // bytes per second, averaged over last second
+	size_t   staging_used = 0;
+	size_t   staging_size = 0;
+	uint32_t streamed_textures = 0; // block-compressed textures with streamed mip levels
+	uint64_t resident_bytes = 0;    // their levels currently in video memory
+	uint64_t requested_bytes = 0;   // their levels needed for current view
+};
+
+// Starts decoder threads and allocates staging ring. Requires current GL context.
+void init();
+
+// Waits for decoder threads and releases GL resources.
+void shutdown();
+
+// Performs uploads within per-frame byte budget and retires finished ones.
+// Must be called once per frame on the render thread.
+void update();
+
+// Returns texture with allocated storage and undefined contents. It becomes
+// resident once its image is decoded and uploaded; until then it fails to bind.
+// Textures of known kind are block-compressed, see Texture::cooked_format().
+// Block-compressed textures start with only small mip levels resident; finer
+// ones are loaded as detail requests ask for them, within video memory budget.
+// Mips are generated on CPU, see Texture::mip_options() for how kind and alpha cutoff are used.
+[[nodiscard]] ImageTexture2D request(const std::filesystem::path& path,
+                                     ColorSpace colorspace,
+                                     Kind kind = Kind::None,
+                                     float alpha_cutoff = -1.0f);
+
+// Records that texture is sampled at given rate this frame, in texture
+// coordinate units per screen pixel. Does nothing for non-streamed textures.
+void request_detail(const ImageTexture2D& texture, float uv_per_pixel) noexcept;
+
+void   set_upload_budget(size_t bytes_per_frame) noexcept;
+size_t upload_budget() noexcept;
+
+void   set_vram_budget(size_t bytes) noexcept;
+size_t vram_budget() noexcept;
+
+Stats stats() noexcept;
+
+}
@@ -93,6 +93,11 @@ void basic_buf::flush(size_t offset, size_t size)
 		gl45core::glFlushMappedNamedBufferRange(*_buffer, offset, size);
 }
 
+void basic_buf::copy_from(uint32_t source, size_t offset, size_t size)
+{
+	gl45core::glCopyNamedBufferSubData(source, *_buffer, 0, offset, size);
+}
+
 rc::sync_handle basic_buf::make_fence()
 {
 	return rc::sync_handle{gl45core::glFenceSync(gl45core::GL_SYNC_GPU_COMMANDS_COMPLETE, 0)};
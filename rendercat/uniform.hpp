@@ -68,6 +68,7 @@ protected:
 	void map(size_t size);
 	size_t map_size() const;
 	void flush(size_t offset, size_t size);
+	void copy_from(uint32_t source, size_t offset, size_t size);
 	static rc::sync_handle make_fence();
 
 	rc::buffer_handle _buffer;
@@ -114,6 +115,11 @@ struct buf : public basic_buf {
 		basic_buf::flush(_index * sizeof (T), sizeof (T));
 	}
 
+	// copies values produced on GPU into current chunk, offset is relative to chunk
+	void copy_from(uint32_t source, size_t offset, size_t size) {
+		basic_buf::copy_from(source, _index * sizeof (T) + offset, size);
+	}
+
 	void finish() {
 		_sync[_index] = basic_buf::make_fence();
 	}
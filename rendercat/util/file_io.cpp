@@ -0,0 +1,43 @@
+#include <rendercat/util/file_io.hpp>
+#include <rendercat/util/unique_file_handle.hpp>
+#include <fmt/core.h>
+#include <atomic>
+#include <thread>
+
+bool rc::util::read_file(const std::filesystem::path& path, std::vector<uint8_t>& contents)
+{
+	rc::file_handle file(std::fopen(path.u8string().data(), "rb"));
+	if (!file)
+		return false;
+	std::fseek(*file, 0, SEEK_END);
+	const long size = std::ftell(*file);
+	std::fseek(*file, 0, SEEK_SET);
+	if (size <= 0)
+		return false;
+	contents.resize(size_t(size));
+	return std::fread(contents.data(), 1, contents.size(), *file) == contents.size();
+}
+
+bool rc::util::write_file_atomic(const std::filesystem::path& path, const std::function<bool(std::FILE*)>& write)
+{
+	static std::atomic<uint32_t> counter;
+	const auto thread = std::hash<std::thread::id>{}(std::this_thread::get_id());
+	auto tmp_path = path;
+	tmp_path += fmt::format(".{:x}-{}.tmp", thread, counter++);
+
+	std::error_code ec;
+	bool ok = false;
+	{
+		rc::file_handle file(std::fopen(tmp_path.u8string().data(), "wb"));
+		if (!file)
+			return false;
+		ok = write(*file) && std::fflush(*file) == 0 && !std::ferror(*file);
+	}
+	if (ok) {
+		std::filesystem::rename(tmp_path, path, ec);
+		ok = !ec;
+	}
+	if (!ok)
+		std::filesystem::remove(tmp_path, ec);
+	return ok;
+}
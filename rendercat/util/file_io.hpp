@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+namespace rc::util {
+
+// Reads whole file. Empty files are treated as failure.
+bool read_file(const std::filesystem::path& path, std::vector<uint8_t>& contents);
+
+// Writes file through a temporary next to it, renamed into place once complete, so
+// interrupted runs never leave truncated files behind. Temporary name is unique per
+// call, concurrent writers of the same path don't interfere and the last rename wins.
+// Temporary is removed if write returns false, reports stream error, or rename fails.
+bool write_file_atomic(const std::filesystem::path& path, const std::function<bool(std::FILE*)>& write);
+
+}
@@ -0,0 +1,177 @@
+#include <rendercat/util/file_watcher.hpp>
+#include <fmt/format.h>
+#include <tracy/Tracy.hpp>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace rc;
+
+namespace {
+
+struct PathHash
+{
+	size_t operator()(const std::filesystem::path& p) const noexcept
+	{
+		return std::filesystem::hash_value(p);
+	}
+};
+
+using path_set = std::unordered_set<std::filesystem::path, PathHash>;
+
+}
+
+class FileWatcher::Impl
+{
+	std::mutex        m_mutex;
+	path_set          m_files;
+	path_set          m_changed;
+	std::thread       m_thread;
+	std::atomic<bool> m_stopping{false};
+
+	static constexpr auto poll_interval = std::chrono::milliseconds(100);
+
+#ifdef __linux__
+	int m_fd = -1;
+	std::unordered_map<int, std::filesystem::path> m_directories; // watch descriptor -> directory
+#else
+	std::unordered_map<std::filesystem::path, std::filesystem::file_time_type, PathHash> m_write_times;
+#endif
+
+public:
+	Impl()
+	{
+#ifdef __linux__
+		m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_fd < 0) {
+			fmt::print(stderr, "[watcher] inotify_init1 failed: {}\n", std::strerror(errno));
+			std::fflush(stderr);
+			return;
+		}
+#endif
+		m_thread = std::thread([this]{ thread_loop(); });
+	}
+
+	~Impl()
+	{
+		m_stopping = true;
+		if (m_thread.joinable())
+			m_thread.join();
+#ifdef __linux__
+		if (m_fd >= 0)
+			close(m_fd);
+#endif
+	}
+
+	void watch(const std::filesystem::path& file)
+	{
+		auto path = file.lexically_normal();
+		std::lock_guard lock(m_mutex);
+		if (!m_files.insert(path).second)
+			return;
+#ifdef __linux__
+		if (m_fd < 0)
+			return;
+		auto dir = path.parent_path();
+		if (dir.empty())
+			dir = ".";
+		// editors often save by renaming a temporary file, so watch the directory rather than the file
+		int wd = inotify_add_watch(m_fd, dir.u8string().data(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (wd < 0) {
+			fmt::print(stderr, "[watcher] could not watch [{}]: {}\n", dir.u8string(), std::strerror(errno));
+			std::fflush(stderr);
+			return;
+		}
+		m_directories.emplace(wd, path.parent_path());
+#else
+		std::error_code ec;
+		m_write_times[path] = std::filesystem::last_write_time(path, ec);
+#endif
+	}
+
+	std::vector<std::filesystem::path> changed_files()
+	{
+		std::lock_guard lock(m_mutex);
+		std::vector<std::filesystem::path> res(m_changed.begin(), m_changed.end());
+		m_changed.clear();
+		return res;
+	}
+
+private:
+#ifdef __linux__
+	void thread_loop()
+	{
+		tracy::SetThreadName("file watcher");
+		alignas(inotify_event) char buf[4096];
+		while (!m_stopping) {
+			pollfd pfd{m_fd, POLLIN, 0};
+			if (poll(&pfd, 1, static_cast<int>(poll_interval.count())) <= 0)
+				continue;
+
+			for (;;) {
+				auto len = read(m_fd, buf, sizeof(buf));
+				if (len <= 0)
+					break;
+
+				std::lock_guard lock(m_mutex);
+				for (char* p = buf; p < buf + len; ) {
+					auto event = reinterpret_cast<const inotify_event*>(p);
+					p += sizeof(inotify_event) + event->len;
+					if (event->len == 0)
+						continue;
+					auto dir = m_directories.find(event->wd);
+					if (dir == m_directories.end())
+						continue;
+					auto path = (dir->second / event->name).lexically_normal();
+					if (m_files.count(path))
+						m_changed.insert(std::move(path));
+				}
+			}
+		}
+	}
+#else
+	void thread_loop()
+	{
+		tracy::SetThreadName("file watcher");
+		while (!m_stopping) {
+			std::this_thread::sleep_for(poll_interval * 5);
+			std::lock_guard lock(m_mutex);
+			for (auto& [path, time] : m_write_times) {
+				std::error_code ec;
+				auto t = std::filesystem::last_write_time(path, ec);
+				if (!ec && t != time) {
+					time = t;
+					m_changed.insert(path);
+				}
+			}
+		}
+	}
+#endif
+};
+
+
+FileWatcher::FileWatcher() : m_impl(std::make_unique<Impl>())
+{ }
+
+FileWatcher::~FileWatcher() = default;
+
+void FileWatcher::watch(const std::filesystem::path& file)
+{
+	m_impl->watch(file);
+}
+
+std::vector<std::filesystem::path> FileWatcher::changed_files()
+{
+	return m_impl->changed_files();
+}
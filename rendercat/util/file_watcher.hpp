@@ -0,0 +1,30 @@
+#pragma once
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+namespace rc {
+
+// Watches files for modifications on a background thread. Uses inotify on Linux,
+// elsewhere falls back to polling write times. Querying changes does no filesystem calls.
+class FileWatcher
+{
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator =(const FileWatcher&) = delete;
+
+	// Adding the same file again is a no-op.
+	void watch(const std::filesystem::path& file);
+
+	// Returns watched files modified since previous call, paths are lexically normalized.
+	std::vector<std::filesystem::path> changed_files();
+
+private:
+	class Impl;
+	std::unique_ptr<Impl> m_impl;
+};
+
+}
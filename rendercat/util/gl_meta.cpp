@@ -2,6 +2,8 @@
 #include <cassert>
 #include <glbinding-aux/ContextInfo.h>
 #include <glbinding-aux/Meta.h>
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
 #include <rendercat/util/gl_meta.hpp>
 #include <rendercat/util/unique_file_handle.hpp>
 #include <fmt/format.h>
@@ -19,6 +21,13 @@ std::string rc::glmeta::vendor()
 	return glbinding::aux::ContextInfo::vendor();
 }
 
+std::string rc::glmeta::version()
+{
+	// full driver version string, not just parsed major.minor
+	auto str = gl::glGetString(gl::GL_VERSION);
+	return str ? reinterpret_cast<const char*>(str) : std::string{};
+}
+
 bool rc::glmeta::extension_supported(gl::GLextension ext)
 {
 	if(!extensions_ready.test_and_set()) {
@@ -7,6 +7,7 @@ namespace rc::glmeta {
 
 	std::string renderer();
 	std::string vendor();
+	std::string version();
 	std::string supported_extensions();
 
 	bool extension_supported(gl::GLextension);
@@ -20,12 +20,13 @@ PerfQuery::PerfQuery()
 	}
 }
 
-void PerfQuery::begin()
+int PerfQuery::begin()
 {
 	int qidx = next_query();
 	m_state[qidx] = QueryState::Began;
 	glBeginQuery(GL_TIME_ELAPSED, *m_query[qidx]);
 	current_query = qidx;
+	return qidx;
 }
 
 void PerfQuery::end()
@@ -48,8 +49,9 @@ float PerfQuery::get()
 }
 
 
-void PerfQuery::collect()
+int PerfQuery::collect()
 {
+	int collected = 0;
 	for(int i = 0; i < query_count; ++i) {
 		if(m_state[i] != QueryState::Ended)
 			continue;
@@ -67,8 +69,9 @@ void PerfQuery::collect()
 		m_state[i] = QueryState::ResultAvailable;
 		float gpu_time = (double)time_elapsed / 1000000.0;
 		push_time(gpu_time, i);
+		++collected;
 	}
-
+	return collected;
 }
 
 void PerfQuery::push_time(float t, int q)
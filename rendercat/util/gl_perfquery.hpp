@@ -21,11 +21,11 @@ struct PerfQuery
 	float time_last = 0.0f;
 	int   query_num = 0;
 
-	void begin();
+	int  begin(); // returns index of started query, see query_num
 	void end();
 
 	float get();
-	void collect();
+	int  collect(); // returns number of results that became available
 
 private:
 	static constexpr int query_count = 8;
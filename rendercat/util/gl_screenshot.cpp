@@ -18,6 +18,7 @@ void rc::util::gl_screenshot(unsigned w, unsigned h, const std::filesystem::path
 
 	stbi_flip_vertically_on_write(true);
 	stbi_write_png(file.u8string().data(), w, h, 3, data.data(), 0);
+	stbi_flip_vertically_on_write(false); // global, texture packer writes unflipped images
 }
 
 void rc::util::gl_save_hdr_texture(uint32_t tex, const std::filesystem::path& file)
@@ -23,6 +23,11 @@ void rc::QueryDeleter::operator()(gl45core::GLuint h) noexcept
 	glDeleteQueries(1, &h);
 }
 
+void rc::SamplerDeleter::operator()(gl45core::GLuint h) noexcept
+{
+	glDeleteSamplers(1, &h);
+}
+
 void rc::ShaderDeleter::operator()(gl45core::GLuint h) noexcept
 {
 	glDeleteShader(h);
@@ -25,6 +25,11 @@ struct QueryDeleter
 	void operator()(gl45core::GLuint) noexcept;
 };
 
+struct SamplerDeleter
+{
+	void operator()(gl45core::GLuint) noexcept;
+};
+
 struct ShaderDeleter
 {
 	void operator()(gl45core::GLuint) noexcept;
@@ -49,6 +54,7 @@ using buffer_handle       = unique_handle<gl45core::GLuint, BufferDeleter>;
 using framebuffer_handle  = unique_handle<gl45core::GLuint, FrameBufferDeleter>;
 using program_handle      = unique_handle<gl45core::GLuint, ProgramDeleter>;
 using query_handle        = unique_handle<gl45core::GLuint, QueryDeleter>;
+using sampler_handle      = unique_handle<gl45core::GLuint, SamplerDeleter>;
 using shader_handle       = unique_handle<gl45core::GLuint, ShaderDeleter>;
 using texture_handle      = unique_handle<gl45core::GLuint, TextureDeleter>;
 using vertex_array_handle = unique_handle<gl45core::GLuint, VertexArrayDeleter>;
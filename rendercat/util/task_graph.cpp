@@ -0,0 +1,297 @@
+#include <rendercat/util/task_graph.hpp>
+#include <rendercat/util/unique_file_handle.hpp>
+#include <fmt/format.h>
+#include <tracy/Tracy.hpp>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+using namespace rc;
+
+TaskGraph::TaskId TaskGraph::add(std::string name, Thread thread, std::function<void()> fn, std::vector<TaskId> deps)
+{
+	const auto id = static_cast<TaskId>(m_tasks.size());
+	for (auto dep : deps) {
+		assert(dep < id && "dependency has to be added first");
+		m_tasks[dep].dependents.push_back(id);
+	}
+
+	auto& task = m_tasks.emplace_back();
+	task.name = std::move(name);
+	task.fn = std::move(fn);
+	task.deps = std::move(deps);
+	task.thread = thread;
+	return id;
+}
+
+void TaskGraph::run(unsigned num_workers, const std::function<void()>& idle)
+{
+	ZoneScoped;
+	using clock = std::chrono::steady_clock;
+	constexpr auto idle_interval = std::chrono::milliseconds(1);
+
+	std::mutex              mutex;
+	std::condition_variable worker_cv;
+	std::condition_variable main_cv;
+	std::deque<TaskId>      worker_queue;
+	std::deque<TaskId>      main_queue;
+	std::vector<uint32_t>   remaining(m_tasks.size());
+	std::exception_ptr      error;
+	size_t finished = 0;
+
+	const auto start = clock::now();
+	auto elapsed_ms = [start]
+	{
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+
+	auto enqueue = [&](TaskId id)
+	{
+		if (m_tasks[id].thread == Thread::Main || num_workers == 0)
+			main_queue.push_back(id);
+		else
+			worker_queue.push_back(id);
+	};
+
+	for (TaskId id = 0; id < m_tasks.size(); ++id) {
+		auto& task = m_tasks[id];
+		task.skipped = false;
+		task.start_ms = task.end_ms = 0.0;
+		remaining[id] = static_cast<uint32_t>(task.deps.size());
+		if (remaining[id] == 0)
+			enqueue(id);
+	}
+
+	auto execute = [&](TaskId id, uint32_t thread_index)
+	{
+		auto& task = m_tasks[id];
+		bool skip;
+		{
+			std::lock_guard lock(mutex);
+			skip = static_cast<bool>(error);
+		}
+		task.thread_index = thread_index;
+		task.skipped = skip;
+		task.start_ms = elapsed_ms();
+		if (!skip) {
+			try {
+				ZoneScopedN("task");
+				ZoneName(task.name.data(), task.name.size());
+				task.fn();
+			} catch (...) {
+				std::lock_guard lock(mutex);
+				if (!error)
+					error = std::current_exception();
+			}
+		}
+		task.end_ms = elapsed_ms();
+
+		{
+			std::lock_guard lock(mutex);
+			++finished;
+			for (auto dependent : task.dependents) {
+				if (--remaining[dependent] == 0)
+					enqueue(dependent);
+			}
+		}
+		worker_cv.notify_all();
+		main_cv.notify_one();
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned i = 0; i < num_workers; ++i) {
+		workers.emplace_back([&, thread_index = i + 1]
+		{
+			tracy::SetThreadName("task graph worker");
+			for (;;) {
+				TaskId id;
+				{
+					std::unique_lock lock(mutex);
+					worker_cv.wait(lock, [&]{ return finished == m_tasks.size() || !worker_queue.empty(); });
+					if (worker_queue.empty())
+						return;
+					id = worker_queue.front();
+					worker_queue.pop_front();
+				}
+				execute(id, thread_index);
+			}
+		});
+	}
+
+	for (;;) {
+		TaskId id;
+		{
+			std::unique_lock lock(mutex);
+			auto ready = [&]{ return finished == m_tasks.size() || !main_queue.empty(); };
+			if (idle)
+				main_cv.wait_for(lock, idle_interval, ready);
+			else
+				main_cv.wait(lock, ready);
+
+			if (main_queue.empty()) {
+				if (finished == m_tasks.size())
+					break;
+				lock.unlock();
+				idle();
+				continue;
+			}
+			id = main_queue.front();
+			main_queue.pop_front();
+		}
+		execute(id, 0);
+	}
+
+	worker_cv.notify_all();
+	for (auto& t : workers)
+		t.join();
+
+	m_num_workers = num_workers;
+	m_duration_ms = elapsed_ms();
+	if (error)
+		std::rethrow_exception(error);
+}
+
+double TaskGraph::ready_ms(const Task& task) const noexcept
+{
+	double ready = 0.0;
+	for (auto dep : task.deps)
+		ready = std::max(ready, m_tasks[dep].end_ms);
+	return ready;
+}
+
+std::vector<TaskGraph::TaskId> TaskGraph::critical_path() const
+{
+	std::vector<TaskId> path;
+	if (m_tasks.empty())
+		return path;
+
+	auto last_finished = [this](const auto& ids)
+	{
+		return *std::max_element(ids.begin(), ids.end(), [this](TaskId a, TaskId b)
+		{
+			return m_tasks[a].end_ms < m_tasks[b].end_ms;
+		});
+	};
+
+	std::vector<TaskId> all(m_tasks.size());
+	for (TaskId id = 0; id < all.size(); ++id)
+		all[id] = id;
+
+	path.push_back(last_finished(all));
+	while (!m_tasks[path.back()].deps.empty())
+		path.push_back(last_finished(m_tasks[path.back()].deps));
+
+	std::reverse(path.begin(), path.end());
+	return path;
+}
+
+bool TaskGraph::write_timeline(const std::filesystem::path& file) const
+{
+	rc::file_handle out(std::fopen(file.u8string().data(), "w"));
+	if (!out) {
+		fmt::print(stderr, "[task graph] could not write timeline to [{}]\n", file.u8string());
+		std::fflush(stderr);
+		return false;
+	}
+
+	const auto path = critical_path();
+	auto on_path = [&path](TaskId id)
+	{
+		return std::find(path.begin(), path.end(), id) != path.end();
+	};
+
+	fmt::memory_buffer buf;
+	fmt::format_to(fmt::appender(buf), "{} tasks in {:.1f} ms, {} worker threads\n\n",
+	               m_tasks.size(), m_duration_ms, m_num_workers);
+	fmt::format_to(fmt::appender(buf), "  {:>10} {:>10} {:>10}  {:<8}  {}\n", "start ms", "time ms", "wait ms", "thread", "task");
+
+	// wait is time between last dependency finishing and task starting, i.e. spent in queue
+	std::vector<TaskId> order(m_tasks.size());
+	for (TaskId id = 0; id < order.size(); ++id)
+		order[id] = id;
+	std::stable_sort(order.begin(), order.end(), [this](TaskId a, TaskId b)
+	{
+		return m_tasks[a].start_ms < m_tasks[b].start_ms;
+	});
+	for (auto id : order) {
+		const auto& task = m_tasks[id];
+		auto thread = task.thread_index == 0 ? std::string("main") : fmt::format("worker {}", task.thread_index);
+		fmt::format_to(fmt::appender(buf), "{} {:>10.2f} {:>10.2f} {:>10.2f}  {:<8}  {}{}\n",
+		               on_path(id) ? '*' : ' ',
+		               task.start_ms,
+		               task.end_ms - task.start_ms,
+		               task.start_ms - ready_ms(task),
+		               thread,
+		               task.name,
+		               task.skipped ? " (skipped)" : "");
+	}
+
+	fmt::format_to(fmt::appender(buf), "\ncritical path:\n");
+	for (auto id : path) {
+		const auto& task = m_tasks[id];
+		fmt::format_to(fmt::appender(buf), "  {:<40} {:>10.2f} ms (+{:.2f} ms wait)\n",
+		               task.name, task.end_ms - task.start_ms, task.start_ms - ready_ms(task));
+	}
+
+	return std::fwrite(buf.data(), 1, buf.size(), *out) == buf.size();
+}
+
+// -----------------------------------------------------------------------------
+#include <doctest/doctest.h>
+#ifndef DOCTEST_CONFIG_DISABLE
+
+TEST_CASE("Task graph runs tasks after their dependencies") {
+	for (unsigned workers : {0u, 3u}) {
+		TaskGraph graph;
+		std::mutex mutex;
+		std::vector<int> order;
+		auto record = [&](int value)
+		{
+			return [&, value]
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(2));
+				std::lock_guard lock(mutex);
+				order.push_back(value);
+			};
+		};
+
+		const auto main_id = std::this_thread::get_id();
+		bool on_main = false;
+		auto a = graph.add("a", TaskGraph::Thread::Worker, record(0));
+		auto b = graph.add("b", TaskGraph::Thread::Worker, record(1));
+		auto c = graph.add("c", TaskGraph::Thread::Main, [&]
+		{
+			on_main = std::this_thread::get_id() == main_id;
+			record(2)();
+		}, {a, b});
+		auto d = graph.add("d", TaskGraph::Thread::Worker, record(3), {c});
+		graph.run(workers);
+
+		REQUIRE(order.size() == 4);
+		CHECK(order[2] == 2);
+		CHECK(order[3] == 3);
+		CHECK(on_main);
+
+		auto path = graph.critical_path();
+		REQUIRE(path.size() == 3);
+		CHECK((path[0] == a || path[0] == b));
+		CHECK(path[1] == c);
+		CHECK(path[2] == d);
+	}
+}
+
+TEST_CASE("Task graph skips remaining tasks after exception") {
+	TaskGraph graph;
+	bool ran = false;
+	auto a = graph.add("a", TaskGraph::Thread::Worker, []{ throw std::runtime_error("failed"); });
+	graph.add("b", TaskGraph::Thread::Main, [&]{ ran = true; }, {a});
+	CHECK_THROWS_AS(graph.run(2), std::runtime_error);
+	CHECK_FALSE(ran);
+}
+
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+#include <rendercat/common.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace rc {
+
+// Set of named tasks with dependencies between them. Worker tasks run on a pool of
+// threads, main tasks on the thread calling run(), so they may touch GL context.
+// Each task is timed, which gives startup timeline and its critical path.
+class TaskGraph
+{
+public:
+	using TaskId = uint32_t;
+
+	enum class Thread : uint8_t
+	{
+		Worker,
+		Main
+	};
+
+	TaskGraph() = default;
+	RC_DISABLE_COPY(TaskGraph)
+
+	// Dependencies have to be added before their dependents.
+	TaskId add(std::string name, Thread thread, std::function<void()> fn, std::vector<TaskId> deps = {});
+
+	// Blocks until every task is done. While main thread has nothing to do, idle is called
+	// roughly every millisecond. If task throws, tasks not yet started are skipped and
+	// exception is rethrown once running ones finish. Without workers everything runs on
+	// calling thread.
+	void run(unsigned num_workers, const std::function<void()>& idle = {});
+
+	// Tasks that determined duration of last run, in execution order: each one is the
+	// dependency of the next that finished last.
+	std::vector<TaskId> critical_path() const;
+
+	// Wall time of last run in milliseconds.
+	double duration_ms() const noexcept { return m_duration_ms; }
+
+	// Writes start, duration and queue wait of each task, followed by critical path.
+	bool write_timeline(const std::filesystem::path& file) const;
+
+private:
+	struct Task
+	{
+		std::string           name;
+		std::function<void()> fn;
+		std::vector<TaskId>   deps;
+		std::vector<TaskId>   dependents;
+		Thread   thread;
+		uint32_t thread_index = 0; // 0 is main thread
+		double   start_ms = 0.0;
+		double   end_ms = 0.0;
+		bool     skipped = false;
+	};
+
+	double ready_ms(const Task& task) const noexcept;
+
+	std::vector<Task> m_tasks;
+	double   m_duration_ms = 0.0;
+	unsigned m_num_workers = 0;
+};
+
+}
@@ -1,4 +1,5 @@
 #version 440 core
+#include "spherical_harmonics.glsl"
 
 layout(location = 0) out vec4 FragColor;
 
@@ -7,9 +8,18 @@ layout(location = 0) in vec3 FragPos;
 layout(binding=0) uniform samplerCubeArray skybox;
 
 layout(location=1) uniform int mip_level;
+layout(location=2) uniform bool show_irradiance_sh;
+
+layout(std430, binding=1) readonly buffer IrradianceSH {
+	vec4 irradiance_sh[9];
+};
 
 void main()
 {
+	if (show_irradiance_sh) {
+		FragColor = vec4(eval_sh_irradiance(irradiance_sh, normalize(FragPos)), 1.0);
+		return;
+	}
 	// BUG: in AMD drivers. Workaround is to use cubemap array.
 	FragColor = textureLod(skybox, vec4(FragPos, 0), mip_level);
 }
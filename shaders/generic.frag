@@ -2,6 +2,9 @@
 //layout(early_fragment_tests) in; // breaks alpha-masked sample to coverage, todo: add a define
 
 #extension GL_ARB_shader_group_vote: enable
+#ifdef RC_BINDLESS_TEXTURES
+	#extension GL_ARB_bindless_texture: require
+#endif
 #ifndef OPENGL
 	#extension GL_KHR_shader_subgroup_vote: enable
 #endif
@@ -16,20 +19,22 @@
 #define ATMOSPHERE_SAMPLE_COUNT 16
 #include "minimal_atmosphere.glsl"
 #include "generic_perframe.glsl"
+#include "spherical_harmonics.glsl"
 
 #include "material.glsl"
 
 layout(binding=30) uniform sampler1D turbo_colormap;
 layout(binding=31) uniform sampler2D uBRDFLut;
-layout(binding=32) uniform sampler2DShadow shadow_map;
+layout(binding=32) uniform sampler2DArrayShadow shadow_map;
 layout(binding=33) uniform samplerCubeArray uReflection;
-layout(binding=34) uniform samplerCubeArray uIrradiance;
-layout(binding=36) uniform sampler2DArrayShadow spot_shadowmaps;
-layout(binding=37) uniform samplerCubeArrayShadow point_shadowmaps;
+layout(binding=36) uniform sampler2DShadow shadow_atlas;
 
 
 layout(std140, binding=2) uniform PerFrameLight_frag {
 	mat4 spot_light_matrices[MAX_DYNAMIC_LIGHTS];
+	mat4 point_light_matrices[MAX_DYNAMIC_LIGHTS * 6];
+	vec4 spot_shadow_rects[MAX_DYNAMIC_LIGHTS];      // .xy - atlas offset, .zw - atlas scale
+	vec4 point_shadow_rects[MAX_DYNAMIC_LIGHTS * 6];
 	int num_visible_point_lights;
 	int num_visible_spot_lights;
 	float point_near;
@@ -58,7 +63,6 @@ struct PixelParams {
 };
 
 layout(location = 0) in INTERFACE {
-	vec4 FragPosLightSpace;
 	vec3 FragPos;
 	vec3 Normal;
 	vec3 Tangent;
@@ -69,7 +73,7 @@ layout(location = 0) in INTERFACE {
 layout(location = 0) out	vec4 FragColor;
 
 
-layout(location = 7) uniform bool has_tangents;
+#include "generic_variant.glsl"
 layout(location = 8) uniform int num_point_lights;
 layout(location = 9) uniform int num_spot_lights;
 layout(location = 10) uniform int point_light_indices[MAX_DYNAMIC_LIGHTS];
@@ -160,35 +164,68 @@ float linearizeDepth(in float depth, in float near, in float far) // with finite
 	return -far / (near - far) - (far * near) / (depth * (far - near));
 }
 
-float calcDirectionalShadow(vec4 fragPosLightSpace, float NdotL)
+float calcDirectionalShadow(vec3 fragPos, float NdotL)
 {
-	// perform perspective divide
-	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-	// transform to [0,1] range
-	vec2 shadowTexCoords = projCoords.xy * 0.5 + 0.5;
-	// get depth of current fragment from light's perspective
-	float currentDepth = (projCoords.z);
+	float viewDepth = dot(fragPos - viewPos, camera_forward);
 	// bias accounting the angle to surface
 	float bias = max(0.005 * (1.0 - NdotL), 0.001);
-	float shadow = 0.0;
-	vec2 texelSize = 1.0 / textureSize(shadow_map, 0);
 
-	for(int x = -1; x <= 1; ++x) {
-		for(int y = -1; y <= 1; ++y) {
-			shadow += texture(shadow_map, vec3(shadowTexCoords + vec2(x, y) * texelSize , currentDepth - bias)).r;
+	for (int cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade) {
+		if (viewDepth > cascade_splits[cascade])
+			continue;
+
+		vec4 fragPosLightSpace = cascade_proj_view[cascade] * vec4(fragPos, 1.0);
+		// perform perspective divide
+		vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+		// transform to [0,1] range
+		vec2 shadowTexCoords = projCoords.xy * 0.5 + 0.5;
+
+		// cached cascades may lag behind camera, fall through to the next one
+		if (any(lessThan(shadowTexCoords, vec2(0.0))) || any(greaterThan(shadowTexCoords, vec2(1.0))))
+			continue;
+
+		// get depth of current fragment from light's perspective
+		float currentDepth = (projCoords.z);
+		float shadow = 0.0;
+		vec2 texelSize = 1.0 / textureSize(shadow_map, 0).xy;
+
+		for(int x = -1; x <= 1; ++x) {
+			for(int y = -1; y <= 1; ++y) {
+				shadow += texture(shadow_map, vec4(shadowTexCoords + vec2(x, y) * texelSize, cascade, currentDepth - bias)).r;
+			}
 		}
+		shadow /= 9.0;
+
+		if(projCoords.z > 1.0)
+			shadow = 0.0;
+
+		return shadow;
 	}
-	shadow /= 9.0;
+	return 1.0; // beyond shadow distance
+}
 
-	if(projCoords.z > 1.0)
-		shadow = 0.0;
+// 3x3 PCF inside atlas region, clamped so that filter does not bleed into neighbours
+float sampleShadowAtlas(vec4 rect, vec2 uv, float depth)
+{
+	vec2 texelSize = 1.0 / textureSize(shadow_atlas, 0);
+	vec2 lo = rect.xy + texelSize * 0.5;
+	vec2 hi = rect.xy + rect.zw - texelSize * 0.5;
+	vec2 base = rect.xy + uv * rect.zw;
 
-	return shadow;
+	float shadow = 0.0;
+	for(int x = -1; x <= 1; ++x) {
+		for(int y = -1; y <= 1; ++y) {
+			shadow += texture(shadow_atlas, vec3(clamp(base + vec2(x, y) * texelSize, lo, hi), depth)).r;
+		}
+	}
+	return shadow / 9.0;
 }
 
 float calcSpotShadow(int light_index, float NdotL)
 {
-	int tex_index = light_index;
+	vec4 rect = spot_shadow_rects[light_index];
+	if (rect.z <= 0.0) // light did not get space in shadow atlas
+		return 1.0;
 
 	vec4 fragPosLightSpace = spot_light_matrices[light_index] * vec4(fs_in.FragPos, 1.0);
 	// perform perspective divide
@@ -199,15 +236,7 @@ float calcSpotShadow(int light_index, float NdotL)
 	float currentDepth =  (projCoords.z);
 	// bias accounting the angle to surface
 	float bias = max(0.005 * (1.0 - NdotL), 0.001);
-	float shadow = 0.0;
-	vec2 texelSize = 1.0 / textureSize(spot_shadowmaps, 0).xy;
-
-	for(int x = -1; x <= 1; ++x) {
-		for(int y = -1; y <= 1; ++y) {
-			shadow += texture(spot_shadowmaps, vec4(shadowTexCoords + vec2(x, y) * texelSize, tex_index, currentDepth - bias)).r;
-		}
-	}
-	shadow /= 9.0;
+	float shadow = sampleShadowAtlas(rect, shadowTexCoords, currentDepth - bias);
 
 	if(currentDepth > 1.0)
 		shadow = 0.0;
@@ -217,15 +246,29 @@ float calcSpotShadow(int light_index, float NdotL)
 
 float calcPointShadow(int light_index, float NdotL, float radius, vec3 L)
 {
-	int tex_index = light_index;
-
+	// select cube face by major axis, same order as shadow rendering
 	vec3 absL = abs(L);
-	float Zcomp = max(absL.x, max(absL.y, absL.z));
-	float currentDepth = linearizeDepth(Zcomp, point_near, radius);
+	int face;
+	if (absL.x >= absL.y && absL.x >= absL.z)
+		face = L.x > 0.0 ? 0 : 1;
+	else if (absL.y >= absL.z)
+		face = L.y > 0.0 ? 2 : 3;
+	else
+		face = L.z > 0.0 ? 4 : 5;
+
+	int index = light_index * 6 + face;
+	vec4 rect = point_shadow_rects[index];
+	if (rect.z <= 0.0)
+		return 1.0;
+
+	vec4 fragPosLightSpace = point_light_matrices[index] * vec4(fs_in.FragPos, 1.0);
+	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+	vec2 shadowTexCoords = projCoords.xy * 0.5 + 0.5;
+	float currentDepth = projCoords.z;
 
 	// bias accounting the angle to surface
 	float bias = max(0.005 * (1.0 - NdotL), 0.001);
-	float shadow = texture(point_shadowmaps, vec4(L, tex_index), currentDepth - bias).r;
+	float shadow = sampleShadowAtlas(rect, shadowTexCoords, currentDepth - bias);
 
 	if(currentDepth > 1.0)
 		shadow = 0.0;
@@ -236,9 +279,9 @@ float calcPointShadow(int light_index, float NdotL, float radius, vec3 L)
 vec4 getMaterialBaseColor()
 {
 	vec4 base_color = material.base_color_factor;
-	if((material.type & MATERIAL_BASE_COLOR_MAP) != 0) {
+	if(material_has(MATERIAL_BASE_COLOR_MAP)) {
 		base_color *= texture(material_diffuse, fs_in.TexCoords);
-		if((material.type & MATERIAL_ALPHA_MASK) != 0) {
+		if(material_has(MATERIAL_ALPHA_MASK)) {
 			if(num_msaa_samples > 1) {
 				base_color.a = (base_color.a - material.alpha_cutoff) / max(fwidth(base_color.a), 0.0001) + 0.5;
 
@@ -250,20 +293,29 @@ vec4 getMaterialBaseColor()
 	return base_color;
 }
 
-void getMaterialRougnessMetallic(out float roughness, out float metallic)
+// occlusion, roughness and metallic are packed in RGB channels of one texture,
+// except for occlusion maps that couldn't be packed at import
+void getMaterialOcclusionRougnessMetallic(out float occlusion, out float roughness, out float metallic)
 {
-	vec2 res = vec2(material.roughness, material.metallic);
-	if ((material.type & MATERIAL_ROUGHNESS_METALLIC) != 0)
-		// rougness and metallic is stored in RG channels
-		res *= texture(material_roughness_metallic, fs_in.TexCoords).gb;
-	roughness = res.x;
-	metallic = res.y;
+	const bool separate_occlusion = material_has(MATERIAL_SEPARATE_OCCLUSION);
+	const bool has_occlusion = material_has(MATERIAL_OCCLUSION_MAP);
+	const bool has_roughness_metallic = material_has(MATERIAL_ROUGHNESS_METALLIC);
+
+	vec3 orm = vec3(1.0);
+	if (has_roughness_metallic || (has_occlusion && !separate_occlusion))
+		orm = texture(material_roughness_metallic, fs_in.TexCoords).rgb;
+	if (separate_occlusion)
+		orm.r = texture(material_occlusion, fs_in.TexCoords).r;
+
+	occlusion = has_occlusion ? orm.r : 1.0;
+	roughness = material.roughness * (has_roughness_metallic ? orm.g : 1.0);
+	metallic = material.metallic * (has_roughness_metallic ? orm.b : 1.0);
 }
 
 vec3 getMaterialEmission()
 {
 	vec3 res = material.emission_factor;
-	if((material.type & MATERIAL_EMISSION_MAP) != 0) {
+	if(material_has(MATERIAL_EMISSION_MAP)) {
 		res *= texture(material_emission, fs_in.TexCoords).rgb;
 	}
 	return res;
@@ -271,9 +323,9 @@ vec3 getMaterialEmission()
 
 vec3 getNormal()
 {
-	if((material.type & MATERIAL_NORMAL_MAP) != 0) {
+	if(material_has(MATERIAL_NORMAL_MAP)) {
 		vec3 sampled_normal = texture(material_normal, fs_in.TexCoords).rgb * 2.0 - 1.0;
-		if ((material.type & MATERIAL_NORMAL_WITHOUT_Z) != 0) {
+		if (material_has(MATERIAL_NORMAL_WITHOUT_Z)) {
 			sampled_normal.z = sqrt(1 - sampled_normal.x*sampled_normal.x - sampled_normal.y*sampled_normal.y);
 		}
 
@@ -334,17 +386,9 @@ vec3 calcFog(const in ExponentialDirectionalFog fog,
 	return fragColor * (1.0 - extinctionAmount) + fogColor * inscatteringAmount;
 }
 
-float getMaterialAO()
-{
-	if ((material.type & MATERIAL_OCCLUSION_MAP) != 0) {
-		return texture(material_occlusion, fs_in.TexCoords).r;
-	}
-	return 1.0;
-}
-
 vec3 applyOcclusion(const PixelParams pixel, vec3 color)
 {
-	if ((material.type & MATERIAL_OCCLUSION_MAP) != 0) {
+	if (material_has(MATERIAL_OCCLUSION_MAP)) {
 		float occlusion = pixel.ao;
 		color = mix(color, color * occlusion, material.occlusion_strength);
 	}
@@ -397,8 +441,8 @@ vec3 calcPBRDirect(const PixelParams pixel, out vec3 direct_transmittance){
 	direct_light.attenuation = 1.0;
 
 	float shadow;
-	if ((per_frame_flags & SHADOWS_DIRECTIONAL) != 0)
-		shadow = calcDirectionalShadow(fs_in.FragPosLightSpace, direct_light.NoL);
+	if (shadows_enabled(SHADOWS_DIRECTIONAL))
+		shadow = calcDirectionalShadow(fs_in.FragPos, direct_light.NoL);
 	else shadow = 1.0;
 
 	return surfaceShading(pixel, direct_light, shadow);
@@ -425,7 +469,7 @@ vec3 calcPBRPoint(const PixelParams pixel) {
 			point.NoL = dot(pixel.n, point.l);
 
 			float shadow = 1.0;
-			if ((per_frame_flags & SHADOWS_POINT) != 0) {
+			if (shadows_enabled(SHADOWS_POINT)) {
 				shadow = calcPointShadow(point_light_indices[i], point.NoL, radius, -lightv);
 			}
 
@@ -458,7 +502,7 @@ vec3 calcPBRSpot(const PixelParams pixel) {
 				spot.colorIntensity = sl.color;
 
 				float shadow = 1.0;
-				if ((per_frame_flags & SHADOWS_SPOT) != 0) {
+				if (shadows_enabled(SHADOWS_SPOT)) {
 					shadow = calcSpotShadow(spot_light_indices[i], spot.NoL);
 				}
 				color += surfaceShading(pixel, spot, 1.0) * shadow;
@@ -478,7 +522,7 @@ vec3 calcIBL(PixelParams pixel)
 	float diffuse_AO = pixel.ao;
 	float specular_AO = computeSpecularAO(pixel.NoV, diffuse_AO, pixel.roughness);
 
-	vec3 diffuse_irradiance = texture(uIrradiance, vec4(pixel.n, 0)).rgb;
+	vec3 diffuse_irradiance = eval_sh_irradiance(irradiance_sh, pixel.n);
 	vec3 Fd = pixel.diffuseColor * diffuse_irradiance * diffuse_AO;
 
 	vec3 specular_radiance = textureLod(uReflection, vec4(r, 0),
@@ -500,8 +544,8 @@ void main()
 	vec3 viewRay = viewPos - fs_in.FragPos;
 	float viewRayLength = length(viewRay);
 
-	float material_roughness, material_metallic;
-	getMaterialRougnessMetallic(material_roughness, material_metallic);
+	float material_ao, material_roughness, material_metallic;
+	getMaterialOcclusionRougnessMetallic(material_ao, material_roughness, material_metallic);
 
 	vec4 material_base_color = getMaterialBaseColor();
 	vec3 diffuse_color = (1.0 - material_metallic) * material_base_color.rgb;
@@ -518,7 +562,7 @@ void main()
 	pixel.NoV = abs(dot(N, V)) + 1e-5;
 	pixel.roughness = material_roughness * material_roughness;
 	pixel.perceptualRoughness = material_roughness;
-	pixel.ao = getMaterialAO();
+	pixel.ao = material_ao;
 	pixel.dfg = textureLod(uBRDFLut, vec2(pixel.NoV, pixel.perceptualRoughness), 0.0).rg;
 	pixel.energyCompensation = 1.0 + pixel.f0 * (1.0 / pixel.dfg.y - 1.0);
 
@@ -5,7 +5,6 @@ layout (location = 2) in vec4 aTangent; // xyz - tangent, w - bitangent sign
 layout (location = 3) in vec2 aTexCoords;
 
 layout(location=0) out INTERFACE {
-	vec4 FragPosLightSpace;
 	vec3 FragPos;
 	vec3 Normal;
 	vec3 Tangent;
@@ -19,12 +18,11 @@ layout(location=0) out INTERFACE {
 
 layout(location=5) uniform mat4 model;
 layout(location=6) uniform mat3 normal_matrix;
-layout(location=7) uniform bool has_tangents;
+#include "generic_variant.glsl"
 
 void main()
 {
 	vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
-	vs_out.FragPosLightSpace = light_proj_view * vec4(vs_out.FragPos, 1.0);
 	gl_Position = proj_view * vec4(vs_out.FragPos, 1.0);
 	vs_out.TexCoords = aTexCoords;
 
@@ -5,10 +5,12 @@ const int MATERIAL_OCCLUSION_MAP       = 1 << 4;
 const int MATERIAL_EMISSION_MAP        = 1 << 5;
 const int MATERIAL_SPECULAR_GLOSSINESS = 1 << 6;
 const int MATERIAL_NORMAL_WITHOUT_Z    = 1 << 12;
+const int MATERIAL_SEPARATE_OCCLUSION  = 1 << 13;
 const int MATERIAL_BLEND               = 1 << 14;
 const int MATERIAL_ALPHA_MASK          = 1 << 15;
 
 const int MAX_DYNAMIC_LIGHTS = 16;
+const int SHADOW_CASCADE_COUNT = 4;
 
 const int SHADOWS_DIRECTIONAL          = 1 << 1;
 const int SHADOWS_POINT                = 1 << 2;
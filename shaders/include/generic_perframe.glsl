@@ -28,7 +28,8 @@ struct SpotLightData {
 
 layout(std140, binding=1) uniform PerFrame {
 	mat4  proj_view;
-	mat4  light_proj_view;
+	mat4  cascade_proj_view[SHADOW_CASCADE_COUNT];
+	vec4  cascade_splits; // view-space far distance of each cascade
 	vec3  camera_forward;
 	float znear;
 	vec3  viewPos;
@@ -39,6 +40,7 @@ layout(std140, binding=1) uniform PerFrame {
 
 	PointLightData point_light[MAX_DYNAMIC_LIGHTS];
 	SpotLightData  spot_light[MAX_DYNAMIC_LIGHTS];
+	vec4 irradiance_sh[9]; // .rgb - diffuse irradiance, see spherical_harmonics.glsl
 
 	int num_msaa_samples;
 };
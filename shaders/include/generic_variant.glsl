@@ -0,0 +1,23 @@
+// Permutations of generic program. Specialized ones know material features, presence of
+// baked tangents and enabled shadows at compile time, unspecialized one (-1) reads them at
+// runtime. Values come from defines when compiled from GLSL, or from specialization constants
+// when loaded as SPIR-V, ids match RC_SPEC_CONSTANT_* in rendercat/shaders/common.h.
+#ifdef GL_SPIRV
+	layout(constant_id = 0) const int material_variant = -1;
+	layout(constant_id = 1) const int tangents_variant = -1;
+	layout(constant_id = 2) const int shadow_variant = -1;
+#elif defined(RC_MATERIAL_VARIANT)
+	const int material_variant = RC_MATERIAL_VARIANT;
+	const int tangents_variant = RC_VARIANT_TANGENTS;
+	const int shadow_variant = RC_SHADOW_VARIANT;
+#else
+	const int material_variant = -1;
+	const int tangents_variant = -1;
+	const int shadow_variant = -1;
+#endif
+
+layout(location = 7) uniform bool has_baked_tangents;
+
+#define has_tangents (tangents_variant >= 0 ? tangents_variant != 0 : has_baked_tangents)
+#define material_has(flag) (material_variant >= 0 ? (material_variant & (flag)) != 0 : (material.type & (flag)) != 0)
+#define shadows_enabled(flag) (shadow_variant >= 0 ? (shadow_variant & (flag)) != 0 : (per_frame_flags & (flag)) != 0)
@@ -1,10 +1,3 @@
-layout(binding=0) uniform sampler2D material_diffuse;
-layout(binding=1) uniform sampler2D material_normal;
-layout(binding=2) uniform sampler2D material_specular_map;
-layout(binding=3) uniform sampler2D material_roughness_metallic;
-layout(binding=4) uniform sampler2D material_occlusion;
-layout(binding=5) uniform sampler2D material_emission;
-
 struct Material {
 	vec4      base_color_factor;
 	vec3      emission_factor;
@@ -14,10 +7,32 @@ struct Material {
 	float     occlusion_strength;
 	float     alpha_cutoff;
 	int       type;
+	// ARB_bindless_texture handles, only valid with RC_BINDLESS_TEXTURES
+	uvec2     diffuse_handle;
+	uvec2     normal_handle;
+	uvec2     roughness_metallic_handle;
+	uvec2     occlusion_handle;
+	uvec2     emission_handle;
 };
 
-layout(std140, binding=0) uniform MaterialUBO {
-	Material material;
+layout(std430, binding=0) readonly buffer MaterialStorage {
+	Material materials[];
 };
 
+layout(location = 3) uniform int material_index;
+#define material materials[material_index]
 
+#ifdef RC_BINDLESS_TEXTURES
+	#define material_diffuse            sampler2D(material.diffuse_handle)
+	#define material_normal             sampler2D(material.normal_handle)
+	#define material_roughness_metallic sampler2D(material.roughness_metallic_handle)
+	#define material_occlusion          sampler2D(material.occlusion_handle)
+	#define material_emission           sampler2D(material.emission_handle)
+#else
+	layout(binding=0) uniform sampler2D material_diffuse;
+	layout(binding=1) uniform sampler2D material_normal;
+	layout(binding=2) uniform sampler2D material_specular_map;
+	layout(binding=3) uniform sampler2D material_roughness_metallic;
+	layout(binding=4) uniform sampler2D material_occlusion;
+	layout(binding=5) uniform sampler2D material_emission;
+#endif
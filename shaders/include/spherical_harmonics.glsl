@@ -0,0 +1,25 @@
+// Real L2 spherical harmonics basis, direction has to be normalized.
+void sh_basis(vec3 d, out float b[9])
+{
+	b[0] = 0.282095;
+	b[1] = 0.488603 * d.y;
+	b[2] = 0.488603 * d.z;
+	b[3] = 0.488603 * d.x;
+	b[4] = 1.092548 * d.x * d.y;
+	b[5] = 1.092548 * d.y * d.z;
+	b[6] = 0.315392 * (3.0 * d.z * d.z - 1.0);
+	b[7] = 1.092548 * d.x * d.z;
+	b[8] = 0.546274 * (d.x * d.x - d.y * d.y);
+}
+
+// Evaluates coefficients produced by cubemap_irradiance_sh.comp in direction of normal.
+vec3 eval_sh_irradiance(const vec4 sh[9], vec3 n)
+{
+	float b[9];
+	sh_basis(n, b);
+	vec3 irradiance = vec3(0.0);
+	for (int i = 0; i < 9; ++i)
+		irradiance += sh[i].rgb * b[i];
+	// ringing of L2 approximation may go below zero opposite of bright sources
+	return max(irradiance, vec3(0.0));
+}
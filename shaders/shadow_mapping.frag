@@ -1,4 +1,7 @@
 #version 450 core
+#ifdef RC_BINDLESS_TEXTURES
+	#extension GL_ARB_bindless_texture: require
+#endif
 #include "constants.glsl"
 #include "material.glsl"
 